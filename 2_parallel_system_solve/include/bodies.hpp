@@ -9,15 +9,15 @@ class Body
 public:
     Body(long int id, double x, double y, double z, double e0, double e1, double e2, double e3);
 
-    void setPosition(const Eigen::VectorXd& position);
+    void setPosition(const Eigen::Matrix<double, 7, 1>& position);
 
-    const Eigen::VectorXd& getPosition() const;
+    const Eigen::Matrix<double, 7, 1>& getPosition() const;
 
     long int getId() const;
 
 private:
     long int id;
-    Eigen::VectorXd q;
+    Eigen::Matrix<double, 7, 1> q;
 };
 
 #endif // BODIES_HPP
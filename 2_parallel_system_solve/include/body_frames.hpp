@@ -0,0 +1,59 @@
+#ifndef BODY_FRAMES_HPP
+#define BODY_FRAMES_HPP
+
+#include <vector>
+#include <cstdint>
+#include <eigen3/Eigen/Dense>
+#include "constraints.hpp"
+
+// Macierze obrotu i położenia wszystkich ciał wyznaczone raz na jedno obliczenie funkcji więzów.
+// Pozycja 0 to ground (macierz jednostkowa, zerowe położenie), ciało o indeksie i zajmuje
+// pozycję i + 1, więc odczyt nie wymaga rozgałęzienia dla ground_index.
+class BodyFrames
+{
+public:
+    BodyFrames() = default;
+    explicit BodyFrames(int num_bodies);
+
+    void resize(int num_bodies);
+
+    // Wszystkie ciała
+    void update(const Eigen::VectorXd& q);
+
+    // Ciała first .. last - 1 (np. fragment przy aktualizacji równoległej)
+    void update(const Eigen::VectorXd& q, std::int32_t first, std::int32_t last);
+
+    // Tylko jedno ciało - np. zaburzone przy liczeniu kolumny jakobianu
+    void update(const Eigen::VectorXd& q, std::int32_t index);
+
+    // Przywrócenie wpisu jednego ciała z innej pamięci podręcznej
+    void restore(const BodyFrames& other, std::int32_t index);
+
+    const Eigen::Matrix3d& rotation(std::int32_t index) const
+    {
+        return rotations[index + 1];
+    }
+
+    const Eigen::Vector3d& position(std::int32_t index) const
+    {
+        return positions[index + 1];
+    }
+
+    // Surowe dane dla jąder wektorowych (simd_kernels.hpp), przesunięte tak,
+    // że indeks ciała (także ground_index = -1) jest bezpośrednio indeksem tablicy
+    const double* rotationData() const
+    {
+        return rotations.data()->data() + 9;
+    }
+
+    const double* positionData() const
+    {
+        return positions.data()->data() + 3;
+    }
+
+private:
+    std::vector<Eigen::Matrix3d> rotations;
+    std::vector<Eigen::Vector3d> positions;
+};
+
+#endif // BODY_FRAMES_HPP
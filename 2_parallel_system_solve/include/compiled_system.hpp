@@ -0,0 +1,77 @@
+#ifndef COMPILED_SYSTEM_HPP
+#define COMPILED_SYSTEM_HPP
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <memory>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+#include "multibody_system.hpp"
+#include "constraint_buckets.hpp"
+#include "symbolic_cache.hpp"
+#include "model_loader.hpp"
+
+class ModelImage;
+
+// Niezmienna, skompilowana postać układu wieloczłonowego przekazywana przez referencję
+// do solvera: indeksy ciał, kubełki ograniczeń, przesunięcia wierszy i struktura
+// rzadkości jakobianu wyznaczone raz - kolejne rozwiązania nie ponoszą kosztu przygotowania.
+// Struktura jakobianu pochodzi ze wspólnej pamięci podręcznej (raz na topologię).
+class CompiledSystem
+{
+public:
+    explicit CompiledSystem(const MultibodySystem& mbs);
+
+    // Z obrazu binarnego (model_image.hpp): tablice kopiowane w całości, bez budowy układu
+    // i bez analizy symbolicznej (struktura jakobianu i uporządkowanie pochodzą z obrazu)
+    explicit CompiledSystem(const ModelImage& image, const DriverRegistry& drivers = DriverRegistry{});
+
+    int getNumBodies() const;
+    int getNumCoordinates() const;
+    int getNumEquations() const;
+
+    const std::vector<long int>& getBodyIds() const;
+    std::int32_t getBodyIndex(long int id) const;
+
+    // Położenia i orientacje ciał w chwili kompilacji
+    const Eigen::VectorXd& getInitialQ() const;
+
+    const ConstraintBuckets& getBuckets() const;
+
+    // Ograniczenia zależne od danego ciała (CSR: body_constraints[offsets[i] .. offsets[i + 1]]),
+    // w kolejności rosnących wierszy
+    const std::vector<std::int32_t>& getBodyConstraintOffsets() const;
+    const std::vector<ConstraintRef>& getBodyConstraints() const;
+
+    // Struktura jakobianu (wartości zerowe); kolumna ciała zawiera wiersze jego ograniczeń
+    const Eigen::SparseMatrix<double>& getJacobianPattern() const;
+
+    // Analiza symboliczna współdzielona przez układy o tej samej topologii (SymbolicCache::global())
+    const SymbolicAnalysis& getSymbolic() const;
+
+    // Kanoniczny skrót grafu ciał i ograniczeń - równy dla układów o tej samej topologii
+    std::uint64_t getTopologyHash() const;
+
+    // Czy układy mają identyczną topologię: te same ciała, typy i połączenia ograniczeń
+    // (różnić mogą się tylko wartości liczbowe - punkty, osie, położenia)
+    bool sameTopology(const CompiledSystem& other) const;
+
+    // frames - macierze obrotu wyznaczone wcześniej dla tego samego q
+    void evaluate(const Eigen::VectorXd& q, const BodyFrames& frames, double t, Eigen::Ref<Eigen::VectorXd> phi) const;
+
+    // Wersja wygodna: macierze obrotu liczone w tymczasowej pamięci podręcznej
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> phi) const;
+
+private:
+    std::vector<long int> body_ids;
+    std::unordered_map<long int, std::int32_t> body_index;
+    Eigen::VectorXd initial_q;
+    ConstraintBuckets buckets;
+    std::vector<std::int32_t> body_constraint_offsets;
+    std::vector<ConstraintRef> body_constraints;
+    std::uint64_t topology_hash = 0;
+    std::shared_ptr<const SymbolicAnalysis> symbolic;
+};
+
+#endif // COMPILED_SYSTEM_HPP
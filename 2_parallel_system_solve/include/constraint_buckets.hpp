@@ -0,0 +1,165 @@
+#ifndef CONSTRAINT_BUCKETS_HPP
+#define CONSTRAINT_BUCKETS_HPP
+
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "constraints.hpp"
+#include "body_frames.hpp"
+#include "frame_lanes.hpp"
+
+class MultibodySystem;
+class ModelImage;
+class DriverRegistry;
+
+enum class ConstraintType : std::uint8_t
+{
+    distance,
+    fixed_parameter,
+    fixed_orientation,
+    fixed_position,
+    ball_joint,
+    revolute,
+    quaternion,
+    generic
+};
+
+// Odwołanie do pojedynczego ograniczenia w kubełku: typ, pozycja w kubełku,
+// pierwszy wiersz, liczba równań i indeksy ciał (ground_index dla ground)
+struct ConstraintRef
+{
+    ConstraintType type;
+    std::int32_t index;
+    std::int32_t row;
+    std::int32_t equations;
+    std::int32_t body1;
+    std::int32_t body2;
+};
+
+inline bool operator==(const ConstraintRef& a, const ConstraintRef& b)
+{
+    return a.type == b.type && a.index == b.index && a.row == b.row && a.equations == b.equations &&
+           a.body1 == b.body1 && a.body2 == b.body2;
+}
+
+inline bool operator!=(const ConstraintRef& a, const ConstraintRef& b)
+{
+    return !(a == b);
+}
+
+// Skompilowana reprezentacja ograniczeń: więzy pogrupowane według typu w jednorodne
+// tablice (structure of arrays), liczone w ciasnych pętlach bez wywołań wirtualnych.
+// row - pierwszy wiersz ograniczenia w wektorze funkcji więzów (kolejność jak w układzie).
+
+struct DistanceBucket
+{
+    std::vector<std::int32_t> body1, body2, row;
+    std::vector<Eigen::Vector3d> body1_point, body2_point;
+    std::vector<Eigen::Vector3d (*)(double)> distance;
+};
+
+struct FixedParameterBucket
+{
+    std::vector<std::int32_t> body, row;
+    std::vector<int> parameter_index;
+};
+
+struct FixedOrientationBucket
+{
+    std::vector<std::int32_t> body, row;
+    std::vector<Eigen::Vector4d> orientation;
+};
+
+struct FixedPositionBucket
+{
+    std::vector<std::int32_t> body, row;
+    std::vector<Eigen::Vector3d> position;
+};
+
+struct BallJointBucket
+{
+    std::vector<std::int32_t> body1, body2, row;
+    std::vector<Eigen::Vector3d> body1_point, body2_point;
+};
+
+struct RevoluteBucket
+{
+    std::vector<std::int32_t> body1, body2, row;
+    std::vector<Eigen::Vector3d> body1_point, body2_point, body1_axis, body2_axis;
+};
+
+struct QuaternionBucket
+{
+    std::vector<std::int32_t> body, row;
+};
+
+// Ograniczenia użytkownika (spoza powyższych typów) - liczone wirtualnie
+struct GenericBucket
+{
+    std::vector<std::int32_t> body1, body2, row;
+    std::vector<std::shared_ptr<const Constraint>> constraints;
+};
+
+// Fragment jednego kubełka: ograniczenia begin .. end - 1 danego typu (najwyżej 64)
+struct BucketChunk
+{
+    ConstraintType type;
+    std::size_t begin;
+    std::size_t end;
+};
+
+class ConstraintBuckets
+{
+public:
+    explicit ConstraintBuckets(const MultibodySystem& mbs);
+
+    // Kubełki zapisane w obrazie (model_image.hpp); funkcje wymuszenia odszukiwane po nazwach
+    ConstraintBuckets(const ModelImage& image, const DriverRegistry& drivers);
+
+    // Wszystkie funkcje więzów zapisywane do phi (rozmiar getNumEquations());
+    // frames - macierze obrotu ciał wyznaczone dla tego samego q
+    void evaluate(const Eigen::VectorXd& q, const BodyFrames& frames, double t, Eigen::Ref<Eigen::VectorXd> phi) const;
+
+    // Tylko jeden fragment kubełka; fragmenty zapisują rozłączne wiersze phi,
+    // więc mogą być liczone równolegle
+    void evaluate(const BucketChunk& chunk, const Eigen::VectorXd& q, const BodyFrames& frames, double t,
+                  Eigen::Ref<Eigen::VectorXd> phi) const;
+
+    // Tylko jedno ograniczenie - wiersze ref.row .. ref.row + ref.equations w phi
+    void evaluate(const ConstraintRef& ref, const Eigen::VectorXd& q, const BodyFrames& frames, double t,
+                  Eigen::Ref<Eigen::VectorXd> phi) const;
+
+    // Jedno ograniczenie ciała body dla wszystkich pasów lanes (FrameLanes::perturb) naraz;
+    // out.values[e][l] - równanie e w pasie l. Zwraca false dla ograniczeń ogólnych
+    // (GenericBucket), które trzeba liczyć kolumna po kolumnie.
+    bool evaluateLanes(const ConstraintRef& ref, std::int32_t body, const FrameLanes& lanes, const BodyFrames& frames,
+                       double t, ResidualLanes& out) const;
+
+    int getNumEquations() const;
+
+    // Ograniczenia w kolejności dodania do układu
+    const std::vector<ConstraintRef>& getRefs() const;
+
+    // Podział wszystkich kubełków na fragmenty (kolejność jak w evaluate(q, frames, t, phi))
+    const std::vector<BucketChunk>& getChunks() const;
+
+    DistanceBucket distance;
+    FixedParameterBucket fixed_parameter;
+    FixedOrientationBucket fixed_orientation;
+    FixedPositionBucket fixed_position;
+    BallJointBucket ball_joint;
+    RevoluteBucket revolute;
+    QuaternionBucket quaternion;
+    GenericBucket generic;
+
+private:
+    // Podział wypełnionych kubełków na fragmenty
+    void buildChunks();
+
+    std::vector<ConstraintRef> refs;
+    std::vector<BucketChunk> chunks;
+    int num_equations = 0;
+};
+
+#endif // CONSTRAINT_BUCKETS_HPP
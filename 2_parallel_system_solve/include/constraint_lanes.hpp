@@ -0,0 +1,134 @@
+#ifndef CONSTRAINT_LANES_HPP
+#define CONSTRAINT_LANES_HPP
+
+#include <cmath>
+
+// Wzory ograniczeń wbudowanych dla W pasów naraz. Pas to jeden wariant stanu: stan z zaburzoną
+// współrzędną (ConstraintBuckets::evaluateLanes) albo jeden układ partii (EnsembleBatch).
+// Macierze obrotu (kolumnami) i położenia ciał ułożone są pasami - element j pod [j * W + l],
+// a równanie e wyniku trafia pod out[e * W + l]. Wzory są te same co w jądrach skalarnych,
+// więc każdy pas zgadza się z wartością liczoną kolumna po kolumnie z dokładnością do
+// zaokrągleń (patrz rotation_matrix()).
+
+// Parametry ograniczeń w pasach - składowa i pasa l to v(i, l):
+// wektor wspólny dla wszystkich pasów
+struct SharedLanes
+{
+    const double* data;
+
+    double operator()(int i, int) const
+    {
+        return data[i];
+    }
+};
+
+// wektor ułożony pasami, składowa i pasa l pod [i * W + l]
+template<int W>
+struct InterleavedLanes
+{
+    const double* data;
+
+    double operator()(int i, int l) const
+    {
+        return data[i * W + l];
+    }
+};
+
+// Położenie i obrót ciała we wszystkich pasach
+struct LaneFrame
+{
+    const double* rotation;  // [9 * W]
+    const double* position;  // [3 * W]
+};
+
+template<int W, class Point>
+inline void rotate_lanes(const double* m, const Point& p, double (&out)[3][W])
+{
+    for(int l = 0; l < W; l++)
+    {
+        out[0][l] = (m[0 * W + l] * p(0, l) + m[3 * W + l] * p(1, l)) + m[6 * W + l] * p(2, l);
+        out[1][l] = (m[1 * W + l] * p(0, l) + m[4 * W + l] * p(1, l)) + m[7 * W + l] * p(2, l);
+        out[2][l] = m[2 * W + l] * p(0, l) + (m[5 * W + l] * p(1, l) + m[8 * W + l] * p(2, l));
+    }
+}
+
+template<int W, class Point>
+inline void transform_lanes(const LaneFrame& frame, const Point& p, double (&out)[3][W])
+{
+    rotate_lanes<W>(frame.rotation, p, out);
+    for(int i = 0; i < 3; i++)
+        for(int l = 0; l < W; l++)
+            out[i][l] = frame.position[i * W + l] + out[i][l];
+}
+
+// Ball joint (oraz pierwsze trzy równania revolute): (r2 + R2 p2) - (r1 + R1 p1)
+template<int W, class Point1, class Point2>
+inline void point_difference_lanes(const LaneFrame& frame1, const Point1& point1, const LaneFrame& frame2,
+                                   const Point2& point2, double* out)
+{
+    double world1[3][W], world2[3][W];
+    transform_lanes<W>(frame1, point1, world1);
+    transform_lanes<W>(frame2, point2, world2);
+
+    for(int i = 0; i < 3; i++)
+        for(int l = 0; l < W; l++)
+            out[i * W + l] = world2[i][l] - world1[i][l];
+}
+
+// Distance: (r2 + R2 p2) - (r1 + R1 p1) - d(t)
+template<int W, class Point1, class Point2, class Distance>
+inline void distance_lanes(const LaneFrame& frame1, const Point1& point1, const LaneFrame& frame2,
+                           const Point2& point2, const Distance& distance, double* out)
+{
+    point_difference_lanes<W>(frame1, point1, frame2, point2, out);
+    for(int i = 0; i < 3; i++)
+        for(int l = 0; l < W; l++)
+            out[i * W + l] = out[i * W + l] - distance(i, l);
+}
+
+// Revolute: zbieżność punktów i dwie pierwsze składowe (R1 a1) x (R2 a2)
+template<int W, class Vector>
+inline void revolute_lanes(const LaneFrame& frame1, const Vector& point1, const Vector& axis1,
+                           const LaneFrame& frame2, const Vector& point2, const Vector& axis2, double* out)
+{
+    point_difference_lanes<W>(frame1, point1, frame2, point2, out);
+
+    double world_axis1[3][W], world_axis2[3][W];
+    rotate_lanes<W>(frame1.rotation, axis1, world_axis1);
+    rotate_lanes<W>(frame2.rotation, axis2, world_axis2);
+    for(int l = 0; l < W; l++)
+    {
+        out[3 * W + l] = world_axis1[1][l] * world_axis2[2][l] - world_axis1[2][l] * world_axis2[1][l];
+        out[4 * W + l] = world_axis1[2][l] * world_axis2[0][l] - world_axis1[0][l] * world_axis2[2][l];
+    }
+}
+
+// Fixed parameter
+template<int W, class Value>
+inline void parameter_lanes(const Value& value, double* out)
+{
+    for(int l = 0; l < W; l++)
+        out[l] = value(0, l);
+}
+
+// Fixed position (size 3) i fixed orientation (size 4): value - reference
+template<int W, class Value, class Reference>
+inline void difference_lanes(int size, const Value& value, const Reference& reference, double* out)
+{
+    for(int i = 0; i < size; i++)
+        for(int l = 0; l < W; l++)
+            out[i * W + l] = value(i, l) - reference(i, l);
+}
+
+// Quaternion: |e| - 1
+template<int W, class Quaternion>
+inline void quaternion_norm_lanes(const Quaternion& e, double* out)
+{
+    for(int l = 0; l < W; l++)
+    {
+        const double e0 = e(0, l), e1 = e(1, l), e2 = e(2, l), e3 = e(3, l);
+        out[l] = std::sqrt((e0 * e0 + e2 * e2) + (e1 * e1 + e3 * e3)) - 1.0;
+    }
+}
+
+#endif // CONSTRAINT_LANES_HPP
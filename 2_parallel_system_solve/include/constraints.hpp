@@ -6,13 +6,27 @@
 #include "bodies.hpp"
 #include <memory>
 #include <iostream>
+#include <cstdint>
+#include <unordered_map>
+#include <variant>
+#include <type_traits>
 
 // Stała pozycja/rotacja dla ciała typu ground
 extern const Eigen::Matrix<double, 7, 1> ground;
 
+// Indeks ciała ground oraz indeks ciała, którego id nie zostało jeszcze rozwiązane
+constexpr std::int32_t ground_index = -1;
+constexpr std::int32_t unresolved_index = -2;
+
 // Funkcje pomocnicze do mapowania stanu układu
-Eigen::Map<const Eigen::VectorXd> get_body_position(const Eigen::VectorXd& q, long int id, const std::vector<long int>& body_ids);
-Eigen::Map<const Eigen::VectorXd> get_body_rotation(const Eigen::VectorXd& q, long int id, const std::vector<long int>& body_ids);
+Eigen::Map<const Eigen::Vector3d> get_body_position(const Eigen::VectorXd& q, long int id, const std::vector<long int>& body_ids);
+Eigen::Map<const Eigen::Vector4d> get_body_rotation(const Eigen::VectorXd& q, long int id, const std::vector<long int>& body_ids);
+
+// Wersje O(1) - indeks ciała w wektorze q wyznaczony wcześniej
+Eigen::Map<const Eigen::Vector3d> get_body_position(const Eigen::VectorXd& q, std::int32_t index);
+Eigen::Map<const Eigen::Vector4d> get_body_rotation(const Eigen::VectorXd& q, std::int32_t index);
+
+class ConstraintBuckets;
 
 // Klasa bazowa dla ograniczeń
 class Constraint
@@ -20,29 +34,70 @@ class Constraint
 public:
     Constraint(long int id, long int body1_id, long int body2_id);
 
+    virtual ~Constraint() = default;
+
     virtual std::shared_ptr<Constraint> clone() const = 0;
 
-    virtual Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids);
-    virtual double equations_number();
+    // Wartości funkcji więzów zapisywane do bufora wywołującego (bez alokacji);
+    // wymaga rozwiązanych indeksów ciał (resolveBodies)
+    virtual void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const = 0;
+    virtual int equations_number() const = 0;
+
+    // Zamiana id ciał na indeksy w wektorze q; zwraca false, gdy któreś id jest nieznane
+    bool resolveBodies(const std::unordered_map<long int, std::int32_t>& body_index);
+
+    long int getId() const;
+    long int getBody1Id() const;
+    long int getBody2Id() const;
+    std::int32_t getBody1Index() const;
+    std::int32_t getBody2Index() const;
 
 protected:
     long int id;
     long int body1_id;
     long int body2_id;
+    std::int32_t body1_index = unresolved_index;
+    std::int32_t body2_index = unresolved_index;
+};
+
+// Adapter dla klas pisanych pod dawny interfejs (wyszukiwanie ciał po id, wynik przez wartość):
+// wystarczy dziedziczyć po LegacyConstraint zamiast po Constraint. ConstrainingFunctions dostaje
+// tylko współrzędne obu ciał ograniczenia i ich id, więc koszt wywołania nie zależy od rozmiaru q.
+class LegacyConstraint : public Constraint
+{
+public:
+    LegacyConstraint(long int id, long int body1_id, long int body2_id);
+
+    virtual Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids) = 0;
+    virtual double equations_number() = 0;
+
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const final;
+    int equations_number() const final;
+
+private:
+    // Dostęp do niestałych metod dawnego interfejsu
+    LegacyConstraint& legacy() const;
+
+    // id ciał (bez ground) w kolejności ich współrzędnych w lokalnym wektorze q
+    std::vector<long int> body_ids;
 };
 
 // Ograniczenie odległości między punktami na ciałach
 class DistanceConstraint : public Constraint
 {
+    friend class ConstraintBuckets;
+
 public:
+    static constexpr int equations = 3;
+
     DistanceConstraint(long int id, long int body1_id, long int body2_id, const Eigen::Vector3d& body1_point,
                        const Eigen::Vector3d& body2_point,
                        Eigen::Vector3d (*distance)(double));
 
     std::shared_ptr<Constraint> clone() const override;
 
-    Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids) override;
-    double equations_number() override;
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const override;
+    int equations_number() const override;
 
 private:
     const Eigen::Vector3d body1_point;
@@ -53,13 +108,17 @@ private:
 // Ograniczenie na konkretny parametr pozycji lub orientacji
 class FixedParameterConstraint : public Constraint
 {
+    friend class ConstraintBuckets;
+
 public:
+    static constexpr int equations = 1;
+
     FixedParameterConstraint(long int id, long int body_id, int parameter_index);
 
     std::shared_ptr<Constraint> clone() const override;
 
-    Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids) override;
-    double equations_number() override;
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const override;
+    int equations_number() const override;
 
 private:
     int parameter_index;
@@ -68,13 +127,17 @@ private:
 // Ograniczenie orientacji względem ustalonego wektora
 class FixedOrientationConstraint : public Constraint
 {
+    friend class ConstraintBuckets;
+
 public:
+    static constexpr int equations = 4;
+
     FixedOrientationConstraint(long int id, long int body_id, const Eigen::Vector4d& orientation);
 
     std::shared_ptr<Constraint> clone() const override;
 
-    Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids) override;
-    double equations_number() override;
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const override;
+    int equations_number() const override;
 
 private:
     const Eigen::Vector4d orientation;
@@ -83,13 +146,17 @@ private:
 // Ograniczenie pozycji względem stałego punktu
 class FixedPositionConstraint : public Constraint
 {
+    friend class ConstraintBuckets;
+
 public:
+    static constexpr int equations = 3;
+
     FixedPositionConstraint(long int id, long int body_id, const Eigen::Vector3d& position);
 
     std::shared_ptr<Constraint> clone() const override;
 
-    Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids) override;
-    double equations_number() override;
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const override;
+    int equations_number() const override;
 
 private:
     const Eigen::Vector3d position;
@@ -98,14 +165,18 @@ private:
 // Ograniczenie kuliste – wspólny punkt w przestrzeni
 class BallJointConstraint : public Constraint
 {
+    friend class ConstraintBuckets;
+
 public:
+    static constexpr int equations = 3;
+
     BallJointConstraint(long int id, long int body1_id, long int body2_id, const Eigen::Vector3d& body1_point,
                         const Eigen::Vector3d& body2_point);
 
     std::shared_ptr<Constraint> clone() const override;
 
-    Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids) override;
-    double equations_number() override;
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const override;
+    int equations_number() const override;
 
 private:
     const Eigen::Vector3d body1_point;
@@ -114,15 +185,19 @@ private:
 
 class RevoluteConstraint : public Constraint
 {
+    friend class ConstraintBuckets;
+
 public:
+    static constexpr int equations = 5;
+
     RevoluteConstraint(long int id, long int body1_id, long int body2_id, const Eigen::Vector3d& body1_point,
                         const Eigen::Vector3d& body2_point, const Eigen::Vector3d& body1_axis,
                         const Eigen::Vector3d& body2_axis);
 
     std::shared_ptr<Constraint> clone() const override;
 
-    Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids) override;
-    double equations_number() override;
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const override;
+    int equations_number() const override;
 
 private:
     const Eigen::Vector3d body1_point;
@@ -133,13 +208,83 @@ private:
 
 class QuaternionConstraint : public Constraint
 {
+    friend class ConstraintBuckets;
+
 public:
+    static constexpr int equations = 1;
+
     QuaternionConstraint(long int id, long int body1_id);
 
     std::shared_ptr<Constraint> clone() const override;
 
-    Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids) override;
-    double equations_number() override;
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const override;
+    int equations_number() const override;
 };
 
+// Ograniczenie przechowywane bez wywołań wirtualnych: wbudowane typy w miejscu,
+// ograniczenia użytkownika (klasy pochodne Constraint) przez wskaźnik na klasę bazową
+using ConstraintVariant = std::variant<DistanceConstraint, FixedParameterConstraint, FixedOrientationConstraint,
+                                       FixedPositionConstraint, BallJointConstraint, RevoluteConstraint,
+                                       QuaternionConstraint, std::shared_ptr<Constraint>>;
+
+// Kopia constraint: wbudowany typ (dokładnie, nie klasa pochodna) trafia do wariantu,
+// pozostałe są klonowane
+ConstraintVariant make_constraint_variant(const Constraint& constraint);
+
+// Wywołanie f(c) dla ograniczenia przechowywanego w wariancie: c to wbudowany typ
+// lub const Constraint& dla ograniczeń użytkownika
+template<typename F>
+decltype(auto) visit_constraint(const ConstraintVariant& constraint, F&& f)
+{
+    return std::visit([&](const auto& c) -> decltype(auto)
+    {
+        if constexpr(std::is_same_v<std::decay_t<decltype(c)>, std::shared_ptr<Constraint>>)
+            return f(static_cast<const Constraint&>(*c));
+        else
+            return f(c);
+    }, constraint);
+}
+
+inline const Constraint& as_constraint(const ConstraintVariant& constraint)
+{
+    return visit_constraint(constraint, [](const Constraint& c) -> const Constraint& { return c; });
+}
+
+inline int equations_number(const ConstraintVariant& constraint)
+{
+    return visit_constraint(constraint, [](const auto& c)
+    {
+        using Type = std::decay_t<decltype(c)>;
+        if constexpr(std::is_same_v<Type, Constraint>)
+            return c.equations_number();
+        else
+            return Type::equations;
+    });
+}
+
+// Wywołanie kwalifikowane (Type::evaluate) nie przechodzi przez vtable i może być rozwinięte
+inline void evaluate(const ConstraintVariant& constraint, const Eigen::VectorXd& q, double t,
+                     Eigen::Ref<Eigen::VectorXd> functions)
+{
+    visit_constraint(constraint, [&](const auto& c)
+    {
+        using Type = std::decay_t<decltype(c)>;
+        if constexpr(std::is_same_v<Type, Constraint>)
+            c.evaluate(q, t, functions);
+        else
+            c.Type::evaluate(q, t, functions);
+    });
+}
+
+inline bool resolve_bodies(ConstraintVariant& constraint, const std::unordered_map<long int, std::int32_t>& body_index)
+{
+    return std::visit([&](auto& c)
+    {
+        if constexpr(std::is_same_v<std::decay_t<decltype(c)>, std::shared_ptr<Constraint>>)
+            return c->resolveBodies(body_index);
+        else
+            return c.resolveBodies(body_index);
+    }, constraint);
+}
+
 #endif // CONSTRAINTS_HPP
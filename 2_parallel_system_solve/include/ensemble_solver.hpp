@@ -0,0 +1,84 @@
+#ifndef ENSEMBLE_SOLVER_HPP
+#define ENSEMBLE_SOLVER_HPP
+
+#include <vector>
+#include <cstdint>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "multibody_system.hpp"
+#include "compiled_system.hpp"
+#include "normal_equations_solver.hpp"
+
+// Liczba układów liczonych razem (8 liczb double = jeden rejestr AVX-512)
+constexpr int ensemble_width = 8;
+
+extern template class NormalEquationsLanes<ensemble_width>;
+
+// Partia do ensemble_width układów o identycznej topologii (CompiledSystem::sameTopology),
+// rozwiązywanych w lockstepie. Dane ułożone są z indeksem układu jako najszybciej
+// zmiennym (system-minor): wartość k układu s leży pod [k * ensemble_width + s], więc
+// residuum, jakobian oraz rozkład LDL^T równań normalnych liczone są jedną pętlą po
+// układach. Część symboliczna rozkładu jest wspólna dla całej partii.
+// Wyniki zgodne z NormalEquationsSession z dokładnością do zaokrągleń.
+class EnsembleBatch
+{
+public:
+    EnsembleBatch(const std::vector<const CompiledSystem*>& systems, const NormalEquationsSymbolic& symbolic,
+                  double regularization = 1e-15);
+
+    EnsembleBatch(const EnsembleBatch&) = delete;
+    EnsembleBatch& operator=(const EnsembleBatch&) = delete;
+
+    int getNumSystems() const;
+
+    // Wymiana stanu jednego układu z partią
+    void setQ(int system, const Eigen::VectorXd& q);
+    void getQ(int system, Eigen::VectorXd& q) const;
+
+    // Metoda Newtona (cięciwowa, jak SolverSession::solve) dla wszystkich układów naraz;
+    // układ, który osiągnął zbieżność, nie jest dalej zmieniany
+    void solve(double t);
+
+    // Liczba iteracji ostatniego solve() dla układu
+    int getIterations(int system) const;
+
+private:
+    void updateFrames();
+    void updateFrame(std::int32_t body);
+    void evaluateConstraint(const ConstraintRef& ref, double t, double* out) const;
+    void evaluate(double t, std::vector<double>& out);
+    void jacobian(double t);
+    bool factorize();
+    void solveLinear();
+
+    int num_systems;
+    int num_coordinates;
+    int num_equations;
+    const CompiledSystem& topology;
+    const NormalEquationsSymbolic& symbolic;
+
+    // Parametry ograniczeń układów, [(k * wymiar + i) * ensemble_width + s]
+    std::vector<double> distance_points1, distance_points2;
+    std::vector<Eigen::Vector3d (*)(double)> distance_functions;
+    std::vector<double> fixed_orientations, fixed_positions;
+    std::vector<double> ball_joint_points1, ball_joint_points2;
+    std::vector<double> revolute_points1, revolute_points2, revolute_axes1, revolute_axes2;
+
+    // Stan, macierze obrotu i położenia ciał (pozycja 0 - ground) oraz bufory Newtona
+    std::vector<double> q;
+    std::vector<double> rotations, positions;
+    std::vector<double> phi, b, delta_q, jacobian_values;
+
+    // Rozkład LDL^T równań normalnych wszystkich układów partii
+    NormalEquationsLanes<ensemble_width> linear;
+
+    std::vector<int> iterations;
+};
+
+// Rozwiązanie wielu układów: układy o identycznej topologii grupowane są w partie
+// EnsembleBatch i liczone w lockstepie (partie równolegle w TBB), pozostałe (np. z
+// ograniczeniami użytkownika) osobno. Wynik w kolejności systems.
+std::vector<std::vector<State>> ensemble_solver(const std::vector<CompiledSystem>& systems, double end_time);
+
+#endif // ENSEMBLE_SOLVER_HPP
@@ -0,0 +1,21 @@
+#ifndef FLOW_SOLVER_HPP
+#define FLOW_SOLVER_HPP
+
+#include <vector>
+
+#include "multibody_system.hpp"
+#include "compiled_system.hpp"
+#include "solver_session.hpp"
+
+// Rozwiązanie partii układów jako jeden oneapi::tbb::flow::graph. Węzły odpowiadają etapom
+// iteracji Newtona (residuum -> jakobian -> rozkład -> aktualizacja) oraz przejściu do
+// kolejnego kroku czasowego; komunikatem jest indeks układu, więc każdy układ przechodzi
+// przez graf sekwencyjnie, a różne układy - równocześnie. Nie ma barier między układami:
+// rozkład jednego układu może się nakładać z jakobianem innego.
+// Sesje to RuntimeSolverSession z solverem liniowym linear_solver; przy sparse_qr wyniki
+// identyczne z multibody_solver. Wynik w kolejności systems.
+std::vector<std::vector<State>> flow_solver(const std::vector<CompiledSystem>& systems, double end_time,
+                                            int block_size = 7,
+                                            LinearSolverType linear_solver = LinearSolverType::sparse_qr);
+
+#endif // FLOW_SOLVER_HPP
@@ -0,0 +1,35 @@
+#ifndef FRAME_LANES_HPP
+#define FRAME_LANES_HPP
+
+#include <cstdint>
+#include <eigen3/Eigen/Dense>
+#include "body_frames.hpp"
+
+// Liczba pasów: jeden na każdą współrzędną ciała (7) + pas bez zaburzenia
+constexpr int lane_count = 8;
+
+// Współrzędne, położenie i macierz obrotu jednego ciała w lane_count wariantach naraz -
+// dane ułożone pasami (lane-minor), tak aby pętle po pasach wektoryzowały się (AVX2/AVX-512).
+// perturb(): pas j < 7 to stan z zaburzoną współrzędną j, pas 7 - stan niezaburzony.
+struct alignas(64) FrameLanes
+{
+    double position[3][lane_count];
+    double quaternion[4][lane_count];
+    double rotation[9][lane_count];
+
+    // Wszystkie pasy zaburzone kolejnymi współrzędnymi ciała index o h
+    void perturb(const Eigen::VectorXd& q, std::int32_t index, double h);
+
+    // Wszystkie pasy równe stanowi ciała z pamięci podręcznej (także dla ground);
+    // uzupełnia tylko położenie i obrót
+    void broadcast(const BodyFrames& frames, std::int32_t index);
+};
+
+// Wartości funkcji jednego ograniczenia (do 5 równań) we wszystkich pasach
+struct alignas(64) ResidualLanes
+{
+    static constexpr int max_equations = 5;
+    double values[max_equations][lane_count];
+};
+
+#endif // FRAME_LANES_HPP
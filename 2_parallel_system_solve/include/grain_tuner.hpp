@@ -0,0 +1,97 @@
+#ifndef GRAIN_TUNER_HPP
+#define GRAIN_TUNER_HPP
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <utility>
+
+#include "parallel_backend.hpp"
+
+// Sposób zrównoleglenia jednego liczenia jakobianu
+struct JacobianSchedule
+{
+    int block_size;
+    Partitioner partitioner;
+
+    bool operator==(const JacobianSchedule& other) const
+    {
+        return block_size == other.block_size && partitioner == other.partitioner;
+    }
+};
+
+// Wartość block_size (SolverSession, multibody_solver) włączająca automatyczny dobór
+constexpr int autotune_block_size = -1;
+
+// Automatyczny dobór rozmiaru bloku i partycjonowania. Kolejne liczenia jakobianu
+// (także z różnych sesji o tej samej topologii) dostają kolejnych kandydatów; każdy
+// mierzony jest trials razy, liczy się najkrótszy czas. Pierwszy pomiar (zimny start)
+// jest odrzucany. Po zmierzeniu wszystkich najlepszy kandydat zostaje ustalony na resztę
+// działania programu.
+class GrainTuner
+{
+public:
+    explicit GrainTuner(int num_coordinates, int trials = 2);
+
+    // Od razu ustalony (np. wczytany z pliku)
+    explicit GrainTuner(JacobianSchedule schedule);
+
+    GrainTuner(const GrainTuner&) = delete;
+    GrainTuner& operator=(const GrainTuner&) = delete;
+
+    // Ustawienie dla najbliższego liczenia jakobianu
+    JacobianSchedule next() const;
+
+    // Czas liczenia jakobianu z ustawieniem zwróconym przez next()
+    void record(const JacobianSchedule& schedule, double seconds);
+
+    bool isLocked() const;
+
+    // Najlepsze dotychczas ustawienie
+    JacobianSchedule getBest() const;
+
+private:
+    struct Candidate
+    {
+        JacobianSchedule schedule;
+        double time;
+        int trials;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Candidate> candidates;
+    std::size_t current = 0;
+    int trials;
+    bool warmed_up = false;
+
+    std::atomic<bool> locked{false};
+    JacobianSchedule best;
+};
+
+// Wyniki doboru dla par (skrót topologii, liczba wątków), współdzielone przez sesje.
+// Ustalone wyniki można zapisać do pliku tekstowego i wczytać w kolejnym uruchomieniu.
+class TuningStore
+{
+public:
+    static TuningStore& global();
+
+    std::shared_ptr<GrainTuner> get(std::uint64_t topology_hash, int num_threads, int num_coordinates);
+
+    // Plik: jeden wiersz "skrót liczba_wątków rozmiar_bloku partycjonowanie" na ustalony wynik.
+    // load(): false, gdy pliku nie ma; std::runtime_error przy błędnym wierszu
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    std::size_t size() const;
+    void clear();
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::pair<std::uint64_t, int>, std::shared_ptr<GrainTuner>> tuners;
+};
+
+#endif // GRAIN_TUNER_HPP
@@ -0,0 +1,147 @@
+#ifndef MODEL_IMAGE_HPP
+#define MODEL_IMAGE_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "constraint_buckets.hpp"
+#include "model_loader.hpp"
+
+class CompiledSystem;
+struct ImageHeader;
+
+// Binarny obraz skompilowanego układu: rozwiązane indeksy ciał, kubełki ograniczeń,
+// sąsiedztwo ciało -> ograniczenia, struktura jakobianu oraz analiza symboliczna równań
+// normalnych (uporządkowanie AMD, drzewo eliminacji). Plik to nagłówek z tablicą sekcji
+// i tablice wyrównane do 64 bajtów, w kolejności i formacie pamięci tej maszyny.
+// Funkcje wymuszenia zapisywane są nazwami z DriverRegistry. Ograniczenia użytkownika
+// (GenericBucket) nie mogą być zapisane.
+
+constexpr std::uint32_t model_image_version = 1;
+
+// Sekcje obrazu; numeracja jest częścią formatu (nowe tylko na końcu, ze zmianą wersji)
+enum class ImageSection : std::uint32_t
+{
+    body_ids,                 // std::int64_t
+    initial_q,                // double
+    refs,                     // ConstraintRef, kolejność dodania
+    body_constraint_offsets,  // std::int32_t
+    body_constraints,         // ConstraintRef
+    jacobian_outer,           // int, CSC
+    jacobian_inner,           // int
+    jacobian_values,          // double (zera)
+
+    distance_body1, distance_body2, distance_row,  // std::int32_t
+    distance_body1_point, distance_body2_point,    // double x 3
+    distance_driver,                               // std::uint32_t - numer nazwy w driver_names
+
+    fixed_parameter_body, fixed_parameter_row, fixed_parameter_index,  // std::int32_t
+    fixed_orientation_body, fixed_orientation_row,                     // std::int32_t
+    fixed_orientation_orientation,                                     // double x 4
+    fixed_position_body, fixed_position_row,                           // std::int32_t
+    fixed_position_position,                                           // double x 3
+    ball_joint_body1, ball_joint_body2, ball_joint_row,                // std::int32_t
+    ball_joint_body1_point, ball_joint_body2_point,                    // double x 3
+    revolute_body1, revolute_body2, revolute_row,                      // std::int32_t
+    revolute_body1_point, revolute_body2_point,                        // double x 3
+    revolute_body1_axis, revolute_body2_axis,                          // double x 3
+    quaternion_body, quaternion_row,                                   // std::int32_t
+
+    normal_perm, normal_inverse_perm,                          // int (NormalEquationsSymbolic)
+    normal_a_outer, normal_a_inner, normal_a_diagonal,         // int
+    normal_product_target, normal_product_left, normal_product_right,  // int
+    normal_parent, normal_l_outer,                             // int
+
+    driver_names,             // char, nazwy zakończone '\0'
+
+    count
+};
+
+// Położenie sekcji w pliku (bajty od początku, długość w bajtach)
+struct ImageSectionEntry
+{
+    std::uint64_t offset;
+    std::uint64_t bytes;
+};
+
+// Widok tablicy w obrazie
+template<typename T>
+struct ImageArray
+{
+    const T* data = nullptr;
+    std::size_t size = 0;
+
+    const T* begin() const { return data; }
+    const T* end() const { return data + size; }
+    const T& operator[](std::size_t i) const { return data[i]; }
+};
+
+// Obraz zmapowany w pamięci (mmap, tylko do odczytu). Otwarcie sprawdza nagłówek, granice
+// i długości sekcji oraz indeksy, którymi odczyt adresuje inne tablice (ciała, wiersze,
+// funkcje wymuszenia) - bez parsowania; dane czytane są wprost z mapowania. Wielu procesom
+// startującym z tym samym obrazem system dzieli strony pliku.
+class ModelImage
+{
+public:
+    explicit ModelImage(const std::string& path);
+    ~ModelImage();
+
+    ModelImage(ModelImage&& other) noexcept;
+    ModelImage& operator=(ModelImage&& other) noexcept;
+
+    ModelImage(const ModelImage&) = delete;
+    ModelImage& operator=(const ModelImage&) = delete;
+
+    // Jak w CompiledSystem
+    int getNumBodies() const;
+    int getNumCoordinates() const;
+    int getNumEquations() const;
+    std::uint64_t getTopologyHash() const;
+
+    ImageArray<std::int64_t> getBodyIds() const;
+    Eigen::Map<const Eigen::VectorXd> getInitialQ() const;
+    ImageArray<ConstraintRef> getRefs() const;
+    ImageArray<std::int32_t> getBodyConstraintOffsets() const;
+    ImageArray<ConstraintRef> getBodyConstraints() const;
+    Eigen::Map<const Eigen::SparseMatrix<double>> getJacobianPattern() const;
+
+    // Liczba wierszy, kolumn i niezerowych elementów jakobianu z analizy równań normalnych
+    int getNormalRows() const;
+    int getNormalCols() const;
+    std::size_t getJacobianNonzeros() const;
+
+    // Dowolna sekcja; T musi odpowiadać typowi elementu sekcji
+    template<typename T>
+    ImageArray<T> array(ImageSection section) const
+    {
+        const auto& entry = sectionEntry(section);
+        return {reinterpret_cast<const T*>(data + entry.offset), static_cast<std::size_t>(entry.bytes / sizeof(T))};
+    }
+
+    // Nazwa funkcji wymuszenia o danym numerze (distance_driver)
+    const char* getDriverName(std::uint32_t index) const;
+    std::size_t getNumDrivers() const;
+
+private:
+    const ImageSectionEntry& sectionEntry(ImageSection section) const;
+    // Zgodność długości sekcji z nagłówkiem i między sobą; błąd - std::runtime_error
+    void checkSections(const std::string& path) const;
+    void release();
+
+    const unsigned char* data = nullptr;
+    std::size_t bytes = 0;
+    const ImageHeader* header = nullptr;
+    std::vector<const char*> driver_names;
+};
+
+// Zapis skompilowanego układu; analiza symboliczna równań normalnych jest przy tym
+// wyznaczana, jeśli nie była jeszcze potrzebna. Nieznana nazwa funkcji wymuszenia lub
+// ograniczenie użytkownika - std::runtime_error.
+void save_model_image(const CompiledSystem& system, const std::string& path,
+                      const DriverRegistry& drivers = DriverRegistry{});
+
+#endif // MODEL_IMAGE_HPP
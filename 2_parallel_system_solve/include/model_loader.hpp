@@ -0,0 +1,58 @@
+#ifndef MODEL_LOADER_HPP
+#define MODEL_LOADER_HPP
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <eigen3/Eigen/Dense>
+
+#include "multibody_system.hpp"
+
+// Tekstowy format modelu: jeden element w wierszu, pola rozdzielone białymi znakami,
+// '#' zaczyna komentarz do końca wiersza. Kąty/orientacje jako kwaterniony e0 e1 e2 e3,
+// punkty i osie jako trzy liczby x y z; id ciała 0 oznacza ground.
+//
+//   bodies <liczba>                                   (opcjonalnie, rezerwacja miejsca, ≤ liczba wierszy)
+//   constraints <liczba>                              (opcjonalnie, rezerwacja miejsca, ≤ liczba wierszy)
+//   body <id> <x y z> <e0 e1 e2 e3>
+//   distance <id> <ciało1> <ciało2> <punkt1> <punkt2> <nazwa funkcji>
+//   fixed_parameter <id> <ciało> <indeks 0..6>
+//   fixed_orientation <id> <ciało> <e0 e1 e2 e3>
+//   fixed_position <id> <ciało> <x y z>
+//   ball_joint <id> <ciało1> <ciało2> <punkt1> <punkt2>
+//   revolute <id> <ciało1> <ciało2> <punkt1> <punkt2> <oś1> <oś2>
+//   quaternion <id> <ciało>
+//
+// Funkcje wymuszenia dla distance wskazywane są nazwą zarejestrowaną w DriverRegistry.
+
+using DriverFunction = Eigen::Vector3d (*)(double);
+
+// Nazwane funkcje wymuszenia; "zero" jest zarejestrowana zawsze
+class DriverRegistry
+{
+public:
+    DriverRegistry();
+
+    void add(const std::string& name, DriverFunction function);
+
+    // nullptr, gdy nazwa nie jest zarejestrowana
+    DriverFunction find(std::string_view name) const;
+
+    // Nazwa zarejestrowanej funkcji (pusta, gdy funkcji nie ma w rejestrze)
+    std::string_view name(DriverFunction function) const;
+
+private:
+    std::map<std::string, DriverFunction, std::less<>> drivers;
+};
+
+// Jedno przejście po tekście; ciała dodawane od razu, ograniczenia po wszystkich ciałach,
+// więc czas jest liniowy niezależnie od kolejności wierszy. Błędy składni i nieznane
+// funkcje wymuszenia zgłaszane są std::runtime_error z numerem wiersza; odwołanie do
+// nieistniejącego ciała - jak w MultibodySystem::finalize().
+MultibodySystem parse_model(std::string_view text, const DriverRegistry& drivers = DriverRegistry{});
+
+// Plik wczytywany jednym odczytem, potem parse_model
+MultibodySystem load_model(const std::string& path, const DriverRegistry& drivers = DriverRegistry{});
+
+#endif // MODEL_LOADER_HPP
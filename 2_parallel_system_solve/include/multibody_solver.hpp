@@ -4,16 +4,78 @@
 #include<vector>
 #include<eigen3/Eigen/Dense>
 #include<iostream>
-#include <oneapi/tbb.h>
 
 #include "multibody_system.hpp"
+#include "compiled_system.hpp"
+#include "solver_session.hpp"
+#include "trajectory_writer.hpp"
 #include <Eigen/Sparse>
 using SparseMatrix = Eigen::SparseMatrix<double>;
 using Triplet = Eigen::Triplet<double>;
 
-SparseMatrix multibody_jacobian(MultibodySystem mbs, State state, int block_size = 7);
+// Chwile kolejnych kroków czasowych: 0, 0.1, 0.2, ... dopóki t <= end_time. Jedyna siatka
+// czasu solverów; chwile sumowane są krok po kroku (t += time_step), tak jak od początku.
+constexpr double time_step = 0.1;
+std::vector<double> time_steps(double end_time);
 
-State newton_solver(MultibodySystem mbs, State state, int block_size = 7);
+// block_size - liczba kolumn jakobianu w jednym zadaniu TBB;
+// autotune_block_size (grain_tuner.hpp) - dobór automatyczny
+SparseMatrix multibody_jacobian(const CompiledSystem& system, const State& state, int block_size = 7);
+
+State newton_solver(const CompiledSystem& system, const State& state, int block_size = 7);
+
+std::vector<State> multibody_solver(const CompiledSystem& system, double end_time, int block_size = 7);
+
+void multibody_solver(const CompiledSystem& system, double end_time, TrajectoryWriter& output, int block_size = 7);
+
+// Wersje korzystające z buforów sesji, dla dowolnej kombinacji strategii BasicSolverSession.
+// Siatka czasu i wynikowe State przydzielane są raz na wywołanie (State - po jednym na krok);
+// poza tym pamięć przydziela tylko sesja, a bez alokacji jest wyłącznie NormalEquationsSession.
+// Wersje przyjmujące CompiledSystem tworzą nową sesję przy każdym wywołaniu - przy wielu
+// wywołaniach dla tego samego układu lepiej trzymać własną sesję.
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+State newton_solver(BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>& session, const State& state)
+{
+    Eigen::VectorXd q = state.getQ();
+    session.solve(q, state.getTime());
+    return State{q, state.getTime()};
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+std::vector<State> multibody_solver(BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>& session,
+                                    double end_time)
+{
+    // previous solution is the initial guess for the next time step
+    Eigen::VectorXd q = session.getSystem().getInitialQ();
+    const std::vector<double> times = time_steps(end_time);
+    std::vector<State> states;
+    states.reserve(times.size());
+    for(double t : times)
+    {
+        session.solve(q, t);
+        states.emplace_back(q, t);
+    }
+
+    return states;
+}
+
+// Zbieżne stany trafiają do output (zapis w wątku TrajectoryWriter) zamiast do pamięci
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+void multibody_solver(BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>& session,
+                      double end_time, TrajectoryWriter& output)
+{
+    Eigen::VectorXd q = session.getSystem().getInitialQ();
+    for(double t : time_steps(end_time))
+    {
+        session.solve(q, t);
+        output.push(q, t);
+    }
+}
+
+// Wersje kompilujące układ przy każdym wywołaniu
+SparseMatrix multibody_jacobian(const MultibodySystem& mbs, const State& state, int block_size = 7);
+
+State newton_solver(const MultibodySystem& mbs, const State& state, int block_size = 7);
 
 std::vector<State> multibody_solver(MultibodySystem& mbs, double end_time, int block_size = 7);
 
@@ -5,6 +5,8 @@
 #include "bodies.hpp"
 #include "constraints.hpp"
 #include <memory>
+#include <cstdint>
+#include <unordered_map>
 
 class MultibodySystem
 {
@@ -15,20 +17,40 @@ class MultibodySystem
 
         void addConstraint(const Constraint& constraint); 
 
+        // Ograniczenie już w postaci wariantu (np. z model_loader), bez kopiowania
+        void addConstraint(ConstraintVariant&& constraint);
+
+        // Rezerwacja miejsca przed dodawaniem wielu ciał i ograniczeń
+        void reserve(std::size_t num_bodies, std::size_t num_constraints);
+
         int getNumBodies() const;
 
         int getNumConstraints() const;
 
         const std::vector<Body>& getBodies() const;
         const std::vector<long int>& getBodyIds() const;
-        const std::vector<std::shared_ptr<Constraint>>& getConstraints() const;
+        // Wbudowane typy przechowywane w miejscu (ConstraintVariant), w kolejności dodania
+        const std::vector<ConstraintVariant>& getConstraints() const;
+
+        const Eigen::Matrix<double, 7, 1>& getBodyParameters(long int id) const;
 
-        const Eigen::VectorXd& getBodyParameters(long int id) const;
+        // Indeks ciała w wektorze q (O(1)); ground_index dla id 0
+        std::int32_t getBodyIndex(long int id) const;
+
+        // Rozwiązuje ograniczenia dodane przed ich ciałami (addBody ich nie przegląda) i
+        // sprawdza, czy wszystkie odwołują się do istniejących ciał. Wymagane przed
+        // kompilacją układu, w którym ograniczenie poprzedza swoje ciało.
+        void finalize();
     
     private:
+        // Ograniczenia użytkownika współdzielone z innym właścicielem są przed tym klonowane
+        bool resolveConstraint(std::size_t k);
+
         std::vector<Body> bodies;
         std::vector<long int> body_ids;
-        std::vector<std::shared_ptr<Constraint>> constraints;
+        std::unordered_map<long int, std::int32_t> body_index;
+        std::vector<ConstraintVariant> constraints;
+        std::vector<std::size_t> unresolved;  // numery ograniczeń czekających na finalize()
 };
 
 class State
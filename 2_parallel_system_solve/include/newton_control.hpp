@@ -0,0 +1,26 @@
+#ifndef NEWTON_CONTROL_HPP
+#define NEWTON_CONTROL_HPP
+
+// Następny etap metody Newtona po policzeniu residuum
+enum class NewtonStage
+{
+    refactorize,  // jakobian i jego rozkład w bieżącym punkcie, potem aktualizacja
+    iterate,      // aktualizacja z istniejącym rozkładem
+    done          // zbieżność albo przerwanie (limit iteracji, rozbieżność)
+};
+
+// Reguły zakończenia metody Newtona, wspólne dla SolverSession, EnsembleBatch i flow_solver.
+// Jakobian i jego rozkład liczone są raz na krok czasowy, w przybliżeniu początkowym.
+struct NewtonControl
+{
+    static constexpr double tolerance = 1e-12;      // norma b . b uznana za zbieżność
+    static constexpr int max_iterations = 1000;
+    static constexpr double divergence_norm = 1e20;
+
+    // norm - residuum po iterations aktualizacjach kroku, factorized - czy rozkład kroku
+    // jest już policzony. Przerwanie (tylko po co najmniej jednej aktualizacji) wypisuje
+    // komunikat na std::cerr.
+    static NewtonStage next(double norm, int iterations, bool factorized);
+};
+
+#endif // NEWTON_CONTROL_HPP
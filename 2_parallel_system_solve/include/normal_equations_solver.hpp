@@ -0,0 +1,96 @@
+#ifndef NORMAL_EQUATIONS_SOLVER_HPP
+#define NORMAL_EQUATIONS_SOLVER_HPP
+
+#include <vector>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+
+// Część symboliczna rozkładu LDL^T równań normalnych (J^T J + mu I) dx = J^T b:
+// uporządkowanie AMD, struktura macierzy J^T J, drzewo eliminacji i struktura L.
+// Zależy tylko od struktury rzadkości J, więc może być współdzielona.
+struct NormalEquationsSymbolic
+{
+    explicit NormalEquationsSymbolic(const Eigen::SparseMatrix<double>& jacobian_pattern);
+
+    // Pusta - do wypełnienia gotową analizą (np. z ModelImage)
+    NormalEquationsSymbolic() = default;
+
+    int rows = 0;
+    int cols = 0;
+    std::size_t jacobian_nonzeros = 0;
+
+    // perm[k] - stara kolumna na pozycji k, inverse_perm[i] - nowa pozycja kolumny i
+    std::vector<int> perm;
+    std::vector<int> inverse_perm;
+
+    // Górny trójkąt P J^T J P^T (CSC) i indeksy jego przekątnej
+    std::vector<int> a_outer;
+    std::vector<int> a_inner;
+    std::vector<int> a_diagonal;
+
+    // Iloczyn J^T J: a_values[product_target[k]] += J[product_left[k]] * J[product_right[k]]
+    std::vector<int> product_target;
+    std::vector<int> product_left;
+    std::vector<int> product_right;
+
+    // Drzewo eliminacji i wskaźniki kolumn czynnika L
+    std::vector<int> parent;
+    std::vector<int> l_outer;
+};
+
+// Część numeryczna dla W układów o wspólnej części symbolicznej, liczonych razem: wartość k
+// układu s leży pod [k * W + s] (jakobian, prawa strona, wynik), więc każde działanie rozkładu
+// to jedna pętla po układach. Cała pamięć przydzielana w konstruktorze, factorize() i solve()
+// nie alokują. Regularyzacja mu = regularization * max(diag(J^T J)) (osobno dla każdego układu)
+// czyni układ dodatnio określonym także dla jakobianów z nadmiarowymi więzami.
+// Instancje: W = 1 (NormalEquationsSolver) i W = ensemble_width (EnsembleBatch).
+template<int W>
+class NormalEquationsLanes
+{
+public:
+    explicit NormalEquationsLanes(const NormalEquationsSymbolic& symbolic, double regularization = 1e-15);
+
+    // jacobian - wartości niezerowe J w kolejności wzorca. Zwraca false, gdy rozkład
+    // któregoś z pierwszych num_systems układów się nie powiódł (zerowy element przekątnej)
+    bool factorize(const double* jacobian, int num_systems = W);
+
+    // x = (J^T J + mu I)^-1 J^T b; outer, inner - wzorzec J (CSC)
+    void solve(const int* outer, const int* inner, const double* jacobian, const double* b, double* x);
+
+private:
+    const NormalEquationsSymbolic& symbolic;
+    double regularization;
+
+    std::vector<double> a_values;
+    std::vector<int> l_inner;
+    std::vector<double> l_values;
+    std::vector<double> d;
+
+    // Przestrzeń robocza rozkładu i rozwiązania
+    std::vector<double> y;
+    std::vector<int> pattern;
+    std::vector<int> flag;
+    std::vector<int> l_count;
+    std::vector<double> x_perm;
+};
+
+extern template class NormalEquationsLanes<1>;
+
+// Jeden układ: NormalEquationsLanes<1> dla macierzy Eigena
+class NormalEquationsSolver
+{
+public:
+    explicit NormalEquationsSolver(const NormalEquationsSymbolic& symbolic, double regularization = 1e-15);
+
+    // Zwraca false, gdy rozkład się nie powiódł (zerowy element przekątnej)
+    bool factorize(const Eigen::SparseMatrix<double>& J);
+
+    // x = (J^T J + mu I)^-1 J^T b
+    void solve(const Eigen::SparseMatrix<double>& J, const Eigen::VectorXd& b, Eigen::VectorXd& x);
+
+private:
+    const NormalEquationsSymbolic& symbolic;
+    NormalEquationsLanes<1> lanes;
+};
+
+#endif // NORMAL_EQUATIONS_SOLVER_HPP
@@ -0,0 +1,70 @@
+#ifndef NUMA_SOLVER_HPP
+#define NUMA_SOLVER_HPP
+
+#include <vector>
+#include <memory>
+#include <map>
+#include <atomic>
+#include <oneapi/tbb.h>
+
+#include "multibody_system.hpp"
+#include "compiled_system.hpp"
+#include "solver_session.hpp"
+
+// Partia układów rozdzielona między węzły NUMA. Dla każdego węzła działa osobna
+// task_arena związana z jego rdzeniami (oneapi::tbb::info::numa_nodes, wymaga tbbbind).
+// Układy przydzielane są węzłom według kosztu (system_cost) i liczby rdzeni węzła,
+// a kopia skompilowanego układu, stan i bufory sesji (jakobian, rozkład) tworzone są
+// przez wątki węzła macierzystego, więc strony pamięci trafiają na ten węzeł (first touch).
+// Wątki węzła biorą najpierw własne układy; po cudze sięgają dopiero, gdy własnych
+// zabraknie. Jakobian własnego układu liczony jest w arenie węzła o niskim priorytecie
+// i współbieżności równej budżetowi układu (thread_budgets, jak w SystemScheduler), układ
+// cudzy - w arenie węzła, który go przejął. Bez NUMA (jeden węzeł) działa jak zwykła partia.
+class NumaBatch
+{
+public:
+    explicit NumaBatch(const std::vector<CompiledSystem>& systems, int block_size = 7);
+
+    NumaBatch(const NumaBatch&) = delete;
+    NumaBatch& operator=(const NumaBatch&) = delete;
+
+    // Jak multibody_solver dla każdego układu; wynik w kolejności systems
+    std::vector<std::vector<State>> solve(double end_time);
+
+    int getNumNodes() const;
+
+    // Numer węzła (0 .. getNumNodes() - 1), do którego przydzielono układ
+    int getNode(std::size_t system) const;
+
+    // Liczba wątków węzła macierzystego dla jakobianu układu
+    int getBudget(std::size_t system) const;
+
+    // Liczba układów, które w ostatnim solve liczył inny węzeł niż macierzysty
+    std::size_t getNumStolen() const;
+
+private:
+    // Układy jednego węzła, od najdroższego; next - pierwszy jeszcze nie pobrany.
+    // inner - areny jakobianów związane z węzłem, po jednej na budżet
+    struct Node
+    {
+        oneapi::tbb::task_arena arena;
+        std::vector<std::size_t> systems;
+        std::atomic<std::size_t> next{0};
+        std::map<int, std::unique_ptr<oneapi::tbb::task_arena>> inner;
+    };
+
+    // Kolejny układ dla wątku węzła node: własny, a gdy ich brak - z innego węzła
+    bool take(std::size_t node, std::size_t& system, bool& remote);
+
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<int> home;
+    std::vector<int> budgets;
+
+    // Dane układów, tworzone na węźle macierzystym
+    std::vector<std::unique_ptr<CompiledSystem>> local_systems;
+    std::vector<std::unique_ptr<SolverSession>> sessions;
+
+    std::atomic<std::size_t> stolen{0};
+};
+
+#endif // NUMA_SOLVER_HPP
@@ -0,0 +1,318 @@
+#ifndef PARALLEL_BACKEND_HPP
+#define PARALLEL_BACKEND_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <iterator>
+
+// Pętle równoległe solvera niezależne od biblioteki wątków. Backend wybierany jest przy
+// kompilacji (CMake: PARALLEL_BACKEND) jedną z definicji:
+//   MULTIBODY_PARALLEL_TBB    - oneTBB (domyślny),
+//   MULTIBODY_PARALLEL_OPENMP - OpenMP,
+//   MULTIBODY_PARALLEL_STD    - algorytmy równoległe C++17 (std::execution::par).
+// Backend std wymaga równoległej implementacji biblioteki standardowej; cicha wersja
+// sekwencyjna (libstdc++ bez TBB) jest błędem kompilacji.
+
+#if defined(MULTIBODY_PARALLEL_OPENMP)
+#include <omp.h>
+#elif defined(MULTIBODY_PARALLEL_STD)
+#include <execution>
+#if defined(_PSTL_PAR_BACKEND_SERIAL)
+#error "std::execution::par runs serially with this standard library; use PARALLEL_BACKEND=TBB or OpenMP"
+#endif
+#if defined(_PSTL_PAR_BACKEND_TBB)
+#include <oneapi/tbb/global_control.h>
+#include <oneapi/tbb/task_arena.h>
+#endif
+#else
+#ifndef MULTIBODY_PARALLEL_TBB
+#define MULTIBODY_PARALLEL_TBB
+#endif
+#include <oneapi/tbb.h>
+#endif
+
+// Podział zakresu na zadania
+enum class Partitioner
+{
+    simple,     // bloki po grain elementów rozdzielane dynamicznie (TBB simple_partitioner, OpenMP dynamic)
+    automatic,  // podział wybierany przez bibliotekę (TBB auto_partitioner, OpenMP guided)
+    affinity    // ten sam przydział bloków do wątków w kolejnych wywołaniach (TBB affinity_partitioner, OpenMP static)
+};
+
+inline const char* partitioner_name(Partitioner partitioner)
+{
+    switch(partitioner)
+    {
+        case Partitioner::simple:
+            return "simple";
+        case Partitioner::automatic:
+            return "auto";
+        case Partitioner::affinity:
+            return "affinity";
+    }
+    return "unknown";
+}
+
+inline const char* parallel_backend_name()
+{
+#if defined(MULTIBODY_PARALLEL_OPENMP)
+    return "OpenMP";
+#elif defined(MULTIBODY_PARALLEL_STD)
+    return "std::execution";
+#else
+    return "oneTBB";
+#endif
+}
+
+// Liczba wątków, z jaką będą wykonywane pętle równoległe
+inline int current_thread_count()
+{
+#if defined(MULTIBODY_PARALLEL_OPENMP)
+    return omp_get_max_threads();
+#elif defined(MULTIBODY_PARALLEL_STD) && !defined(_PSTL_PAR_BACKEND_TBB)
+    return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+#else
+    const auto allowed = oneapi::tbb::global_control::active_value(oneapi::tbb::global_control::max_allowed_parallelism);
+    return static_cast<int>(std::min<std::size_t>(allowed, oneapi::tbb::this_task_arena::max_concurrency()));
+#endif
+}
+
+// Ograniczenie liczby wątków na czas życia obiektu (np. w benchmarkach). Backend std bez
+// TBB nie daje kontroli nad pulą wątków - wtedy supported == false i obiekt nic nie zmienia.
+class ThreadLimit
+{
+public:
+#if defined(MULTIBODY_PARALLEL_STD) && !defined(_PSTL_PAR_BACKEND_TBB)
+    static constexpr bool supported = false;
+#else
+    static constexpr bool supported = true;
+#endif
+
+    explicit ThreadLimit(int num_threads)
+#if defined(MULTIBODY_PARALLEL_OPENMP)
+        : previous(omp_get_max_threads())
+    {
+        omp_set_num_threads(num_threads);
+    }
+
+    ~ThreadLimit()
+    {
+        omp_set_num_threads(previous);
+    }
+#elif defined(MULTIBODY_PARALLEL_STD) && !defined(_PSTL_PAR_BACKEND_TBB)
+    {
+        // the standard library gives no control over its thread pool
+        static_cast<void>(num_threads);
+    }
+#else
+        : control(oneapi::tbb::global_control::max_allowed_parallelism, static_cast<std::size_t>(num_threads))
+    {
+    }
+#endif
+
+    ThreadLimit(const ThreadLimit&) = delete;
+    ThreadLimit& operator=(const ThreadLimit&) = delete;
+
+private:
+#if defined(MULTIBODY_PARALLEL_OPENMP)
+    int previous;
+#elif defined(MULTIBODY_PARALLEL_STD) && !defined(_PSTL_PAR_BACKEND_TBB)
+#else
+    oneapi::tbb::global_control control;
+#endif
+};
+
+// Stan przydziału bloków do wątków między wywołaniami (Partitioner::affinity)
+class ParallelAffinity
+{
+#if defined(MULTIBODY_PARALLEL_TBB)
+public:
+    oneapi::tbb::affinity_partitioner partitioner;
+#endif
+};
+
+// Obiekt T dla każdego wątku, tworzony przy pierwszym użyciu w danym wątku
+template<typename T>
+class ThreadLocal
+{
+public:
+    T& local()
+    {
+#if defined(MULTIBODY_PARALLEL_TBB)
+        return values.local();
+#else
+        const auto id = std::this_thread::get_id();
+        {
+            std::shared_lock lock(mutex);
+            auto it = values.find(id);
+            if(it != values.end())
+                return *it->second;
+        }
+
+        std::unique_lock lock(mutex);
+        auto& value = values[id];
+        if(!value)
+            value = std::make_unique<T>();
+        return *value;
+#endif
+    }
+
+private:
+#if defined(MULTIBODY_PARALLEL_TBB)
+    oneapi::tbb::enumerable_thread_specific<T> values;
+#else
+    std::shared_mutex mutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<T>> values;
+#endif
+};
+
+namespace detail
+{
+    // Iterator po numerach bloków dla std::for_each(std::execution::par, ...)
+    class BlockIterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::ptrdiff_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::ptrdiff_t*;
+        using reference = std::ptrdiff_t;
+
+        BlockIterator() = default;
+        explicit BlockIterator(std::ptrdiff_t block) : block(block) {}
+
+        reference operator*() const { return block; }
+        reference operator[](difference_type n) const { return block + n; }
+
+        BlockIterator& operator++() { ++block; return *this; }
+        BlockIterator operator++(int) { return BlockIterator(block++); }
+        BlockIterator& operator--() { --block; return *this; }
+        BlockIterator operator--(int) { return BlockIterator(block--); }
+        BlockIterator& operator+=(difference_type n) { block += n; return *this; }
+        BlockIterator& operator-=(difference_type n) { block -= n; return *this; }
+
+        friend BlockIterator operator+(BlockIterator it, difference_type n) { return BlockIterator(it.block + n); }
+        friend BlockIterator operator+(difference_type n, BlockIterator it) { return BlockIterator(it.block + n); }
+        friend BlockIterator operator-(BlockIterator it, difference_type n) { return BlockIterator(it.block - n); }
+        friend difference_type operator-(BlockIterator a, BlockIterator b) { return a.block - b.block; }
+
+        friend bool operator==(BlockIterator a, BlockIterator b) { return a.block == b.block; }
+        friend bool operator!=(BlockIterator a, BlockIterator b) { return a.block != b.block; }
+        friend bool operator<(BlockIterator a, BlockIterator b) { return a.block < b.block; }
+        friend bool operator>(BlockIterator a, BlockIterator b) { return a.block > b.block; }
+        friend bool operator<=(BlockIterator a, BlockIterator b) { return a.block <= b.block; }
+        friend bool operator>=(BlockIterator a, BlockIterator b) { return a.block >= b.block; }
+
+    private:
+        std::ptrdiff_t block = 0;
+    };
+}
+
+// body(first, last) dla rozłącznych podzakresów [begin, end) o rozmiarze rzędu grain
+// (dokładny podział zależy od backendu); różne podzakresy mogą być liczone równocześnie
+template<typename Index, typename Body>
+void parallel_for_range(Index begin, Index end, std::size_t grain, const Body& body,
+                        Partitioner partitioner, ParallelAffinity& affinity)
+{
+    if(end <= begin)
+        return;
+    grain = std::max<std::size_t>(grain, 1);
+
+#if defined(MULTIBODY_PARALLEL_TBB)
+    const auto range = oneapi::tbb::blocked_range<Index>{begin, end, grain};
+    const auto ranges = [&](const oneapi::tbb::blocked_range<Index>& r) { body(r.begin(), r.end()); };
+
+    switch(partitioner)
+    {
+        case Partitioner::simple:
+            oneapi::tbb::parallel_for(range, ranges, oneapi::tbb::simple_partitioner{});
+            break;
+        case Partitioner::automatic:
+            oneapi::tbb::parallel_for(range, ranges, oneapi::tbb::auto_partitioner{});
+            break;
+        case Partitioner::affinity:
+            oneapi::tbb::parallel_for(range, ranges, affinity.partitioner);
+            break;
+    }
+#else
+    static_cast<void>(affinity);
+
+    const std::ptrdiff_t size = static_cast<std::ptrdiff_t>(end - begin);
+    const std::ptrdiff_t step = static_cast<std::ptrdiff_t>(grain);
+    const std::ptrdiff_t blocks = (size + step - 1) / step;
+
+    const auto block = [&](std::ptrdiff_t k)
+    {
+        const Index first = begin + static_cast<Index>(k * step);
+        const Index last = static_cast<Index>(std::min<std::ptrdiff_t>(size, (k + 1) * step)) + begin;
+        body(first, last);
+    };
+
+#if defined(MULTIBODY_PARALLEL_OPENMP)
+    switch(partitioner)
+    {
+        case Partitioner::simple:
+            #pragma omp parallel for schedule(dynamic, 1) if(blocks > 1)
+            for(std::ptrdiff_t k = 0; k < blocks; k++)
+                block(k);
+            break;
+        case Partitioner::automatic:
+            #pragma omp parallel for schedule(guided) if(blocks > 1)
+            for(std::ptrdiff_t k = 0; k < blocks; k++)
+                block(k);
+            break;
+        case Partitioner::affinity:
+            #pragma omp parallel for schedule(static) if(blocks > 1)
+            for(std::ptrdiff_t k = 0; k < blocks; k++)
+                block(k);
+            break;
+    }
+#else
+    // the standard library chooses the split by itself
+    static_cast<void>(partitioner);
+    std::for_each(std::execution::par, detail::BlockIterator(0), detail::BlockIterator(blocks), block);
+#endif
+#endif
+}
+
+template<typename Index, typename Body>
+void parallel_for_range(Index begin, Index end, std::size_t grain, const Body& body)
+{
+    ParallelAffinity affinity;
+    parallel_for_range(begin, end, grain, body, Partitioner::automatic, affinity);
+}
+
+// body(i) dla każdego i z [begin, end), pojedynczo rozdzielane między wątki
+template<typename Index, typename Body>
+void parallel_for_each_index(Index begin, Index end, const Body& body)
+{
+    parallel_for_range(begin, end, 1, [&](Index first, Index last)
+    {
+        for(Index i = first; i != last; ++i)
+            body(i);
+    });
+}
+
+// Suma count wartości block(k), liczonych równolegle do partials i dodawanych po kolei:
+// wynik nie zależy od liczby wątków ani od backendu
+template<typename Block>
+double parallel_ordered_sum(std::size_t count, double* partials, const Block& block)
+{
+    parallel_for_range(std::size_t{0}, count, 1, [&](std::size_t first, std::size_t last)
+    {
+        for(std::size_t k = first; k != last; ++k)
+            partials[k] = block(k);
+    });
+
+    double sum = 0.0;
+    for(std::size_t k = 0; k < count; k++)
+        sum += partials[k];
+    return sum;
+}
+
+#endif // PARALLEL_BACKEND_HPP
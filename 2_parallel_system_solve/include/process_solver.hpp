@@ -0,0 +1,65 @@
+#ifndef PROCESS_SOLVER_HPP
+#define PROCESS_SOLVER_HPP
+
+#include <vector>
+#include <cstddef>
+#include <eigen3/Eigen/Dense>
+
+#include "multibody_system.hpp"
+#include "compiled_system.hpp"
+
+// Trajektorie partii układów we wspólnym obszarze mmap (MAP_SHARED), zapisywane
+// bezpośrednio przez procesy robocze. Układ: czasy kroków, a po nich stany kolejnych
+// układów - dla układu i krok k to getNumCoordinates(i) liczb pod offsets[i] + k * n_i.
+class SharedTrajectories
+{
+public:
+    SharedTrajectories() = default;
+    SharedTrajectories(const std::vector<CompiledSystem>& systems, double end_time);
+    ~SharedTrajectories();
+
+    SharedTrajectories(SharedTrajectories&& other) noexcept;
+    SharedTrajectories& operator=(SharedTrajectories&& other) noexcept;
+
+    SharedTrajectories(const SharedTrajectories&) = delete;
+    SharedTrajectories& operator=(const SharedTrajectories&) = delete;
+
+    std::size_t getNumSystems() const;
+    std::size_t getNumSteps() const;
+    double getTime(std::size_t step) const;
+
+    // Stan układu w kroku - widok na pamięć współdzieloną
+    Eigen::Map<Eigen::VectorXd> getQ(std::size_t system, std::size_t step);
+    Eigen::Map<const Eigen::VectorXd> getQ(std::size_t system, std::size_t step) const;
+
+    // Kopia trajektorii jednego układu
+    std::vector<State> getStates(std::size_t system) const;
+
+    // Liczba procesów roboczych, których nie udało się przypiąć do rdzeni (sched_setaffinity);
+    // rozwiązują swoje układy mimo to, na dowolnych rdzeniach rodzica
+    std::size_t getNumUnpinned() const;
+
+private:
+    friend SharedTrajectories process_solver(const std::vector<CompiledSystem>&, double, int, int);
+
+
+    void release();
+
+    double* data = nullptr;
+    std::size_t bytes = 0;
+    std::size_t num_steps = 0;
+    std::vector<std::size_t> offsets;
+    std::vector<int> sizes;
+    std::size_t num_unpinned = 0;
+};
+
+// Rozwiązanie partii w num_processes procesach potomnych (fork). Każdy proces ma własny
+// planista TBB i własną stertę, jest przypięty do osobnego, ciągłego zakresu rdzeni
+// dostępnych dla rodzica (sched_setaffinity) i zapisuje wyniki swoich układów wprost do
+// SharedTrajectories, bez serializacji. Układy dzielone są między procesy według kosztu.
+// Przed fork wątki robocze TBB rodzica są zatrzymywane (oneapi::tbb::finalize), więc
+// w chwili wywołania nie może istnieć żadna task_arena ani global_control.
+SharedTrajectories process_solver(const std::vector<CompiledSystem>& systems, double end_time, int num_processes,
+                                  int block_size = 7);
+
+#endif // PROCESS_SOLVER_HPP
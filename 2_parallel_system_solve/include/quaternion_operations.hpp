@@ -1,12 +1,39 @@
 #ifndef QUATERNION_OPERATIONS
 #define QUATERNION_OPERATIONS
 
+#include <cstddef>
 #include <eigen3/Eigen/Dense>
 
-Eigen::MatrixXd L(Eigen::Map<const Eigen::VectorXd> e);
+Eigen::Matrix<double, 3, 4> L(const Eigen::Ref<const Eigen::Vector4d>& e);
 
-Eigen::MatrixXd E(Eigen::Map<const Eigen::VectorXd> e);
+Eigen::Matrix<double, 3, 4> E(const Eigen::Ref<const Eigen::Vector4d>& e);
 
-Eigen::Matrix3d R(Eigen::Map<const Eigen::VectorXd> e);
+Eigen::Matrix3d R(const Eigen::Ref<const Eigen::Vector4d>& e);
+
+// Macierz obrotu kwaternionu (w, x, y, z) zapisana kolumnami: element j pod m[j * stride].
+// Jedyne miejsce tego wzoru - R(), jądra SIMD, FrameLanes i EnsembleBatch liczą przez nią,
+// w kolejności działań Eigen::Quaterniond::toRotationMatrix().
+// Zgodność wariantów: ta sama kolejność działań daje te same bity tylko wtedy, gdy kompilator
+// nie łączy mnożeń z dodawaniami w FMA. Tylko simd_kernels.cpp kompilowany jest bez tego
+// (-ffp-contract=off), więc jego warianty wektorowe i skalarny są porównywane dokładnie;
+// pozostałe ścieżki (R(), FrameLanes, EnsembleBatch, constraint_lanes.hpp) mogą korzystać
+// z FMA (np. z -march=native) i zgadzają się ze sobą z dokładnością do zaokrągleń.
+inline void rotation_matrix(double w, double x, double y, double z, double* m, std::ptrdiff_t stride = 1)
+{
+    const double tx = 2.0 * x, ty = 2.0 * y, tz = 2.0 * z;
+    const double twx = tx * w, twy = ty * w, twz = tz * w;
+    const double txx = tx * x, txy = ty * x, txz = tz * x;
+    const double tyy = ty * y, tyz = tz * y, tzz = tz * z;
+
+    m[0 * stride] = 1.0 - (tyy + tzz);
+    m[1 * stride] = txy + twz;
+    m[2 * stride] = txz - twy;
+    m[3 * stride] = txy - twz;
+    m[4 * stride] = 1.0 - (txx + tzz);
+    m[5 * stride] = tyz + twx;
+    m[6 * stride] = txz + twy;
+    m[7 * stride] = tyz - twx;
+    m[8 * stride] = 1.0 - (txx + tyy);
+}
 
 #endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef SIMD_KERNELS_HPP
+#define SIMD_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Wektorowe jądra dla wielu ciał / ograniczeń naraz. Implementacja (AVX-512, AVX2
+// lub skalarna) wybierana jest przy pierwszym wywołaniu na podstawie procesora.
+// Wszystkie warianty dają te same bity (patrz rotation_matrix()), zgodne z R() i iloczynem
+// Eigena z dokładnością do zaokrągleń.
+
+enum class SimdLevel
+{
+    scalar,
+    avx2,
+    avx512
+};
+
+// Najwyższy poziom obsługiwany przez procesor i poziom aktualnie używany
+SimdLevel simd_supported_level();
+SimdLevel simd_level();
+
+// Wymuszenie poziomu (np. w testach); ograniczane do simd_supported_level()
+void set_simd_level(SimdLevel level);
+
+const char* simd_level_name(SimdLevel level);
+
+// count kwaternionów [w, x, y, z] zapisanych co stride liczb w quaternions
+// -> macierze obrotu 3x3 (kolumnowo, po 9 liczb) w rotations
+void rotation_matrices(const double* quaternions, std::size_t stride, std::size_t count, double* rotations);
+
+// out[k] = r[body[k]] + R[body[k]] * point[k] dla k < count.
+// rotations - macierze 3x3 (po 9 liczb), positions - wektory (po 3 liczby),
+// points i out - wektory po 3 liczby. Indeks body[k] wskazuje bezpośrednio pozycję w tablicach.
+void transform_points(const double* rotations, const double* positions, const std::int32_t* body,
+                      const double* points, std::size_t count, double* out);
+
+#endif // SIMD_KERNELS_HPP
@@ -0,0 +1,182 @@
+#ifndef SOLVER_POLICIES_HPP
+#define SOLVER_POLICIES_HPP
+
+#include <memory>
+#include <cstddef>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "compiled_system.hpp"
+#include "body_frames.hpp"
+#include "frame_lanes.hpp"
+#include "normal_equations_solver.hpp"
+#include "symbolic_cache.hpp"
+#include "parallel_backend.hpp"
+
+// Strategie wybierane przy kompilacji dla BasicSolverSession (solver_session.hpp):
+// liczenie jakobianu, solver liniowy i sposób wykonania pętli. Każda kombinacja to osobna
+// klasa bez rozgałęzień w czasie działania; warianty dawnych katalogów 0_unoptimized
+// i 1_parallel_jacobian to ColumnJacobian z SequentialExecution / ParallelExecution.
+
+enum class LinearSolverType
+{
+    sparse_qr,        // Eigen::SparseQR (COLAMD), wynik jak w newton_solver
+    normal_equations  // LDL^T regularyzowanych równań normalnych, bez alokacji
+};
+
+// Bufory robocze jednego wątku przy liczeniu jakobianu
+struct JacobianWorkspace
+{
+    Eigen::VectorXd q_h;
+    Eigen::VectorXd phi_h;
+    BodyFrames frames;
+    FrameLanes lanes;
+    ResidualLanes residuals;
+};
+
+// --- Wykonanie pętli ---
+
+// Wszystko w wątku wywołującym
+struct SequentialExecution
+{
+    static constexpr const char* name = "sequential";
+
+    template<typename Index, typename Body>
+    static void forRange(Index begin, Index end, std::size_t, const Body& body, Partitioner, ParallelAffinity&)
+    {
+        if(begin < end)
+            body(begin, end);
+    }
+
+    template<typename Index, typename Body>
+    static void forRange(Index begin, Index end, std::size_t, const Body& body)
+    {
+        if(begin < end)
+            body(begin, end);
+    }
+
+    template<typename Block>
+    static double orderedSum(std::size_t count, double* partials, const Block& block)
+    {
+        double sum = 0.0;
+        for(std::size_t k = 0; k < count; k++)
+        {
+            partials[k] = block(k);
+            sum += partials[k];
+        }
+        return sum;
+    }
+};
+
+// Pętle równoległe wybranego backendu (parallel_backend.hpp)
+struct ParallelExecution
+{
+    static constexpr const char* name = "parallel";
+
+    template<typename Index, typename Body>
+    static void forRange(Index begin, Index end, std::size_t grain, const Body& body, Partitioner partitioner,
+                         ParallelAffinity& affinity)
+    {
+        parallel_for_range(begin, end, grain, body, partitioner, affinity);
+    }
+
+    template<typename Index, typename Body>
+    static void forRange(Index begin, Index end, std::size_t grain, const Body& body)
+    {
+        parallel_for_range(begin, end, grain, body);
+    }
+
+    template<typename Block>
+    static double orderedSum(std::size_t count, double* partials, const Block& block)
+    {
+        return parallel_ordered_sum(count, partials, block);
+    }
+};
+
+// --- Solver liniowy: factorize(J), solve(J, b, delta_q) ---
+
+// SparseQR z uporządkowaniem COLAMD wziętym z analizy symbolicznej topologii (ColumnOrdering):
+// rozkładany jest jakobian z kolumnami w tej kolejności, więc wynik jest taki sam jak
+// Eigen::SparseQR<..., COLAMDOrdering>, a sesja nie liczy uporządkowania sama
+class SparseQRSolve
+{
+public:
+    static constexpr const char* name = "sparse QR";
+
+    SparseQRSolve(const CompiledSystem& system, LinearSolverType type);
+
+    void factorize(const Eigen::SparseMatrix<double>& J);
+    void solve(const Eigen::SparseMatrix<double>& J, const Eigen::VectorXd& b, Eigen::VectorXd& delta_q);
+
+private:
+    const CompiledSystem& system;
+    const ColumnOrdering* ordering = nullptr;
+    Eigen::SparseMatrix<double> permuted;
+    Eigen::VectorXd solution;  // w kolejności permuted
+    Eigen::SparseQR<Eigen::SparseMatrix<double>, Eigen::NaturalOrdering<int>> qr;
+};
+
+class NormalEquationsSolve
+{
+public:
+    static constexpr const char* name = "normal equations";
+
+    NormalEquationsSolve(const CompiledSystem& system, LinearSolverType type);
+
+    void factorize(const Eigen::SparseMatrix<double>& J);
+    void solve(const Eigen::SparseMatrix<double>& J, const Eigen::VectorXd& b, Eigen::VectorXd& delta_q);
+
+private:
+    const CompiledSystem& system;
+    std::unique_ptr<NormalEquationsSolver> solver;
+};
+
+// Jeden z powyższych, wybrany w czasie działania przez LinearSolverType (RuntimeSolverSession).
+// Tworzony jest tylko wybrany solver; pozostałe strategie nie płacą za rozgałęzienie.
+class RuntimeLinearSolve
+{
+public:
+    static constexpr const char* name = "runtime";
+
+    RuntimeLinearSolve(const CompiledSystem& system, LinearSolverType type);
+
+    void factorize(const Eigen::SparseMatrix<double>& J);
+    void solve(const Eigen::SparseMatrix<double>& J, const Eigen::VectorXd& b, Eigen::VectorXd& delta_q);
+
+private:
+    std::unique_ptr<SparseQRSolve> qr;            // nullptr, gdy wybrano równania normalne
+    std::unique_ptr<NormalEquationsSolve> normal;  // nullptr, gdy wybrano SparseQR
+};
+
+// --- Jakobian: columns(task, first, last) wypełnia kolumny first .. last - 1 ---
+// Definicje są w solver_session.cpp, obok instancji sesji, aby każda kombinacja mogła je rozwinąć.
+
+// Dane wspólne dla wszystkich kolumn jednego liczenia jakobianu
+struct JacobianTask
+{
+    const CompiledSystem& system;
+    const Eigen::VectorXd& q;
+    double t;
+    const Eigen::VectorXd& phi;  // residuum w q
+    const BodyFrames& frames;    // macierze obrotu w q
+    ThreadLocal<JacobianWorkspace>& workspaces;
+    Eigen::SparseMatrix<double>& J;
+};
+
+// Kolumna po kolumnie: zaburzenie jednej współrzędnej, ograniczenia jej ciała liczone skalarnie
+struct ColumnJacobian
+{
+    static constexpr const char* name = "columns";
+
+    static void columns(const JacobianTask& task, Eigen::Index first, Eigen::Index last);
+};
+
+// 7 kolumn ciała naraz w pasach SIMD (FrameLanes); ograniczenia użytkownika kolumna po kolumnie
+struct LaneJacobian
+{
+    static constexpr const char* name = "lanes";
+
+    static void columns(const JacobianTask& task, Eigen::Index first, Eigen::Index last);
+};
+
+#endif // SOLVER_POLICIES_HPP
@@ -0,0 +1,105 @@
+#ifndef SOLVER_SESSION_HPP
+#define SOLVER_SESSION_HPP
+
+#include <vector>
+#include <memory>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "compiled_system.hpp"
+#include "body_frames.hpp"
+#include "grain_tuner.hpp"
+#include "parallel_backend.hpp"
+#include "solver_policies.hpp"
+#include "newton_control.hpp"
+
+// Stanowa sesja solvera dla jednego skompilowanego układu. Przechowuje bufory rozwiązania:
+// residuum, przyrost, kopie stanu, jakobian, rozkład i bufory wątków. Sesja przechowuje
+// referencję do układu.
+// block_size = autotune_block_size: rozmiar bloku i partycjonowanie jakobianu dobierane
+// automatycznie (GrainTuner wspólny dla topologii układu i liczby wątków).
+// Strategie (solver_policies.hpp) wybierane są parametrami szablonu; instancje dla
+// wszystkich kombinacji są w solver_session.cpp. linear_solver ma znaczenie tylko dla
+// RuntimeLinearSolve - pozostałe solvery liniowe są ustalone typem.
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+class BasicSolverSession
+{
+public:
+    explicit BasicSolverSession(const CompiledSystem& system, int block_size = 7,
+                                LinearSolverType linear_solver = LinearSolverType::sparse_qr);
+
+    BasicSolverSession(const BasicSolverSession&) = delete;
+    BasicSolverSession& operator=(const BasicSolverSession&) = delete;
+
+    // Metoda Newtona w miejscu: q - przybliżenie początkowe i wynik
+    void solve(Eigen::VectorXd& q, double t);
+
+    // Jakobian w punkcie (q, t), zapisany do bufora sesji
+    const Eigen::SparseMatrix<double>& jacobian(const Eigen::VectorXd& q, double t);
+
+    // Etapy jednej iteracji solve(), do sterowania z zewnątrz (np. flow_solver):
+    // b = -phi(q, t) wraz z normą b . b; suma liczona w stałych blokach wierszy
+    // i składana po kolei, więc wynik nie zależy od liczby wątków
+    double residual(const Eigen::VectorXd& q, double t);
+
+    // Rozkład ostatnio policzonego jakobianu
+    void factorize();
+
+    // q += przyrost z rozkładu i residuum z ostatniego residual(); liczy iteracje kroku
+    void update(Eigen::VectorXd& q);
+
+    // Początek kroku czasowego: zeruje licznik iteracji, rozkład trzeba policzyć od nowa
+    void beginStep();
+
+    // Co dalej po residual() o normie norm (NewtonControl): jakobian i rozkład, aktualizacja
+    // albo koniec kroku. solve() to beginStep(), a potem etapy w kolejności tych decyzji.
+    NewtonStage nextStage(double norm) const;
+
+    const CompiledSystem& getSystem() const;
+    int getIterations() const;
+
+    // Ustawienie użyte przy ostatnim (lub, przed pierwszym, najbliższym) liczeniu jakobianu
+    JacobianSchedule getSchedule() const;
+
+private:
+    // Residuum z odświeżeniem macierzy obrotu (frames) dla q, równolegle po fragmentach kubełków
+    void evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> out);
+
+    const CompiledSystem& system;
+    JacobianSchedule schedule;
+    std::shared_ptr<GrainTuner> tuner;
+    ParallelAffinity affinity;
+
+    Eigen::VectorXd b;
+    Eigen::VectorXd phi;
+    Eigen::VectorXd delta_q;
+    Eigen::SparseMatrix<double> J;
+    BodyFrames frames;
+    std::vector<double> partial_norms;
+
+    LinearPolicy linear;
+
+    ThreadLocal<JacobianWorkspace> workspaces;
+
+    int iterations = 0;
+    bool factorized = false;
+};
+
+// Domyślna sesja: jakobian w pasach SIMD, SparseQR, pętle równoległe. SparseQR jest
+// domyślny, bo rozkłada J bezpośrednio: równania normalne podnoszą uwarunkowanie do
+// kwadratu i tracą dokładność lub zawodzą, gdy jakobian ma niepełny rząd (więzy
+// nadmiarowe), a QR daje wtedy rozwiązanie najmniejszych kwadratów - jak pierwotny
+// solver oparty na SparseQR. SparseQR z Eigen przydziela pamięć przy każdym rozkładzie
+// i rozwiązaniu, więc ta sesja nie jest wolna od alokacji - oszczędza tylko bufory
+// jakobianu, residuum i wątków.
+using SolverSession = BasicSolverSession<LaneJacobian, SparseQRSolve, ParallelExecution>;
+
+// Jak SolverSession, ale z równaniami normalnymi. Jedyna sesja bez alokacji w stanie
+// ustalonym: po pierwszym kroku czasowym solve() nie przydziela pamięci. Sprawdzane dla
+// jednego wątku - przy wielu pamięć może przydzielać harmonogram zaplecza równoległego.
+using NormalEquationsSession = BasicSolverSession<LaneJacobian, NormalEquationsSolve, ParallelExecution>;
+
+// Solver liniowy wybierany argumentem linear_solver w czasie działania
+using RuntimeSolverSession = BasicSolverSession<LaneJacobian, RuntimeLinearSolve, ParallelExecution>;
+
+#endif // SOLVER_SESSION_HPP
@@ -0,0 +1,87 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+// Kolejka bez blokad dla jednego producenta i jednego konsumenta: pierścień
+// wstępnie utworzonych elementów, więc przekazanie nie przydziela pamięci.
+// Producent wypełnia element z prepare() i udostępnia go przez publish(),
+// konsument czyta front() i zwalnia element przez pop().
+template<typename T>
+class SpscQueue
+{
+public:
+    // capacity zaokrąglane w górę do potęgi dwójki; każdy element to kopia prototype
+    SpscQueue(std::size_t capacity, const T& prototype)
+        : slots(round_up(capacity), prototype), mask(slots.size() - 1)
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producent: wolny element albo nullptr, gdy kolejka jest pełna
+    T* prepare()
+    {
+        const std::size_t position = head.load(std::memory_order_relaxed);
+        if(position - cached_tail == slots.size())
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if(position - cached_tail == slots.size())
+                return nullptr;
+        }
+        return &slots[position & mask];
+    }
+
+    // Producent: element z prepare() staje się widoczny dla konsumenta
+    void publish()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Konsument: najstarszy element albo nullptr, gdy kolejka jest pusta
+    T* front()
+    {
+        const std::size_t position = tail.load(std::memory_order_relaxed);
+        if(position == cached_head)
+        {
+            cached_head = head.load(std::memory_order_acquire);
+            if(position == cached_head)
+                return nullptr;
+        }
+        return &slots[position & mask];
+    }
+
+    // Konsument: element z front() wraca do producenta
+    void pop()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    std::size_t capacity() const
+    {
+        return slots.size();
+    }
+
+private:
+    static std::size_t round_up(std::size_t capacity)
+    {
+        std::size_t size = 1;
+        while(size < capacity)
+            size *= 2;
+        return size;
+    }
+
+    std::vector<T> slots;
+    const std::size_t mask;
+
+    // indeksy producenta i konsumenta w osobnych liniach pamięci podręcznej
+    alignas(64) std::atomic<std::size_t> head{0};
+    std::size_t cached_tail = 0;
+    alignas(64) std::atomic<std::size_t> tail{0};
+    std::size_t cached_head = 0;
+};
+
+#endif // SPSC_QUEUE_HPP
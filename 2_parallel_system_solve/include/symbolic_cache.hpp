@@ -0,0 +1,114 @@
+#ifndef SYMBOLIC_CACHE_HPP
+#define SYMBOLIC_CACHE_HPP
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include <atomic>
+#include <unordered_map>
+#include <Eigen/Sparse>
+#include "constraint_buckets.hpp"
+#include "normal_equations_solver.hpp"
+
+class CompiledSystem;
+
+// Uporządkowanie kolumn jakobianu COLAMD (jak w Eigen::SparseQR z COLAMDOrdering) i struktura
+// jakobianu z kolumnami w tej kolejności; SparseQRSolve rozkłada taką macierz bez ponownego
+// liczenia uporządkowania
+struct ColumnOrdering
+{
+    explicit ColumnOrdering(const Eigen::SparseMatrix<double>& jacobian_pattern);
+
+    std::vector<int> position;            // kolumna i jakobianu to kolumna position[i] macierzy uporządkowanej
+    Eigen::SparseMatrix<double> pattern;  // jakobian uporządkowany (same zera)
+    std::vector<int> value_source;        // wartość k macierzy uporządkowanej to wartość value_source[k] jakobianu
+};
+
+// Część symboliczna zależna tylko od topologii układu: struktura rzadkości jakobianu
+// oraz (leniwie, przy pierwszym użyciu) uporządkowanie kolumn dla SparseQR albo
+// uporządkowanie AMD, drzewo eliminacji i struktura czynnika LDL^T równań normalnych.
+// Współdzielona przez wszystkie układy o tej samej topologii, bezpieczna przy
+// równoczesnym odczycie.
+class SymbolicAnalysis
+{
+public:
+    explicit SymbolicAnalysis(const CompiledSystem& system);
+
+    // Gotowa analiza (np. z ModelImage); normal_equations może być pusty - wtedy leniwie
+    SymbolicAnalysis(Eigen::SparseMatrix<double> jacobian_pattern,
+                     std::unique_ptr<NormalEquationsSymbolic> normal_equations);
+
+    const Eigen::SparseMatrix<double>& getJacobianPattern() const;
+    const NormalEquationsSymbolic& getNormalEquations() const;
+    const ColumnOrdering& getColumnOrdering() const;
+
+private:
+    Eigen::SparseMatrix<double> jacobian_pattern;
+
+    mutable std::once_flag column_ordering_once;
+    mutable std::unique_ptr<ColumnOrdering> column_ordering;
+
+    mutable std::once_flag normal_equations_once;
+    mutable std::unique_ptr<NormalEquationsSymbolic> normal_equations;
+};
+
+// Pamięć podręczna analiz symbolicznych indeksowana kanonicznym skrótem topologii
+// (CompiledSystem::getTopologyHash). Wyszukanie wpisu bierze tylko blokadę współdzieloną;
+// analiza danej topologii jest budowana raz, także gdy wiele wątków prosi o nią równocześnie.
+// Kolizje skrótu są wykrywane porównaniem topologii. Pamięć podręczna trzyma analizy
+// (shared_ptr), więc kolejne układy tej topologii - także tymczasowe CompiledSystem
+// w multibody_solver(mbs) - nie powtarzają analizy. Liczba wpisów jest ograniczona:
+// dodanie wpisu ponad capacity usuwa najdawniej używany (układy, które go używają,
+// zachowują swoją analizę); clear() usuwa wszystkie.
+class SymbolicCache
+{
+public:
+    static constexpr std::size_t default_capacity = 64;
+
+    explicit SymbolicCache(std::size_t capacity = default_capacity);
+
+    // Wspólna instancja używana przez CompiledSystem
+    static SymbolicCache& global();
+
+    std::shared_ptr<const SymbolicAnalysis> get(const CompiledSystem& system);
+
+    // Jak wyżej, ale analiza nieobecna w pamięci podręcznej pochodzi z build()
+    std::shared_ptr<const SymbolicAnalysis> get(const CompiledSystem& system,
+                                                const std::function<std::shared_ptr<const SymbolicAnalysis>()>& build);
+
+    std::size_t size() const;
+    void clear();
+
+    // Ile analiz zbudowano od utworzenia pamięci podręcznej (także dla kolizji skrótu)
+    std::size_t getNumBuilds() const;
+
+private:
+    struct Entry
+    {
+        int num_bodies;
+        std::vector<ConstraintRef> refs;
+        std::vector<int> parameter_index;
+
+        std::mutex build_mutex;
+        std::shared_ptr<const SymbolicAnalysis> analysis;
+        std::atomic<std::uint64_t> last_use{0};
+    };
+
+    static bool matches(const Entry& entry, const CompiledSystem& system);
+
+    std::shared_ptr<const SymbolicAnalysis> build(const std::function<std::shared_ptr<const SymbolicAnalysis>()>& build);
+
+    // Usuwa najdawniej używany wpis; wymaga wyłącznej blokady mutex
+    void evictLeastRecent();
+
+    std::size_t capacity;
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::uint64_t, std::shared_ptr<Entry>> entries;
+    std::atomic<std::uint64_t> clock{0};
+    std::atomic<std::size_t> num_builds{0};
+};
+
+#endif // SYMBOLIC_CACHE_HPP
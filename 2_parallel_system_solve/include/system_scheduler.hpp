@@ -0,0 +1,58 @@
+#ifndef SYSTEM_SCHEDULER_HPP
+#define SYSTEM_SCHEDULER_HPP
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <oneapi/tbb.h>
+
+#include "multibody_system.hpp"
+#include "compiled_system.hpp"
+#include "grain_tuner.hpp"
+
+// Szacowany koszt rozwiązania układu: liczba współrzędnych * liczba ograniczeń
+double system_cost(const CompiledSystem& system);
+
+// Podział num_threads wątków między układy o kosztach costs: każdy układ ma co najmniej
+// wątek, który go liczy, pozostałe wątki dzielone są proporcjonalnie do kosztu (części
+// całkowite, potem po jednym dla największych reszt). Gdy układów jest nie więcej niż
+// wątków, budżety sumują się dokładnie do num_threads.
+std::vector<int> thread_budgets(const std::vector<double>& costs, int num_threads);
+
+// Dwupoziomowe zrównoleglenie partii układów: poziom zewnętrzny (po układach) działa
+// w task_arena o wysokim priorytecie, jakobiany w task_arena o niskim priorytecie - jednej
+// na budżet, wspólnej dla układów o tym budżecie, o współbieżności równej sumie ich budżetów.
+// Budżety (thread_budgets) wynikają z udziału kosztu układu w koszcie partii i sumują się
+// do liczby wątków, więc małe układy liczone są sekwencyjnie, duże mogą zająć wiele wątków,
+// a areny razem nie przekraczają num_threads. Wątki przechodzą do aren wewnętrznych dopiero
+// wtedy, gdy na poziomie zewnętrznym brakuje pracy. Układy rozdzielane są od najdroższego.
+class SystemScheduler
+{
+public:
+    explicit SystemScheduler(int num_threads = current_thread_count());
+
+    SystemScheduler(const SystemScheduler&) = delete;
+    SystemScheduler& operator=(const SystemScheduler&) = delete;
+
+    // Jak multibody_solver dla każdego układu; wynik w kolejności systems
+    std::vector<std::vector<State>> solve(const std::vector<CompiledSystem>& systems, double end_time,
+                                          int block_size = 7);
+
+    // Budżety wątków przydzielone układom w ostatnim solve (w kolejności systems)
+    const std::vector<int>& getBudgets() const;
+
+    int getNumThreads() const;
+
+private:
+    int num_threads;
+    // Współbieżność aren ograniczona do wątków dostępnych dla procesu
+    int max_concurrency;
+    oneapi::tbb::task_arena outer;
+
+    // Areny wewnętrzne ostatniego solve, po jednej na budżet
+    std::map<int, std::unique_ptr<oneapi::tbb::task_arena>> inner;
+
+    std::vector<int> budgets;
+};
+
+#endif // SYSTEM_SCHEDULER_HPP
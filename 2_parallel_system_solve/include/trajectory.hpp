@@ -0,0 +1,43 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+#include <vector>
+#include <eigen3/Eigen/Dense>
+#include "multibody_system.hpp"
+
+// Ciągła reprezentacja trajektorii wyznaczonej przez multibody_solver (dense output).
+// Położenia (x, y, z) interpolowane są wielomianem Hermite'a na podstawie zapisanych
+// położeń i prędkości, orientacje (kwaterniony e0..e3) - przez slerp. Znak kwaternionu
+// w węźle dobierany jest zgodnie z poprzednim węzłem (e i -e to ta sama orientacja),
+// więc interpolant jest ciągły; w węzłach at() zwraca zapisany stan.
+class Trajectory
+{
+public:
+    // Prędkości w węzłach szacowane trzypunktowymi różnicami skończonymi z kolejnych stanów
+    explicit Trajectory(const std::vector<State>& states);
+
+    // Prędkości w węzłach podane jawnie (jeden wektor na stan)
+    Trajectory(const std::vector<State>& states, const std::vector<Eigen::VectorXd>& velocities);
+
+    // Stan układu w dowolnej chwili t (poza zakresem - stan skrajny)
+    State at(double t) const;
+    void at(double t, Eigen::VectorXd& q) const;
+
+    // Pochodna interpolanta po czasie; na końcach - pochodna skrajnego odcinka
+    Eigen::VectorXd velocity(double t) const;
+
+    double getStartTime() const;
+    double getEndTime() const;
+    int getNumSamples() const;
+
+private:
+    std::size_t segment(double t) const;
+    void estimateVelocities();
+
+    int num_bodies;
+    std::vector<double> times;
+    std::vector<Eigen::VectorXd> positions;
+    std::vector<Eigen::VectorXd> velocities;
+};
+
+#endif // TRAJECTORY_HPP
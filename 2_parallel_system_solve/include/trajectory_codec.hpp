@@ -0,0 +1,49 @@
+#ifndef TRAJECTORY_CODEC_HPP
+#define TRAJECTORY_CODEC_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Kompresja stratna trajektorii z dopuszczalnym błędem podanym przez użytkownika
+struct TrajectoryCompression
+{
+    // Największy błąd położenia (x, y, z)
+    double position_tolerance = 1e-6;
+    // Największy błąd każdej składowej kwaternionu (dla kwaternionów jednostkowych)
+    double orientation_tolerance = 1e-6;
+};
+
+// Kodowanie jednego fragmentu pliku trajektorii (kolumny 7 * liczba ciał współrzędnych po
+// steps kroków). Położenia kwantowane są krokiem 2 * position_tolerance, kwaternion - w
+// postaci "smallest three": numer i znak największej składowej oraz trzy pozostałe,
+// kwantowane krokiem orientation_tolerance / 2 (odtwarzana składowa ma wtedy błąd co
+// najwyżej 3/4 tolerancji). Każda kolumna liczb całkowitych to wartość z pierwszego kroku
+// i różnice między kolejnymi krokami, zapisane kodem Rice'a z parametrem dobranym do
+// średniej kolumny. Fragment dekodowany jest niezależnie od pozostałych.
+class TrajectoryCodec
+{
+public:
+    TrajectoryCodec(std::size_t num_bodies, const TrajectoryCompression& compression);
+    // Kroki kwantyzacji zapisane w pliku
+    TrajectoryCodec(std::size_t num_bodies, double position_step, double orientation_step);
+
+    // columns: współrzędna c w [c * steps, (c + 1) * steps); wynik dopisywany do out.
+    // Położenie poza zakresem kwantyzacji - std::runtime_error
+    void encode(const double* columns, std::size_t steps, std::vector<unsigned char>& out);
+
+    // Odwrotność encode; uszkodzone dane - std::runtime_error
+    void decode(const unsigned char* data, std::size_t bytes, std::size_t steps, double* columns);
+
+    double getPositionStep() const;
+    double getOrientationStep() const;
+
+private:
+    std::size_t num_bodies;
+    double position_step;
+    double orientation_step;
+
+    std::vector<std::int64_t> values;  // kolumny liczb całkowitych jednego fragmentu
+};
+
+#endif // TRAJECTORY_CODEC_HPP
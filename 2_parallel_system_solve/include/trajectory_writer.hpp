@@ -0,0 +1,144 @@
+#ifndef TRAJECTORY_WRITER_HPP
+#define TRAJECTORY_WRITER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <exception>
+#include <eigen3/Eigen/Dense>
+
+#include "multibody_system.hpp"
+#include "spsc_queue.hpp"
+#include "trajectory_codec.hpp"
+
+// Binarny plik trajektorii: nagłówek (wersja, kodowanie, liczba ciał, kroków i fragmentów,
+// położenie indeksu, kroki kwantyzacji) z id ciał, potem fragmenty po chunk_steps kroków,
+// a na końcu indeks: położenia fragmentów. Fragment to
+// liczba kroków i bajtów danych, chwile czasu jego kroków i dane zapisane kolumnami - dla
+// każdej współrzędnej jej wartości we wszystkich krokach fragmentu. Nagłówek i indeks
+// zapisuje dopiero close(); plik niezamknięty (przerwany zapis) czytany jest fragment po
+// fragmencie do ostatniego kompletnego. Fragmenty skompresowane (TrajectoryCodec)
+// dekodowane są niezależnie, więc odczyt dowolnego przedziału czasu czyta tylko
+// fragmenty, które go obejmują. Format pamięci tej maszyny.
+
+constexpr std::uint32_t trajectory_file_version = 3;
+
+// Numeracja jest częścią formatu
+enum class TrajectoryEncoding : std::uint32_t
+{
+    raw,         // double
+    compressed   // TrajectoryCodec
+};
+
+// Zapis trajektorii w osobnym wątku. Wątek rozwiązujący tylko kopiuje stan do wstępnie
+// przydzielonego elementu kolejki bez blokad (SpscQueue); fragmenty składa i zapisuje wątek
+// zapisujący. push() czeka wyłącznie przy pełnej kolejce (getNumStalls()). Jeden producent.
+class TrajectoryWriter
+{
+public:
+    TrajectoryWriter(const std::string& path, const std::vector<long int>& body_ids,
+                     std::size_t chunk_steps = 256, std::size_t queue_capacity = 1024);
+    // Fragmenty kompresowane w wątku zapisującym z błędem nie większym niż tolerancje
+    TrajectoryWriter(const std::string& path, const std::vector<long int>& body_ids,
+                     const TrajectoryCompression& compression,
+                     std::size_t chunk_steps = 256, std::size_t queue_capacity = 1024);
+    // Wywołuje close(); błąd zapisu jest wtedy tylko wypisywany na std::cerr
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // Stan o 7 * liczba ciał współrzędnych w chwili t; pełny fragment trafia do pliku od razu
+    void push(const Eigen::VectorXd& q, double t);
+
+    // Zapisuje ostatni fragment i indeks, kończy wątek; błąd zapisu - std::runtime_error
+    void close();
+
+    // Ile razy push() czekał na miejsce w kolejce
+    std::size_t getNumStalls() const;
+
+private:
+    struct Sample
+    {
+        Eigen::VectorXd q;
+        double t;
+    };
+
+    TrajectoryWriter(const std::string& path, const std::vector<long int>& body_ids,
+                     std::unique_ptr<TrajectoryCodec> codec, std::size_t chunk_steps, std::size_t queue_capacity);
+
+    void run();
+    void writeChunk(std::size_t steps);
+    void writeHeader(std::uint64_t num_steps, std::uint64_t num_chunks, std::uint64_t index_offset);
+
+    std::ofstream file;
+    std::string path;
+    std::vector<long int> body_ids;
+    std::size_t num_coordinates;
+    std::size_t chunk_steps;
+
+    SpscQueue<Sample> queue;
+    std::size_t num_stalls = 0;
+    std::atomic<bool> closing{false};
+    bool closed = false;
+
+    // tylko wątek zapisujący
+    std::vector<double> columns;  // fragment, współrzędna c w [c * chunk_steps, (c + 1) * chunk_steps)
+    std::vector<double> times;    // chwile czasu kroków fragmentu
+    std::uint64_t num_steps = 0;  // w zapisanych fragmentach
+    std::vector<std::uint64_t> chunk_offsets;
+    std::unique_ptr<TrajectoryCodec> codec;  // nullptr - fragmenty bez kompresji
+    std::vector<unsigned char> encoded;
+    std::exception_ptr error;
+
+    std::thread writer;
+};
+
+// Odczyt pliku TrajectoryWriter; wczytuje nagłówek, indeks (w pliku niezamkniętym - kolejne
+// fragmenty do pierwszego niekompletnego) i chwile czasu fragmentów, dane na żądanie
+class TrajectoryReader
+{
+public:
+    explicit TrajectoryReader(const std::string& path);
+
+    std::size_t getNumBodies() const;
+    std::size_t getNumSteps() const;
+    std::size_t getChunkSteps() const;
+    TrajectoryEncoding getEncoding() const;
+    const std::vector<long int>& getBodyIds() const;
+    const std::vector<double>& getTimes() const;
+
+    // false - plik nie został zamknięty; dostępne są kroki kompletnych fragmentów
+    bool isClosed() const;
+
+    // Kroki first .. first + count - 1; czytane są tylko zawierające je fragmenty
+    std::vector<State> read(std::size_t first, std::size_t count);
+    // Kroki o chwilach czasu z przedziału [begin_time, end_time]
+    std::vector<State> readWindow(double begin_time, double end_time);
+    std::vector<State> readAll();
+
+private:
+    void readChunk(std::size_t chunk, std::vector<double>& columns);
+    // Chwile czasu fragmentu o nagłówku pod offset, dopisane do times; liczba kroków fragmentu
+    std::size_t readChunkTimes(std::uint64_t offset);
+    // Fragmenty pliku niezamkniętego, od początku do pierwszego niekompletnego
+    void scanChunks(std::uint64_t first_offset);
+
+    std::ifstream file;
+    std::string path;
+    std::vector<long int> body_ids;
+    std::size_t num_coordinates = 0;
+    std::size_t chunk_steps = 0;
+    std::vector<double> times;
+    std::vector<std::uint64_t> chunk_offsets;  // num_chunks + 1, ostatni to koniec ostatniego fragmentu
+    bool closed = true;
+    std::unique_ptr<TrajectoryCodec> codec;
+    std::vector<unsigned char> encoded;
+};
+
+#endif // TRAJECTORY_WRITER_HPP
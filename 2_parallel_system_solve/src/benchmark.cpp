@@ -1,7 +1,21 @@
 #include <vector>
 #include <random>
+#include <string>
+#include <cstdio>
+#include <fstream>
+#include <memory>
 #include "benchmark/benchmark.h"
 #include "multibody_solver.hpp"
+#include "ensemble_solver.hpp"
+#include "model_loader.hpp"
+#include "model_image.hpp"
+#include "parallel_backend.hpp"
+#ifdef MULTIBODY_PARALLEL_TBB
+#include "system_scheduler.hpp"
+#include "flow_solver.hpp"
+#include "numa_solver.hpp"
+#include "process_solver.hpp"
+#endif
 
 Eigen::Vector3d distance(double t)
                     {
@@ -9,24 +23,14 @@ Eigen::Vector3d distance(double t)
                         return Eigen::Vector3d(0.0, 0.0, cos(t));
                     };
 
-void MultibodySolverBenchmark(benchmark::State& state)
+std::vector<MultibodySystem> build_platforms(long n_platforms, long n_leg_parts)
 {
-    
-    
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_real_distribution<> dist;
 
     std::vector<MultibodySystem> systems;
 
-    auto n_platforms= state.range(0);
-    auto n_leg_parts = state.range(1);
-    const auto max_threads = state.range(2);
-    const auto guard = oneapi::tbb::global_control{
-      oneapi::tbb::global_control::max_allowed_parallelism, static_cast<std::size_t>(max_threads)};
-
-    const auto block_size = state.range(3);
-
     double platform_size_x = 1000.0;
     double platform_size_y = 1000.0;
 
@@ -103,16 +107,45 @@ void MultibodySolverBenchmark(benchmark::State& state)
         }
     }
 
+    return systems;
+}
+
+// Gdy liczby wątków nie da się ograniczyć, przebiegi z inną liczbą niż pula biblioteki
+// mierzyłyby to samo pod inną etykietą - są pomijane z komunikatem
+bool skip_thread_count(benchmark::State& state, int max_threads)
+{
+    if(ThreadLimit::supported || max_threads == current_thread_count())
+        return false;
+    state.SkipWithError("Thread count cannot be limited with this std::execution backend");
+    return true;
+}
+
+void MultibodySolverBenchmark(benchmark::State& state)
+{
+    auto n_platforms= state.range(0);
+    auto n_leg_parts = state.range(1);
+    const auto max_threads = state.range(2);
+    if(skip_thread_count(state, static_cast<int>(max_threads)))
+        return;
+    const auto guard = ThreadLimit{static_cast<int>(max_threads)};
+
+    const auto block_size = state.range(3);
+
+    const auto systems = build_platforms(n_platforms, n_leg_parts);
+
+    // systems are compiled once, every solve reuses them
+    std::vector<CompiledSystem> compiled_systems;
+    compiled_systems.reserve(systems.size());
+    for(const auto& sys : systems)
+    {
+        compiled_systems.emplace_back(sys);
+    }
+
     for (auto _ : state)
     {
-        oneapi::tbb::parallel_for(
-            oneapi::tbb::blocked_range<size_t>(0, systems.size()),
-            [&](const oneapi::tbb::blocked_range<size_t>& r)
+        parallel_for_each_index(size_t{0}, compiled_systems.size(), [&](size_t i)
             {
-                for (size_t i = r.begin(); i != r.end(); ++i)
-                {
-                    auto output = multibody_solver(systems[i], 0.0, block_size);
-                }
+                auto output = multibody_solver(compiled_systems[i], 0.0, block_size);
             });
     }
     state.SetItemsProcessed(state.iterations() * n_platforms * n_leg_parts);
@@ -126,9 +159,462 @@ BENCHMARK(MultibodySolverBenchmark)->Unit(benchmark::kSecond)
         {4, 8, 16, 24, 48},  // Number of platforms in total
         {benchmark::CreateRange(2, 128, 2)}, // Number of legs' parts
         {4, 8, 16, 24}, // Number of threads
-        {7, 14, 28, 56, 70} // Block size for Jacobian
+        {autotune_block_size, 7, 14, 28, 56, 70} // Block size for Jacobian (-1 - autotuned)
     })
     ->UseRealTime()->MeasureProcessCPUTime()->Name("Par System solve (#platforms, #leg parts, #threads, block size)");
 
 
+// Platforma z n_legs nogami po n_leg_parts segmentów w formacie tekstowym (model_loader.hpp)
+std::string platform_model_text(long n_legs, long n_leg_parts)
+{
+    std::string text;
+    const auto line = [&text](const std::string& element) { text += element; text += '\n'; };
+
+    line("bodies " + std::to_string(1 + n_legs * n_leg_parts));
+    line("body 1 0 0 " + std::to_string(0.5 * n_leg_parts) + " 1 0 0 0");
+    line("quaternion 0 1");
+
+    for(long j = 1; j <= n_legs; j++)
+    {
+        const std::string x = std::to_string(static_cast<double>(j % 1000));
+        const std::string y = std::to_string(static_cast<double>(j / 1000));
+
+        for(long k = 1; k <= n_leg_parts; k++)
+        {
+            const long segment_id = j * 1'000'000 + k;
+            const std::string id = std::to_string(segment_id);
+            const std::string z = std::to_string((k - 1) * 0.5);
+
+            line("body " + id + " " + x + " " + y + " " + z + (k % 2 == 1 ? " 0.9659 0.2588 0 0" : " 0.2588 0.9659 0 0"));
+            line("quaternion " + std::to_string(segment_id + 10'000'000) + " " + id);
+
+            if(k == 1)
+            {
+                line("revolute " + std::to_string(segment_id + 3'000'000) + " 0 " + id + " " + x + " " + y + " 0  0 -0.5 0  1 0 0  1 0 0");
+            }
+            else
+            {
+                const std::string previous = std::to_string(segment_id - 1);
+                line("revolute " + std::to_string(segment_id + 3'000'000) + " " + previous + " " + id + "  0 0.5 0  0 -0.5 0  1 0 0  1 0 0");
+                line("distance " + std::to_string(segment_id + 6'000'000) + " " + previous + " " + id + "  0 -0.5 0  0 0.5 0  distance");
+            }
+        }
+
+        line("revolute " + std::to_string(j) + " " + std::to_string(j * 1'000'000 + n_leg_parts) + " 1  0 0.5 0  " + x + " " + y + " 0  1 0 0  1 0 0");
+    }
+
+    return text;
+}
+
+void ModelLoadBenchmark(benchmark::State& state)
+{
+    const auto n_legs = state.range(0);
+    const auto n_leg_parts = state.range(1);
+
+    const std::string text = platform_model_text(n_legs, n_leg_parts);
+    DriverRegistry drivers;
+    drivers.add("distance", distance);
+
+    for (auto _ : state)
+    {
+        auto mbs = parse_model(text, drivers);
+        benchmark::DoNotOptimize(mbs);
+    }
+    state.SetItemsProcessed(state.iterations() * (1 + n_legs * n_leg_parts));
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(text.size()));
+}
+
+BENCHMARK(ModelLoadBenchmark)->Unit(benchmark::kMillisecond)
+    ->ArgsProduct
+    ({
+        {2, 64, 1024}, // Number of legs
+        {benchmark::CreateRange(2, 128, 4)} // Number of legs' parts
+    })
+    ->UseRealTime()->Name("Text model load (#legs, #leg parts)");
+
+// Start krótkiego procesu: model z tekstu (budowa, kompilacja, analiza symboliczna)
+// albo z obrazu binarnego (mmap); pamięć podręczna analiz czyszczona w każdej iteracji
+void ModelStartupBenchmark(benchmark::State& state)
+{
+    const auto n_legs = state.range(0);
+    const auto n_leg_parts = state.range(1);
+    const bool from_image = state.range(2) != 0;
+
+    DriverRegistry drivers;
+    drivers.add("distance", distance);
+    const std::string text = platform_model_text(n_legs, n_leg_parts);
+
+    const std::string path = "startup_benchmark.image";
+    if(from_image)
+    {
+        save_model_image(CompiledSystem{parse_model(text, drivers)}, path, drivers);
+    }
+
+    for (auto _ : state)
+    {
+        SymbolicCache::global().clear();
+        if(from_image)
+        {
+            const ModelImage image{path};
+            const CompiledSystem compiled{image, drivers};
+            benchmark::DoNotOptimize(compiled.getSymbolic().getNormalEquations());
+        }
+        else
+        {
+            const CompiledSystem compiled{parse_model(text, drivers)};
+            benchmark::DoNotOptimize(compiled.getSymbolic().getNormalEquations());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (1 + n_legs * n_leg_parts));
+
+    if(from_image)
+    {
+        std::remove(path.c_str());
+    }
+}
+
+BENCHMARK(ModelStartupBenchmark)->Unit(benchmark::kMillisecond)
+    ->ArgsProduct
+    ({
+        {2, 64, 1024}, // Number of legs
+        {benchmark::CreateRange(2, 128, 4)}, // Number of legs' parts
+        {0, 1} // 0 - text model, 1 - binary image
+    })
+    ->UseRealTime()->Name("Model startup (#legs, #leg parts, from image)");
+
+// Strategie sesji wybierane przy kompilacji; dawne katalogi 0_unoptimized i 1_parallel_jacobian
+// to odpowiednio SequentialColumnSession i ParallelColumnSession
+using SequentialColumnSession = BasicSolverSession<ColumnJacobian, SparseQRSolve, SequentialExecution>;
+using ParallelColumnSession = BasicSolverSession<ColumnJacobian, SparseQRSolve, ParallelExecution>;
+using LaneQRSession = BasicSolverSession<LaneJacobian, SparseQRSolve, ParallelExecution>;
+using LaneNormalSession = BasicSolverSession<LaneJacobian, NormalEquationsSolve, ParallelExecution>;
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+std::string policy_benchmark_name(const BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>*)
+{
+    return std::string{"Policy solve "} + JacobianPolicy::name + "/" + LinearPolicy::name + "/" + ExecutionPolicy::name
+        + " (#platforms, #leg parts, #threads, block size)";
+}
+
+// Układy rozwiązywane po kolei, równoległość (jeśli jest) tylko wewnątrz sesji
+template<class Session>
+void PolicySolverBenchmark(benchmark::State& state)
+{
+    auto n_platforms= state.range(0);
+    auto n_leg_parts = state.range(1);
+    const auto max_threads = state.range(2);
+    if(skip_thread_count(state, static_cast<int>(max_threads)))
+        return;
+    const auto guard = ThreadLimit{static_cast<int>(max_threads)};
+
+    const auto block_size = static_cast<int>(state.range(3));
+
+    const auto systems = build_platforms(n_platforms, n_leg_parts);
+
+    std::vector<CompiledSystem> compiled_systems;
+    compiled_systems.reserve(systems.size());
+    for(const auto& sys : systems)
+    {
+        compiled_systems.emplace_back(sys);
+    }
+
+    for (auto _ : state)
+    {
+        for(const auto& system : compiled_systems)
+        {
+            Session session{system, block_size};
+            auto output = multibody_solver(session, 0.0);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * n_platforms * n_leg_parts);
+}
+
+#define POLICY_SOLVER_BENCHMARK(Session) \
+    BENCHMARK_TEMPLATE(PolicySolverBenchmark, Session)->Unit(benchmark::kSecond) \
+        ->ArgsProduct \
+        ({ \
+            {4, 8, 16, 24, 48}, \
+            {benchmark::CreateRange(2, 128, 2)}, \
+            {4, 8, 16, 24}, \
+            {7, 14, 28, 56, 70} \
+        }) \
+        ->UseRealTime()->MeasureProcessCPUTime()->Name(policy_benchmark_name(static_cast<const Session*>(nullptr)))
+
+POLICY_SOLVER_BENCHMARK(SequentialColumnSession);
+POLICY_SOLVER_BENCHMARK(ParallelColumnSession);
+POLICY_SOLVER_BENCHMARK(LaneQRSession);
+POLICY_SOLVER_BENCHMARK(LaneNormalSession);
+
+// Trajektoria w pamięci zapisywana po rozwiązaniu (0) albo w trakcie, w wątku TrajectoryWriter (1)
+void TrajectoryOutputBenchmark(benchmark::State& state)
+{
+    const auto n_leg_parts = state.range(0);
+    const bool background = state.range(1) != 0;
+    const double end_time = 1.0;
+
+    const CompiledSystem compiled{build_platforms(1, n_leg_parts).front()};
+    const std::string path = "output_benchmark.trajectory";
+
+    for (auto _ : state)
+    {
+        SolverSession session{compiled};
+        if(background)
+        {
+            TrajectoryWriter writer{path, compiled.getBodyIds()};
+            multibody_solver(session, end_time, writer);
+            writer.close();
+        }
+        else
+        {
+            const auto states = multibody_solver(session, end_time);
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            for(const auto& s : states)
+            {
+                const double t = s.getTime();
+                file.write(reinterpret_cast<const char*>(&t), sizeof(t));
+                file.write(reinterpret_cast<const char*>(s.getQ().data()),
+                           static_cast<std::streamsize>(s.getQ().size() * sizeof(double)));
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 11); // time steps 0, 0.1, ..., 1
+
+    std::remove(path.c_str());
+}
+
+BENCHMARK(TrajectoryOutputBenchmark)->Unit(benchmark::kMillisecond)
+    ->ArgsProduct
+    ({
+        {2, 8, 32, 128}, // Number of legs' parts
+        {0, 1} // 0 - states kept in memory, 1 - background writer
+    })
+    ->UseRealTime()->Name("Trajectory output (#leg parts, background)");
+
+// Zapis i odczyt całej trajektorii bez kompresji (0) albo skompresowanej z tolerancją 1e-6 (1)
+void TrajectoryStorageBenchmark(benchmark::State& state)
+{
+    const auto n_leg_parts = state.range(0);
+    const bool compressed = state.range(1) != 0;
+
+    const CompiledSystem compiled{build_platforms(1, n_leg_parts).front()};
+    const auto states = multibody_solver(compiled, 1.0);
+    const std::string path = "storage_benchmark.trajectory";
+
+    std::size_t bytes = 0;
+    for (auto _ : state)
+    {
+        {
+            const auto writer = compressed
+                ? std::make_unique<TrajectoryWriter>(path, compiled.getBodyIds(), TrajectoryCompression{})
+                : std::make_unique<TrajectoryWriter>(path, compiled.getBodyIds());
+            for(const auto& s : states)
+            {
+                writer->push(s.getQ(), s.getTime());
+            }
+            writer->close();
+        }
+        TrajectoryReader reader{path};
+        benchmark::DoNotOptimize(reader.readAll());
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        bytes = static_cast<std::size_t>(file.tellg());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(states.size()));
+    state.counters["bytes_per_step"] = static_cast<double>(bytes) / static_cast<double>(states.size());
+
+    std::remove(path.c_str());
+}
+
+BENCHMARK(TrajectoryStorageBenchmark)->Unit(benchmark::kMillisecond)
+    ->ArgsProduct
+    ({
+        {2, 8, 32, 128}, // Number of legs' parts
+        {0, 1} // 0 - raw doubles, 1 - compressed
+    })
+    ->UseRealTime()->Name("Trajectory storage (#leg parts, compressed)");
+
+
+void EnsembleSolverBenchmark(benchmark::State& state)
+{
+    auto n_platforms= state.range(0);
+    auto n_leg_parts = state.range(1);
+    const auto max_threads = state.range(2);
+    if(skip_thread_count(state, static_cast<int>(max_threads)))
+        return;
+    const auto guard = ThreadLimit{static_cast<int>(max_threads)};
+
+    const auto systems = build_platforms(n_platforms, n_leg_parts);
+
+    std::vector<CompiledSystem> compiled_systems;
+    compiled_systems.reserve(systems.size());
+    for(const auto& sys : systems)
+    {
+        compiled_systems.emplace_back(sys);
+    }
+
+    // identical topologies are solved in lockstep, ensemble_width systems at a time
+    for (auto _ : state)
+    {
+        auto output = ensemble_solver(compiled_systems, 0.0);
+    }
+    state.SetItemsProcessed(state.iterations() * n_platforms * n_leg_parts);
+}
+
+BENCHMARK(EnsembleSolverBenchmark)->Unit(benchmark::kSecond)
+    ->ArgsProduct
+    ({
+        {8, 16, 48, 1000},  // Number of platforms in total
+        {benchmark::CreateRange(2, 128, 2)}, // Number of legs' parts
+        {4, 8, 16, 24} // Number of threads
+    })
+    ->UseRealTime()->MeasureProcessCPUTime()->Name("Ensemble solve (#platforms, #leg parts, #threads)");
+
+// Solvers built directly on oneTBB (task_arena, flow graph)
+#ifdef MULTIBODY_PARALLEL_TBB
+
+void HierarchicalSolverBenchmark(benchmark::State& state)
+{
+    auto n_platforms= state.range(0);
+    auto n_leg_parts = state.range(1);
+    const auto max_threads = state.range(2);
+    const auto guard = oneapi::tbb::global_control{
+      oneapi::tbb::global_control::max_allowed_parallelism, static_cast<std::size_t>(max_threads)};
+
+    // mixed batch: one platform with n_leg_parts per leg, the rest with 2
+    std::vector<CompiledSystem> compiled_systems;
+    compiled_systems.reserve(n_platforms);
+    for(const auto& sys : build_platforms(1, n_leg_parts))
+    {
+        compiled_systems.emplace_back(sys);
+    }
+    for(const auto& sys : build_platforms(n_platforms - 1, 2))
+    {
+        compiled_systems.emplace_back(sys);
+    }
+
+    SystemScheduler scheduler{static_cast<int>(max_threads)};
+    for (auto _ : state)
+    {
+        auto output = scheduler.solve(compiled_systems, 0.0);
+    }
+    state.SetItemsProcessed(state.iterations() * n_platforms);
+}
+
+BENCHMARK(HierarchicalSolverBenchmark)->Unit(benchmark::kSecond)
+    ->ArgsProduct
+    ({
+        {4, 8, 16, 24, 48},  // Number of platforms in total
+        {benchmark::CreateRange(2, 128, 2)}, // Number of legs' parts of the biggest platform
+        {4, 8, 16, 24} // Number of threads
+    })
+    ->UseRealTime()->MeasureProcessCPUTime()->Name("Hierarchical solve (#platforms, #leg parts, #threads)");
+
+void FlowSolverBenchmark(benchmark::State& state)
+{
+    auto n_platforms= state.range(0);
+    auto n_leg_parts = state.range(1);
+    const auto max_threads = state.range(2);
+    const auto guard = oneapi::tbb::global_control{
+      oneapi::tbb::global_control::max_allowed_parallelism, static_cast<std::size_t>(max_threads)};
+
+    const auto systems = build_platforms(n_platforms, n_leg_parts);
+
+    std::vector<CompiledSystem> compiled_systems;
+    compiled_systems.reserve(systems.size());
+    for(const auto& sys : systems)
+    {
+        compiled_systems.emplace_back(sys);
+    }
+
+    // all systems, time steps and Newton stages in one task graph, without barriers between systems
+    for (auto _ : state)
+    {
+        auto output = flow_solver(compiled_systems, 0.0);
+    }
+    state.SetItemsProcessed(state.iterations() * n_platforms * n_leg_parts);
+}
+
+BENCHMARK(FlowSolverBenchmark)->Unit(benchmark::kSecond)
+    ->ArgsProduct
+    ({
+        {4, 8, 16, 24, 48},  // Number of platforms in total
+        {benchmark::CreateRange(2, 128, 2)}, // Number of legs' parts
+        {4, 8, 16, 24} // Number of threads
+    })
+    ->UseRealTime()->MeasureProcessCPUTime()->Name("Flow graph solve (#platforms, #leg parts, #threads)");
+
+void NumaSolverBenchmark(benchmark::State& state)
+{
+    auto n_platforms= state.range(0);
+    auto n_leg_parts = state.range(1);
+    const auto max_threads = state.range(2);
+    const auto guard = oneapi::tbb::global_control{
+      oneapi::tbb::global_control::max_allowed_parallelism, static_cast<std::size_t>(max_threads)};
+
+    const auto systems = build_platforms(n_platforms, n_leg_parts);
+
+    std::vector<CompiledSystem> compiled_systems;
+    compiled_systems.reserve(systems.size());
+    for(const auto& sys : systems)
+    {
+        compiled_systems.emplace_back(sys);
+    }
+
+    // systems and session buffers are placed on their nodes once, every solve reuses them
+    NumaBatch batch{compiled_systems};
+    for (auto _ : state)
+    {
+        auto output = batch.solve(0.0);
+    }
+    state.SetItemsProcessed(state.iterations() * n_platforms * n_leg_parts);
+}
+
+BENCHMARK(NumaSolverBenchmark)->Unit(benchmark::kSecond)
+    ->ArgsProduct
+    ({
+        {4, 8, 16, 24, 48},  // Number of platforms in total
+        {benchmark::CreateRange(2, 128, 2)}, // Number of legs' parts
+        {4, 8, 16, 24, 48} // Number of threads
+    })
+    ->UseRealTime()->MeasureProcessCPUTime()->Name("NUMA batch solve (#platforms, #leg parts, #threads)");
+
+void ProcessSolverBenchmark(benchmark::State& state)
+{
+    auto n_platforms= state.range(0);
+    auto n_leg_parts = state.range(1);
+    const auto n_processes = state.range(2);
+
+    // no global_control here: TBB has to be idle before the worker processes are forked,
+    // every process uses the cores of its own share
+    const auto systems = build_platforms(n_platforms, n_leg_parts);
+
+    std::vector<CompiledSystem> compiled_systems;
+    compiled_systems.reserve(systems.size());
+    for(const auto& sys : systems)
+    {
+        compiled_systems.emplace_back(sys);
+    }
+
+    std::size_t unpinned = 0;
+    for (auto _ : state)
+    {
+        auto output = process_solver(compiled_systems, 0.0, static_cast<int>(n_processes));
+        unpinned = output.getNumUnpinned();
+    }
+    state.counters["unpinned"] = static_cast<double>(unpinned);
+    state.SetItemsProcessed(state.iterations() * n_platforms * n_leg_parts);
+}
+
+BENCHMARK(ProcessSolverBenchmark)->Unit(benchmark::kSecond)
+    ->ArgsProduct
+    ({
+        {4, 8, 16, 24, 48},  // Number of platforms in total
+        {benchmark::CreateRange(2, 128, 2)}, // Number of legs' parts
+        {1, 2, 4, 8} // Number of worker processes
+    })
+    ->UseRealTime()->Name("Process solve (#platforms, #leg parts, #processes)");
+
+#endif // MULTIBODY_PARALLEL_TBB
+
+
 BENCHMARK_MAIN();
\ No newline at end of file
@@ -3,7 +3,7 @@
 #include <Eigen/Dense>
 
 Body::Body(long int id, double x, double y, double z, double e0, double e1, double e2, double e3)
-    : id(id), q(7)
+    : id(id)
 {
     double norm = std::sqrt(e0*e0 + e1*e1 + e2*e2 + e3*e3);
     e0 /= norm;
@@ -13,12 +13,12 @@ Body::Body(long int id, double x, double y, double z, double e0, double e1, doub
     q << x, y, z, e0, e1, e2, e3;
 }
 
-void Body::setPosition(const Eigen::VectorXd& position)
+void Body::setPosition(const Eigen::Matrix<double, 7, 1>& position)
 {
     q = position;
 }
 
-const Eigen::VectorXd& Body::getPosition() const
+const Eigen::Matrix<double, 7, 1>& Body::getPosition() const
 {
     return q;
 }
@@ -0,0 +1,49 @@
+#include "body_frames.hpp"
+#include <vector>
+#include <eigen3/Eigen/Dense>
+#include "quaternion_operations.hpp"
+#include "simd_kernels.hpp"
+
+BodyFrames::BodyFrames(int num_bodies)
+{
+    resize(num_bodies);
+}
+
+void BodyFrames::resize(int num_bodies)
+{
+    rotations.resize(num_bodies + 1);
+    positions.resize(num_bodies + 1);
+    rotations[0].setIdentity();
+    positions[0].setZero();
+}
+
+void BodyFrames::update(const Eigen::VectorXd& q)
+{
+    update(q, 0, static_cast<std::int32_t>(rotations.size() - 1));
+}
+
+void BodyFrames::update(const Eigen::VectorXd& q, std::int32_t first, std::int32_t last)
+{
+    if(last <= first)
+        return;
+
+    // all quaternions of the range at once (stride 7 in q), vectorized when the CPU allows it
+    rotation_matrices(q.data() + first * 7 + 3, 7, last - first, rotations[first + 1].data());
+
+    for(std::int32_t i = first; i < last; i++)
+    {
+        positions[i + 1] = q.segment<3>(i * 7);
+    }
+}
+
+void BodyFrames::update(const Eigen::VectorXd& q, std::int32_t index)
+{
+    rotations[index + 1] = R(q.segment<4>(index * 7 + 3));
+    positions[index + 1] = q.segment<3>(index * 7);
+}
+
+void BodyFrames::restore(const BodyFrames& other, std::int32_t index)
+{
+    rotations[index + 1] = other.rotations[index + 1];
+    positions[index + 1] = other.positions[index + 1];
+}
@@ -0,0 +1,205 @@
+#include "compiled_system.hpp"
+#include <vector>
+#include <stdexcept>
+#include <memory>
+#include <utility>
+#include "model_image.hpp"
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+
+CompiledSystem::CompiledSystem(const MultibodySystem& mbs)
+    : body_ids(mbs.getBodyIds()), initial_q(mbs.getNumBodies() * 7), buckets(mbs)
+{
+    const int num_bodies = mbs.getNumBodies();
+    const auto& bodies = mbs.getBodies();
+
+    body_index.reserve(num_bodies);
+    for(int i = 0; i < num_bodies; i++)
+    {
+        body_index.emplace(body_ids[i], i);
+        initial_q.segment<7>(i * 7) = bodies[i].getPosition();
+    }
+
+    const auto& refs = buckets.getRefs();
+    for(const auto& ref : refs)
+    {
+        if(ref.body1 == unresolved_index || ref.body2 == unresolved_index)
+            throw std::runtime_error("Constraint references a body that was not added to the system");
+    }
+
+    // Body -> constraints adjacency, counting sort keeps the row order
+    body_constraint_offsets.assign(num_bodies + 1, 0);
+    for(const auto& ref : refs)
+    {
+        if(ref.body1 != ground_index)
+            body_constraint_offsets[ref.body1 + 1]++;
+        if(ref.body2 != ground_index && ref.body2 != ref.body1)
+            body_constraint_offsets[ref.body2 + 1]++;
+    }
+    for(int i = 0; i < num_bodies; i++)
+        body_constraint_offsets[i + 1] += body_constraint_offsets[i];
+
+    body_constraints.resize(body_constraint_offsets[num_bodies]);
+    std::vector<std::int32_t> fill(body_constraint_offsets.begin(), body_constraint_offsets.end() - 1);
+    for(const auto& ref : refs)
+    {
+        if(ref.body1 != ground_index)
+            body_constraints[fill[ref.body1]++] = ref;
+        if(ref.body2 != ground_index && ref.body2 != ref.body1)
+            body_constraints[fill[ref.body2]++] = ref;
+    }
+
+    // Canonical hash of the body-constraint graph (FNV-1a over the structure only)
+    std::uint64_t hash = 14695981039346656037ull;
+    const auto mix = [&hash](std::int64_t value)
+    {
+        for(int byte = 0; byte < 8; byte++)
+        {
+            hash ^= static_cast<std::uint64_t>(value >> (byte * 8)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    mix(num_bodies);
+    for(const auto& ref : refs)
+    {
+        mix(static_cast<std::int64_t>(ref.type));
+        mix(ref.equations);
+        mix(ref.body1);
+        mix(ref.body2);
+    }
+    for(int parameter_index : buckets.fixed_parameter.parameter_index)
+        mix(parameter_index);
+    topology_hash = hash;
+
+    // Jacobian pattern and factorization structure are shared by all systems of this topology
+    symbolic = SymbolicCache::global().get(*this);
+}
+
+CompiledSystem::CompiledSystem(const ModelImage& image, const DriverRegistry& drivers)
+    : initial_q(image.getInitialQ()), buckets(image, drivers), topology_hash(image.getTopologyHash())
+{
+    const auto ids = image.getBodyIds();
+    body_ids.assign(ids.begin(), ids.end());
+    body_index.reserve(body_ids.size());
+    for(std::size_t i = 0; i < body_ids.size(); i++)
+        body_index.emplace(body_ids[i], static_cast<std::int32_t>(i));
+
+    const auto offsets = image.getBodyConstraintOffsets();
+    const auto constraints = image.getBodyConstraints();
+    body_constraint_offsets.assign(offsets.begin(), offsets.end());
+    body_constraints.assign(constraints.begin(), constraints.end());
+
+    // the stored analysis is used only if this topology is not cached yet
+    symbolic = SymbolicCache::global().get(*this, [&image]()
+    {
+        auto normal_equations = std::make_unique<NormalEquationsSymbolic>();
+        normal_equations->rows = image.getNormalRows();
+        normal_equations->cols = image.getNormalCols();
+        normal_equations->jacobian_nonzeros = image.getJacobianNonzeros();
+
+        const auto copy = [&image](ImageSection section, std::vector<int>& out)
+        {
+            const auto values = image.array<int>(section);
+            out.assign(values.begin(), values.end());
+        };
+        copy(ImageSection::normal_perm, normal_equations->perm);
+        copy(ImageSection::normal_inverse_perm, normal_equations->inverse_perm);
+        copy(ImageSection::normal_a_outer, normal_equations->a_outer);
+        copy(ImageSection::normal_a_inner, normal_equations->a_inner);
+        copy(ImageSection::normal_a_diagonal, normal_equations->a_diagonal);
+        copy(ImageSection::normal_product_target, normal_equations->product_target);
+        copy(ImageSection::normal_product_left, normal_equations->product_left);
+        copy(ImageSection::normal_product_right, normal_equations->product_right);
+        copy(ImageSection::normal_parent, normal_equations->parent);
+        copy(ImageSection::normal_l_outer, normal_equations->l_outer);
+
+        return std::make_shared<const SymbolicAnalysis>(Eigen::SparseMatrix<double>(image.getJacobianPattern()),
+                                                        std::move(normal_equations));
+    });
+}
+
+int CompiledSystem::getNumBodies() const
+{
+    return static_cast<int>(body_ids.size());
+}
+
+int CompiledSystem::getNumCoordinates() const
+{
+    return static_cast<int>(body_ids.size()) * 7;
+}
+
+int CompiledSystem::getNumEquations() const
+{
+    return buckets.getNumEquations();
+}
+
+const std::vector<long int>& CompiledSystem::getBodyIds() const
+{
+    return body_ids;
+}
+
+std::int32_t CompiledSystem::getBodyIndex(long int id) const
+{
+    if(id == 0)
+        return ground_index;
+    auto it = body_index.find(id);
+    if (it == body_index.end())
+        throw std::runtime_error("Body ID not found");
+    return it->second;
+}
+
+const Eigen::VectorXd& CompiledSystem::getInitialQ() const
+{
+    return initial_q;
+}
+
+const ConstraintBuckets& CompiledSystem::getBuckets() const
+{
+    return buckets;
+}
+
+const std::vector<std::int32_t>& CompiledSystem::getBodyConstraintOffsets() const
+{
+    return body_constraint_offsets;
+}
+
+const std::vector<ConstraintRef>& CompiledSystem::getBodyConstraints() const
+{
+    return body_constraints;
+}
+
+const Eigen::SparseMatrix<double>& CompiledSystem::getJacobianPattern() const
+{
+    return symbolic->getJacobianPattern();
+}
+
+const SymbolicAnalysis& CompiledSystem::getSymbolic() const
+{
+    return *symbolic;
+}
+
+std::uint64_t CompiledSystem::getTopologyHash() const
+{
+    return topology_hash;
+}
+
+bool CompiledSystem::sameTopology(const CompiledSystem& other) const
+{
+    if(topology_hash != other.topology_hash)
+        return false;
+
+    return getNumBodies() == other.getNumBodies() && buckets.getRefs() == other.buckets.getRefs() &&
+           buckets.fixed_parameter.parameter_index == other.buckets.fixed_parameter.parameter_index;
+}
+
+void CompiledSystem::evaluate(const Eigen::VectorXd& q, const BodyFrames& frames, double t, Eigen::Ref<Eigen::VectorXd> phi) const
+{
+    buckets.evaluate(q, frames, t, phi);
+}
+
+void CompiledSystem::evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> phi) const
+{
+    BodyFrames frames(getNumBodies());
+    frames.update(q);
+    buckets.evaluate(q, frames, t, phi);
+}
@@ -0,0 +1,487 @@
+#include "constraint_buckets.hpp"
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+#include <variant>
+#include <type_traits>
+#include "constraints.hpp"
+#include "multibody_system.hpp"
+#include "simd_kernels.hpp"
+#include "constraint_lanes.hpp"
+#include "model_image.hpp"
+#include "model_loader.hpp"
+
+namespace
+{
+    inline void evaluate_distance(const DistanceBucket& b, std::size_t k, const Eigen::VectorXd& q, const BodyFrames& frames, double t,
+                                  Eigen::Ref<Eigen::VectorXd>& phi)
+    {
+        const Eigen::Matrix3d& R1 = frames.rotation(b.body1[k]);
+        const Eigen::Matrix3d& R2 = frames.rotation(b.body2[k]);
+        auto r1 = get_body_position(q, b.body1[k]);
+        auto r2 = get_body_position(q, b.body2[k]);
+
+        phi.segment<3>(b.row[k]) = r2 + R2 * b.body2_point[k] - (r1 + R1 * b.body1_point[k]) - b.distance[k](t);
+    }
+
+    inline void evaluate_fixed_parameter(const FixedParameterBucket& b, std::size_t k, const Eigen::VectorXd& q,
+                                         Eigen::Ref<Eigen::VectorXd>& phi)
+    {
+        const int parameter_index = b.parameter_index[k];
+        if(b.body[k] == ground_index)
+            phi(b.row[k]) = ground(parameter_index);
+        else
+            phi(b.row[k]) = q(b.body[k] * 7 + parameter_index);
+    }
+
+    inline void evaluate_fixed_orientation(const FixedOrientationBucket& b, std::size_t k, const Eigen::VectorXd& q,
+                                           Eigen::Ref<Eigen::VectorXd>& phi)
+    {
+        phi.segment<4>(b.row[k]) = get_body_rotation(q, b.body[k]) - b.orientation[k];
+    }
+
+    inline void evaluate_fixed_position(const FixedPositionBucket& b, std::size_t k, const Eigen::VectorXd& q,
+                                        Eigen::Ref<Eigen::VectorXd>& phi)
+    {
+        phi.segment<3>(b.row[k]) = get_body_position(q, b.body[k]) - b.position[k];
+    }
+
+    inline void evaluate_ball_joint(const BallJointBucket& b, std::size_t k, const Eigen::VectorXd& q, const BodyFrames& frames,
+                                    Eigen::Ref<Eigen::VectorXd>& phi)
+    {
+        const Eigen::Matrix3d& R1 = frames.rotation(b.body1[k]);
+        const Eigen::Matrix3d& R2 = frames.rotation(b.body2[k]);
+        auto r1 = get_body_position(q, b.body1[k]);
+        auto r2 = get_body_position(q, b.body2[k]);
+
+        phi.segment<3>(b.row[k]) = (r2 + R2 * b.body2_point[k]) - (r1 + R1 * b.body1_point[k]);
+    }
+
+    inline void evaluate_revolute(const RevoluteBucket& b, std::size_t k, const Eigen::VectorXd& q, const BodyFrames& frames,
+                                  Eigen::Ref<Eigen::VectorXd>& phi)
+    {
+        const Eigen::Matrix3d& R1 = frames.rotation(b.body1[k]);
+        const Eigen::Matrix3d& R2 = frames.rotation(b.body2[k]);
+        auto r1 = get_body_position(q, b.body1[k]);
+        auto r2 = get_body_position(q, b.body2[k]);
+
+        phi.segment<3>(b.row[k]) = (r2 + R2 * b.body2_point[k]) - (r1 + R1 * b.body1_point[k]);
+        phi.segment<2>(b.row[k] + 3) = (R1 * b.body1_axis[k]).cross(R2 * b.body2_axis[k]).head<2>();
+    }
+
+    inline void evaluate_quaternion(const QuaternionBucket& b, std::size_t k, const Eigen::VectorXd& q,
+                                    Eigen::Ref<Eigen::VectorXd>& phi)
+    {
+        phi(b.row[k]) = get_body_rotation(q, b.body[k]).norm() - 1.0;
+    }
+
+    // Frames of both bodies of a two-body constraint: the perturbed body uses the lanes,
+    // the other one is broadcast from the cache into scratch
+    inline void select_sides(std::int32_t body1, std::int32_t body2, std::int32_t body, const FrameLanes& lanes,
+                             const BodyFrames& frames, FrameLanes& scratch, const FrameLanes*& side1, const FrameLanes*& side2)
+    {
+        side1 = &lanes;
+        side2 = &lanes;
+        if(body1 != body)
+        {
+            scratch.broadcast(frames, body1);
+            side1 = &scratch;
+        }
+        else if(body2 != body)
+        {
+            scratch.broadcast(frames, body2);
+            side2 = &scratch;
+        }
+    }
+
+    inline LaneFrame lane_frame(const FrameLanes& f)
+    {
+        return {&f.rotation[0][0], &f.position[0][0]};
+    }
+
+    // Points r + R * p of both bodies for a chunk of two-body constraints, computed by the
+    // batched kernels; the chunk buffers live on the stack so evaluation never allocates
+    constexpr std::size_t chunk_size = 64;
+
+    struct WorldPoints
+    {
+        double body1[chunk_size * 3];
+        double body2[chunk_size * 3];
+
+        Eigen::Map<const Eigen::Vector3d> point1(std::size_t j) const
+        {
+            return Eigen::Map<const Eigen::Vector3d>(body1 + j * 3);
+        }
+
+        Eigen::Map<const Eigen::Vector3d> point2(std::size_t j) const
+        {
+            return Eigen::Map<const Eigen::Vector3d>(body2 + j * 3);
+        }
+    };
+
+    template<typename Bucket>
+    inline void transform_chunk(const Bucket& b, std::size_t begin, std::size_t count, const BodyFrames& frames,
+                                WorldPoints& world)
+    {
+        transform_points(frames.rotationData(), frames.positionData(), b.body1.data() + begin,
+                         b.body1_point[begin].data(), count, world.body1);
+        transform_points(frames.rotationData(), frames.positionData(), b.body2.data() + begin,
+                         b.body2_point[begin].data(), count, world.body2);
+    }
+
+    // Bulk copies of image sections into the bucket arrays
+    template<typename T>
+    void copy_section(const ModelImage& image, ImageSection section, std::vector<T>& out)
+    {
+        const auto values = image.array<T>(section);
+        out.assign(values.begin(), values.end());
+    }
+
+    template<int N>
+    void copy_vectors(const ModelImage& image, ImageSection section, std::vector<Eigen::Matrix<double, N, 1>>& out)
+    {
+        const auto values = image.array<double>(section);
+        out.resize(values.size / N);
+        for(std::size_t k = 0; k < out.size(); k++)
+            out[k] = Eigen::Map<const Eigen::Matrix<double, N, 1>>(values.data + k * N);
+    }
+
+    inline void evaluate_generic(const GenericBucket& b, std::size_t k, const Eigen::VectorXd& q, double t,
+                                 Eigen::Ref<Eigen::VectorXd>& phi)
+    {
+        const auto& constraint = b.constraints[k];
+        constraint->evaluate(q, t, phi.segment(b.row[k], constraint->equations_number()));
+    }
+}
+
+ConstraintBuckets::ConstraintBuckets(const MultibodySystem& mbs)
+{
+    int row = 0;
+    refs.reserve(mbs.getConstraints().size());
+    for(const auto& constraint : mbs.getConstraints())
+    {
+        const Constraint& base = as_constraint(constraint);
+        ConstraintRef ref{ConstraintType::generic, 0, row, equations_number(constraint),
+                          base.getBody1Index(), base.getBody2Index()};
+
+        // the variant's type selects the bucket at compile time
+        std::visit([&](const auto& c)
+        {
+            using Type = std::decay_t<decltype(c)>;
+            if constexpr(std::is_same_v<Type, DistanceConstraint>)
+            {
+                ref.type = ConstraintType::distance;
+                ref.index = static_cast<std::int32_t>(distance.row.size());
+                distance.body1.push_back(c.body1_index);
+                distance.body2.push_back(c.body2_index);
+                distance.row.push_back(row);
+                distance.body1_point.push_back(c.body1_point);
+                distance.body2_point.push_back(c.body2_point);
+                distance.distance.push_back(c.distance);
+            }
+            else if constexpr(std::is_same_v<Type, FixedParameterConstraint>)
+            {
+                ref.type = ConstraintType::fixed_parameter;
+                ref.index = static_cast<std::int32_t>(fixed_parameter.row.size());
+                fixed_parameter.body.push_back(c.body1_index);
+                fixed_parameter.row.push_back(row);
+                fixed_parameter.parameter_index.push_back(c.parameter_index);
+            }
+            else if constexpr(std::is_same_v<Type, FixedOrientationConstraint>)
+            {
+                ref.type = ConstraintType::fixed_orientation;
+                ref.index = static_cast<std::int32_t>(fixed_orientation.row.size());
+                fixed_orientation.body.push_back(c.body1_index);
+                fixed_orientation.row.push_back(row);
+                fixed_orientation.orientation.push_back(c.orientation);
+            }
+            else if constexpr(std::is_same_v<Type, FixedPositionConstraint>)
+            {
+                ref.type = ConstraintType::fixed_position;
+                ref.index = static_cast<std::int32_t>(fixed_position.row.size());
+                fixed_position.body.push_back(c.body1_index);
+                fixed_position.row.push_back(row);
+                fixed_position.position.push_back(c.position);
+            }
+            else if constexpr(std::is_same_v<Type, BallJointConstraint>)
+            {
+                ref.type = ConstraintType::ball_joint;
+                ref.index = static_cast<std::int32_t>(ball_joint.row.size());
+                ball_joint.body1.push_back(c.body1_index);
+                ball_joint.body2.push_back(c.body2_index);
+                ball_joint.row.push_back(row);
+                ball_joint.body1_point.push_back(c.body1_point);
+                ball_joint.body2_point.push_back(c.body2_point);
+            }
+            else if constexpr(std::is_same_v<Type, RevoluteConstraint>)
+            {
+                ref.type = ConstraintType::revolute;
+                ref.index = static_cast<std::int32_t>(revolute.row.size());
+                revolute.body1.push_back(c.body1_index);
+                revolute.body2.push_back(c.body2_index);
+                revolute.row.push_back(row);
+                revolute.body1_point.push_back(c.body1_point);
+                revolute.body2_point.push_back(c.body2_point);
+                revolute.body1_axis.push_back(c.body1_axis);
+                revolute.body2_axis.push_back(c.body2_axis);
+            }
+            else if constexpr(std::is_same_v<Type, QuaternionConstraint>)
+            {
+                ref.type = ConstraintType::quaternion;
+                ref.index = static_cast<std::int32_t>(quaternion.row.size());
+                quaternion.body.push_back(c.body1_index);
+                quaternion.row.push_back(row);
+            }
+            else
+            {
+                // user constraints stay behind the virtual interface
+                ref.index = static_cast<std::int32_t>(generic.row.size());
+                generic.body1.push_back(c->getBody1Index());
+                generic.body2.push_back(c->getBody2Index());
+                generic.row.push_back(row);
+                generic.constraints.push_back(c);
+            }
+        }, constraint);
+
+        refs.push_back(ref);
+        row += ref.equations;
+    }
+    num_equations = row;
+
+    buildChunks();
+}
+
+ConstraintBuckets::ConstraintBuckets(const ModelImage& image, const DriverRegistry& drivers)
+    : num_equations(image.getNumEquations())
+{
+    copy_section(image, ImageSection::refs, refs);
+
+    copy_section(image, ImageSection::distance_body1, distance.body1);
+    copy_section(image, ImageSection::distance_body2, distance.body2);
+    copy_section(image, ImageSection::distance_row, distance.row);
+    copy_vectors(image, ImageSection::distance_body1_point, distance.body1_point);
+    copy_vectors(image, ImageSection::distance_body2_point, distance.body2_point);
+
+    // drivers are stored by name; each distinct name is looked up once
+    const auto driver_index = image.array<std::uint32_t>(ImageSection::distance_driver);
+    std::vector<Eigen::Vector3d (*)(double)> driver_functions(image.getNumDrivers());
+    for(std::size_t i = 0; i < driver_functions.size(); i++)
+    {
+        driver_functions[i] = drivers.find(image.getDriverName(static_cast<std::uint32_t>(i)));
+        if(!driver_functions[i])
+            throw std::runtime_error(std::string("Model image needs driver function '") + image.getDriverName(static_cast<std::uint32_t>(i)) + "'");
+    }
+    distance.distance.reserve(driver_index.size);
+    for(std::uint32_t index : driver_index)
+        distance.distance.push_back(driver_functions[index]);
+
+    copy_section(image, ImageSection::fixed_parameter_body, fixed_parameter.body);
+    copy_section(image, ImageSection::fixed_parameter_row, fixed_parameter.row);
+    copy_section(image, ImageSection::fixed_parameter_index, fixed_parameter.parameter_index);
+
+    copy_section(image, ImageSection::fixed_orientation_body, fixed_orientation.body);
+    copy_section(image, ImageSection::fixed_orientation_row, fixed_orientation.row);
+    copy_vectors(image, ImageSection::fixed_orientation_orientation, fixed_orientation.orientation);
+
+    copy_section(image, ImageSection::fixed_position_body, fixed_position.body);
+    copy_section(image, ImageSection::fixed_position_row, fixed_position.row);
+    copy_vectors(image, ImageSection::fixed_position_position, fixed_position.position);
+
+    copy_section(image, ImageSection::ball_joint_body1, ball_joint.body1);
+    copy_section(image, ImageSection::ball_joint_body2, ball_joint.body2);
+    copy_section(image, ImageSection::ball_joint_row, ball_joint.row);
+    copy_vectors(image, ImageSection::ball_joint_body1_point, ball_joint.body1_point);
+    copy_vectors(image, ImageSection::ball_joint_body2_point, ball_joint.body2_point);
+
+    copy_section(image, ImageSection::revolute_body1, revolute.body1);
+    copy_section(image, ImageSection::revolute_body2, revolute.body2);
+    copy_section(image, ImageSection::revolute_row, revolute.row);
+    copy_vectors(image, ImageSection::revolute_body1_point, revolute.body1_point);
+    copy_vectors(image, ImageSection::revolute_body2_point, revolute.body2_point);
+    copy_vectors(image, ImageSection::revolute_body1_axis, revolute.body1_axis);
+    copy_vectors(image, ImageSection::revolute_body2_axis, revolute.body2_axis);
+
+    copy_section(image, ImageSection::quaternion_body, quaternion.body);
+    copy_section(image, ImageSection::quaternion_row, quaternion.row);
+
+    buildChunks();
+}
+
+void ConstraintBuckets::buildChunks()
+{
+    // Fixed-size pieces of every bucket; rows are known, so the pieces can be evaluated in any order
+    const auto split = [this](ConstraintType type, std::size_t size)
+    {
+        for(std::size_t begin = 0; begin < size; begin += chunk_size)
+            chunks.push_back({type, begin, std::min(size, begin + chunk_size)});
+    };
+    split(ConstraintType::distance, distance.row.size());
+    split(ConstraintType::fixed_parameter, fixed_parameter.row.size());
+    split(ConstraintType::fixed_orientation, fixed_orientation.row.size());
+    split(ConstraintType::fixed_position, fixed_position.row.size());
+    split(ConstraintType::ball_joint, ball_joint.row.size());
+    split(ConstraintType::revolute, revolute.row.size());
+    split(ConstraintType::quaternion, quaternion.row.size());
+    split(ConstraintType::generic, generic.row.size());
+}
+
+void ConstraintBuckets::evaluate(const Eigen::VectorXd& q, const BodyFrames& frames, double t, Eigen::Ref<Eigen::VectorXd> phi) const
+{
+    for(const auto& chunk : chunks)
+        evaluate(chunk, q, frames, t, phi);
+}
+
+void ConstraintBuckets::evaluate(const BucketChunk& chunk, const Eigen::VectorXd& q, const BodyFrames& frames, double t,
+                                 Eigen::Ref<Eigen::VectorXd> phi) const
+{
+    WorldPoints world;
+    const std::size_t begin = chunk.begin;
+    const std::size_t count = chunk.end - chunk.begin;
+
+    switch(chunk.type)
+    {
+        case ConstraintType::distance:
+            transform_chunk(distance, begin, count, frames, world);
+            for(std::size_t j = 0; j < count; j++)
+            {
+                const std::size_t k = begin + j;
+                phi.segment<3>(distance.row[k]) = world.point2(j) - world.point1(j) - distance.distance[k](t);
+            }
+            break;
+
+        case ConstraintType::fixed_parameter:
+            for(std::size_t k = begin; k < chunk.end; k++)
+                evaluate_fixed_parameter(fixed_parameter, k, q, phi);
+            break;
+
+        case ConstraintType::fixed_orientation:
+            for(std::size_t k = begin; k < chunk.end; k++)
+                evaluate_fixed_orientation(fixed_orientation, k, q, phi);
+            break;
+
+        case ConstraintType::fixed_position:
+            for(std::size_t k = begin; k < chunk.end; k++)
+                evaluate_fixed_position(fixed_position, k, q, phi);
+            break;
+
+        case ConstraintType::ball_joint:
+            transform_chunk(ball_joint, begin, count, frames, world);
+            for(std::size_t j = 0; j < count; j++)
+            {
+                phi.segment<3>(ball_joint.row[begin + j]) = world.point2(j) - world.point1(j);
+            }
+            break;
+
+        case ConstraintType::revolute:
+            transform_chunk(revolute, begin, count, frames, world);
+            for(std::size_t j = 0; j < count; j++)
+            {
+                const std::size_t k = begin + j;
+                const Eigen::Matrix3d& R1 = frames.rotation(revolute.body1[k]);
+                const Eigen::Matrix3d& R2 = frames.rotation(revolute.body2[k]);
+
+                phi.segment<3>(revolute.row[k]) = world.point2(j) - world.point1(j);
+                phi.segment<2>(revolute.row[k] + 3) = (R1 * revolute.body1_axis[k]).cross(R2 * revolute.body2_axis[k]).head<2>();
+            }
+            break;
+
+        case ConstraintType::quaternion:
+            for(std::size_t k = begin; k < chunk.end; k++)
+                evaluate_quaternion(quaternion, k, q, phi);
+            break;
+
+        case ConstraintType::generic:
+            for(std::size_t k = begin; k < chunk.end; k++)
+                evaluate_generic(generic, k, q, t, phi);
+            break;
+    }
+}
+
+void ConstraintBuckets::evaluate(const ConstraintRef& ref, const Eigen::VectorXd& q, const BodyFrames& frames, double t, Eigen::Ref<Eigen::VectorXd> phi) const
+{
+    switch(ref.type)
+    {
+        case ConstraintType::distance:          evaluate_distance(distance, ref.index, q, frames, t, phi); break;
+        case ConstraintType::fixed_parameter:   evaluate_fixed_parameter(fixed_parameter, ref.index, q, phi); break;
+        case ConstraintType::fixed_orientation: evaluate_fixed_orientation(fixed_orientation, ref.index, q, phi); break;
+        case ConstraintType::fixed_position:    evaluate_fixed_position(fixed_position, ref.index, q, phi); break;
+        case ConstraintType::ball_joint:        evaluate_ball_joint(ball_joint, ref.index, q, frames, phi); break;
+        case ConstraintType::revolute:          evaluate_revolute(revolute, ref.index, q, frames, phi); break;
+        case ConstraintType::quaternion:        evaluate_quaternion(quaternion, ref.index, q, phi); break;
+        case ConstraintType::generic:           evaluate_generic(generic, ref.index, q, t, phi); break;
+    }
+}
+
+bool ConstraintBuckets::evaluateLanes(const ConstraintRef& ref, std::int32_t body, const FrameLanes& lanes,
+                                      const BodyFrames& frames, double t, ResidualLanes& out) const
+{
+    // each lane is one perturbed state of the same body; the parameters are shared by all lanes
+    using Lanes = InterleavedLanes<lane_count>;
+    FrameLanes scratch;
+    const FrameLanes* side1;
+    const FrameLanes* side2;
+    const std::int32_t k = ref.index;
+    double* values = &out.values[0][0];
+
+    switch(ref.type)
+    {
+        case ConstraintType::distance:
+        {
+            select_sides(ref.body1, ref.body2, body, lanes, frames, scratch, side1, side2);
+            const Eigen::Vector3d d = distance.distance[k](t);
+            distance_lanes<lane_count>(lane_frame(*side1), SharedLanes{distance.body1_point[k].data()},
+                                       lane_frame(*side2), SharedLanes{distance.body2_point[k].data()},
+                                       SharedLanes{d.data()}, values);
+            return true;
+        }
+        case ConstraintType::fixed_parameter:
+        {
+            const int parameter_index = fixed_parameter.parameter_index[k];
+            const double* value = parameter_index < 3 ? lanes.position[parameter_index] : lanes.quaternion[parameter_index - 3];
+            parameter_lanes<lane_count>(Lanes{value}, values);
+            return true;
+        }
+        case ConstraintType::fixed_orientation:
+            difference_lanes<lane_count>(4, Lanes{&lanes.quaternion[0][0]}, SharedLanes{fixed_orientation.orientation[k].data()}, values);
+            return true;
+        case ConstraintType::fixed_position:
+            difference_lanes<lane_count>(3, Lanes{&lanes.position[0][0]}, SharedLanes{fixed_position.position[k].data()}, values);
+            return true;
+        case ConstraintType::ball_joint:
+            select_sides(ref.body1, ref.body2, body, lanes, frames, scratch, side1, side2);
+            point_difference_lanes<lane_count>(lane_frame(*side1), SharedLanes{ball_joint.body1_point[k].data()},
+                                               lane_frame(*side2), SharedLanes{ball_joint.body2_point[k].data()}, values);
+            return true;
+        case ConstraintType::revolute:
+            select_sides(ref.body1, ref.body2, body, lanes, frames, scratch, side1, side2);
+            revolute_lanes<lane_count>(lane_frame(*side1), SharedLanes{revolute.body1_point[k].data()}, SharedLanes{revolute.body1_axis[k].data()},
+                                       lane_frame(*side2), SharedLanes{revolute.body2_point[k].data()}, SharedLanes{revolute.body2_axis[k].data()},
+                                       values);
+            return true;
+        case ConstraintType::quaternion:
+            quaternion_norm_lanes<lane_count>(Lanes{&lanes.quaternion[0][0]}, values);
+            return true;
+        case ConstraintType::generic:
+            break;
+    }
+    return false;
+}
+
+const std::vector<BucketChunk>& ConstraintBuckets::getChunks() const
+{
+    return chunks;
+}
+
+int ConstraintBuckets::getNumEquations() const
+{
+    return num_equations;
+}
+
+const std::vector<ConstraintRef>& ConstraintBuckets::getRefs() const
+{
+    return refs;
+}
@@ -6,49 +6,137 @@
 #include "quaternion_operations.hpp"
 #include <memory>
 #include <iostream>
+#include <stdexcept>
+#include <typeinfo>
+#include <utility>
+#include <unordered_map>
 
 const Eigen::Matrix<double, 7, 1> ground {0, 0, 0, 1, 0, 0, 0};
 
-Eigen::Map<const Eigen::VectorXd> get_body_position(const Eigen::VectorXd& q, long int id, const std::vector<long int>& body_ids)
+Eigen::Map<const Eigen::Vector3d> get_body_position(const Eigen::VectorXd& q, long int id, const std::vector<long int>& body_ids)
 {
     if(id == 0)
     {
-        return Eigen::Map<const Eigen::VectorXd>(ground.data(), 3);
+        return Eigen::Map<const Eigen::Vector3d>(ground.data());
     }
     else
     {
         auto it = std::find(body_ids.begin(), body_ids.end(), id);
         int i = std::distance(body_ids.begin(), it);
-        return Eigen::Map<const Eigen::VectorXd>(q.data() + i * 7, 3);
+        return Eigen::Map<const Eigen::Vector3d>(q.data() + i * 7);
     }
 }
 
-Eigen::Map<const Eigen::VectorXd> get_body_rotation(const Eigen::VectorXd& q, long int id, const std::vector<long int>& body_ids)
+Eigen::Map<const Eigen::Vector4d> get_body_rotation(const Eigen::VectorXd& q, long int id, const std::vector<long int>& body_ids)
 {
     if(id == 0)
     {
-        return Eigen::Map<const Eigen::VectorXd>(ground.data() + 3, 4);
+        return Eigen::Map<const Eigen::Vector4d>(ground.data() + 3);
     }
     else
     {
         auto it = std::find(body_ids.begin(), body_ids.end(), id);
         int i = std::distance(body_ids.begin(), it);
-        return Eigen::Map<const Eigen::VectorXd>(q.data() + i * 7 + 3, 4);
+        return Eigen::Map<const Eigen::Vector4d>(q.data() + i * 7 + 3);
     }
 }
 
+Eigen::Map<const Eigen::Vector3d> get_body_position(const Eigen::VectorXd& q, std::int32_t index)
+{
+    if(index == ground_index)
+    {
+        return Eigen::Map<const Eigen::Vector3d>(ground.data());
+    }
+    return Eigen::Map<const Eigen::Vector3d>(q.data() + index * 7);
+}
+
+Eigen::Map<const Eigen::Vector4d> get_body_rotation(const Eigen::VectorXd& q, std::int32_t index)
+{
+    if(index == ground_index)
+    {
+        return Eigen::Map<const Eigen::Vector4d>(ground.data() + 3);
+    }
+    return Eigen::Map<const Eigen::Vector4d>(q.data() + index * 7 + 3);
+}
+
 // Constraint base class
 Constraint::Constraint(long int id, long int body1_id, long int body2_id)
     : id(id), body1_id(body1_id), body2_id(body2_id) {}
 
-Eigen::VectorXd Constraint::ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids)
+bool Constraint::resolveBodies(const std::unordered_map<long int, std::int32_t>& body_index)
 {
-    return Eigen::VectorXd();
+    auto resolve = [&](long int body_id) -> std::int32_t
+    {
+        if(body_id == 0)
+            return ground_index;
+        auto it = body_index.find(body_id);
+        return it == body_index.end() ? unresolved_index : it->second;
+    };
+
+    body1_index = resolve(body1_id);
+    body2_index = resolve(body2_id);
+    return body1_index != unresolved_index && body2_index != unresolved_index;
 }
 
-double Constraint::equations_number()
+// Legacy adapter
+LegacyConstraint::LegacyConstraint(long int id, long int body1_id, long int body2_id)
+    : Constraint(id, body1_id, body2_id)
 {
-    return 0;
+    for(long int body_id : {body1_id, body2_id})
+    {
+        if(body_id != 0 && std::find(body_ids.begin(), body_ids.end(), body_id) == body_ids.end())
+            body_ids.push_back(body_id);
+    }
+}
+
+void LegacyConstraint::evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const
+{
+    // gather the bodies of this constraint so the old id lookup only scans them
+    Eigen::VectorXd local(static_cast<Eigen::Index>(body_ids.size() * 7));
+    for(std::size_t k = 0; k < body_ids.size(); k++)
+    {
+        const std::int32_t index = body_ids[k] == body1_id ? body1_index : body2_index;
+        local.segment<7>(static_cast<Eigen::Index>(k * 7)) = q.segment<7>(static_cast<Eigen::Index>(index) * 7);
+    }
+
+    functions = legacy().ConstrainingFunctions(local, t, body_ids);
+}
+
+int LegacyConstraint::equations_number() const
+{
+    return static_cast<int>(legacy().equations_number());
+}
+
+LegacyConstraint& LegacyConstraint::legacy() const
+{
+    // The old methods are non-const but do not modify the constraint; user constraints are held
+    // through std::shared_ptr<Constraint>, so the object itself is never const
+    return const_cast<LegacyConstraint&>(*this);
+}
+
+long int Constraint::getId() const
+{
+    return id;
+}
+
+long int Constraint::getBody1Id() const
+{
+    return body1_id;
+}
+
+long int Constraint::getBody2Id() const
+{
+    return body2_id;
+}
+
+std::int32_t Constraint::getBody1Index() const
+{
+    return body1_index;
+}
+
+std::int32_t Constraint::getBody2Index() const
+{
+    return body2_index;
 }
 
 // DistanceConstraint
@@ -61,25 +149,21 @@ std::shared_ptr<Constraint> DistanceConstraint::clone() const {
     return std::make_shared<DistanceConstraint>(*this);
 }
 
-Eigen::VectorXd DistanceConstraint::ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids)
+void DistanceConstraint::evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const
 {
-    auto e1 = get_body_rotation(q, body1_id, body_ids);
-    auto e2 = get_body_rotation(q, body2_id, body_ids);
-    auto r1 = get_body_position(q, body1_id, body_ids);
-    auto r2 = get_body_position(q, body2_id, body_ids);
+    auto e1 = get_body_rotation(q, body1_index);
+    auto e2 = get_body_rotation(q, body2_index);
+    auto r1 = get_body_position(q, body1_index);
+    auto r2 = get_body_position(q, body2_index);
 
-    Eigen::Vector3d functions;
-
-    Eigen::Vector3d dist;
-    dist = distance(t);
+    Eigen::Vector3d dist = distance(t);
 
     functions = r2 + R(e2) * body2_point - (r1 + R(e1) * body1_point) - dist;
-    return functions;
 }
 
-double DistanceConstraint::equations_number()
+int DistanceConstraint::equations_number() const
 {
-    return 3;
+    return equations;
 }
 
 // FixedParameterConstraint
@@ -90,23 +174,21 @@ std::shared_ptr<Constraint> FixedParameterConstraint::clone() const {
     return std::make_shared<FixedParameterConstraint>(*this);
 }
 
-Eigen::VectorXd FixedParameterConstraint::ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids)
+void FixedParameterConstraint::evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const
 {
-    Eigen::VectorXd functions(1);
-    auto e = get_body_rotation(q, body1_id, body_ids);
-    auto r = get_body_position(q, body1_id, body_ids);
+    auto e = get_body_rotation(q, body1_index);
+    auto r = get_body_position(q, body1_index);
 
     if (parameter_index < 3) {
         functions(0) = r(parameter_index);
     } else {
         functions(0) = e(parameter_index - 3);
     }
-    return functions;
 }
 
-double FixedParameterConstraint::equations_number()
+int FixedParameterConstraint::equations_number() const
 {
-    return 1;
+    return equations;
 }
 
 // FixedOrientationConstraint
@@ -117,17 +199,15 @@ std::shared_ptr<Constraint> FixedOrientationConstraint::clone() const {
     return std::make_shared<FixedOrientationConstraint>(*this);
 }
 
-Eigen::VectorXd FixedOrientationConstraint::ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids)
+void FixedOrientationConstraint::evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const
 {
-    Eigen::VectorXd functions(4);
-    auto e = get_body_rotation(q, body1_id, body_ids);
+    auto e = get_body_rotation(q, body1_index);
     functions = e - orientation;
-    return functions;
 }
 
-double FixedOrientationConstraint::equations_number()
+int FixedOrientationConstraint::equations_number() const
 {
-    return 4;
+    return equations;
 }
 
 // FixedPositionConstraint
@@ -138,17 +218,15 @@ std::shared_ptr<Constraint> FixedPositionConstraint::clone() const {
     return std::make_shared<FixedPositionConstraint>(*this);
 }
 
-Eigen::VectorXd FixedPositionConstraint::ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids)
+void FixedPositionConstraint::evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const
 {
-    Eigen::VectorXd functions(3);
-    auto r = get_body_position(q, body1_id, body_ids);
+    auto r = get_body_position(q, body1_index);
     functions = r - position;
-    return functions;
 }
 
-double FixedPositionConstraint::equations_number()
+int FixedPositionConstraint::equations_number() const
 {
-    return 3;
+    return equations;
 }
 
 // BallJointConstraint
@@ -160,21 +238,19 @@ std::shared_ptr<Constraint> BallJointConstraint::clone() const {
     return std::make_shared<BallJointConstraint>(*this);
 }
 
-Eigen::VectorXd BallJointConstraint::ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids)
+void BallJointConstraint::evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const
 {
-    auto e1 = get_body_rotation(q, body1_id, body_ids);
-    auto e2 = get_body_rotation(q, body2_id, body_ids);
-    auto r1 = get_body_position(q, body1_id, body_ids);
-    auto r2 = get_body_position(q, body2_id, body_ids);
+    auto e1 = get_body_rotation(q, body1_index);
+    auto e2 = get_body_rotation(q, body2_index);
+    auto r1 = get_body_position(q, body1_index);
+    auto r2 = get_body_position(q, body2_index);
 
-    Eigen::VectorXd functions(3);
     functions = (r2 + R(e2) * body2_point) - (r1 + R(e1) * body1_point);
-    return functions;
 }
 
-double BallJointConstraint::equations_number()
+int BallJointConstraint::equations_number() const
 {
-    return 3;
+    return equations;
 }
 
 // RevoluteConstraint
@@ -187,24 +263,25 @@ std::shared_ptr<Constraint> RevoluteConstraint::clone() const {
     return std::make_shared<RevoluteConstraint>(*this);
 }
 
-Eigen::VectorXd RevoluteConstraint::ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids)
+void RevoluteConstraint::evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const
 {
-    auto e1 = get_body_rotation(q, body1_id, body_ids);
-    auto e2 = get_body_rotation(q, body2_id, body_ids);
-    auto r1 = get_body_position(q, body1_id, body_ids);
-    auto r2 = get_body_position(q, body2_id, body_ids);
-
-    Eigen::VectorXd functions(5);
-    Eigen::Vector3d point_functions = (r2 + R(e2) * body2_point) - (r1 + R(e1) * body1_point);
-    Eigen::Vector3d axis_functions = (R(e1) * body1_axis).cross(R(e2) * body2_axis);
-    functions.head(3) = point_functions;
-    functions.tail(2) = axis_functions.head(2);
-    return functions;
+    auto e1 = get_body_rotation(q, body1_index);
+    auto e2 = get_body_rotation(q, body2_index);
+    auto r1 = get_body_position(q, body1_index);
+    auto r2 = get_body_position(q, body2_index);
+
+    const Eigen::Matrix3d R1 = R(e1);
+    const Eigen::Matrix3d R2 = R(e2);
+
+    Eigen::Vector3d point_functions = (r2 + R2 * body2_point) - (r1 + R1 * body1_point);
+    Eigen::Vector3d axis_functions = (R1 * body1_axis).cross(R2 * body2_axis);
+    functions.head<3>() = point_functions;
+    functions.tail<2>() = axis_functions.head<2>();
 }
 
-double RevoluteConstraint::equations_number()
+int RevoluteConstraint::equations_number() const
 {
-    return 5;
+    return equations;
 }
 
 // QuaternionConstraint
@@ -215,17 +292,36 @@ std::shared_ptr<Constraint> QuaternionConstraint::clone() const {
     return std::make_shared<QuaternionConstraint>(*this);
 }
 
-Eigen::VectorXd QuaternionConstraint::ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids)
+void QuaternionConstraint::evaluate(const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> functions) const
 {
-    auto e1 = get_body_rotation(q, body1_id, body_ids);
+    auto e1 = get_body_rotation(q, body1_index);
 
-    Eigen::VectorXd functions(1);
     functions(0) = e1.norm() - 1.0;
-    return functions;
 }
 
-double QuaternionConstraint::equations_number()
+int QuaternionConstraint::equations_number() const
 {
-    return 1;
+    return equations;
 }
 
+
+ConstraintVariant make_constraint_variant(const Constraint& constraint)
+{
+    // exact types only: a user class derived from a built-in one keeps its own overrides
+    const std::type_info& type = typeid(constraint);
+    if(type == typeid(DistanceConstraint))
+        return static_cast<const DistanceConstraint&>(constraint);
+    if(type == typeid(FixedParameterConstraint))
+        return static_cast<const FixedParameterConstraint&>(constraint);
+    if(type == typeid(FixedOrientationConstraint))
+        return static_cast<const FixedOrientationConstraint&>(constraint);
+    if(type == typeid(FixedPositionConstraint))
+        return static_cast<const FixedPositionConstraint&>(constraint);
+    if(type == typeid(BallJointConstraint))
+        return static_cast<const BallJointConstraint&>(constraint);
+    if(type == typeid(RevoluteConstraint))
+        return static_cast<const RevoluteConstraint&>(constraint);
+    if(type == typeid(QuaternionConstraint))
+        return static_cast<const QuaternionConstraint&>(constraint);
+    return constraint.clone();
+}
@@ -0,0 +1,418 @@
+#include "ensemble_solver.hpp"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "multibody_solver.hpp"
+#include "parallel_backend.hpp"
+#include "quaternion_operations.hpp"
+#include "constraint_lanes.hpp"
+#include "newton_control.hpp"
+
+namespace
+{
+    constexpr int W = ensemble_width;
+
+    // Copies one parameter of every constraint of every system into [(k * size + i) * W + s];
+    // lanes past the last system repeat the first one so that they stay well defined
+    template<typename Vector, typename Get>
+    std::vector<double> interleave(const std::vector<const CompiledSystem*>& systems, std::size_t count, Get get)
+    {
+        constexpr int size = Vector::RowsAtCompileTime;
+        std::vector<double> values(count * size * W);
+        for(std::size_t k = 0; k < count; k++)
+        {
+            for(int s = 0; s < W; s++)
+            {
+                const auto& system = *systems[s < static_cast<int>(systems.size()) ? s : 0];
+                const Vector& value = get(system.getBuckets(), k);
+                for(int i = 0; i < size; i++)
+                    values[(k * size + i) * W + s] = value(i);
+            }
+        }
+        return values;
+    }
+}
+
+EnsembleBatch::EnsembleBatch(const std::vector<const CompiledSystem*>& systems, const NormalEquationsSymbolic& symbolic,
+                             double regularization)
+    : num_systems(static_cast<int>(systems.size())),
+      num_coordinates(systems.empty() ? 0 : systems.front()->getNumCoordinates()),
+      num_equations(systems.empty() ? 0 : systems.front()->getNumEquations()),
+      topology(*systems.at(0)), symbolic(symbolic), linear(symbolic, regularization)
+{
+    if(num_systems > W)
+        throw std::runtime_error("Too many systems in one ensemble batch");
+    for(const auto* system : systems)
+    {
+        if(!system->sameTopology(topology))
+            throw std::runtime_error("Systems of an ensemble batch must have identical topology");
+    }
+
+    const auto& buckets = topology.getBuckets();
+    if(!buckets.generic.row.empty())
+        throw std::runtime_error("Ensemble batch supports built-in constraint types only");
+    if(symbolic.cols != num_coordinates || symbolic.rows != num_equations ||
+       symbolic.jacobian_nonzeros != static_cast<std::size_t>(topology.getJacobianPattern().nonZeros()))
+        throw std::runtime_error("Symbolic analysis does not match the ensemble topology");
+
+    distance_points1 = interleave<Eigen::Vector3d>(systems, buckets.distance.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector3d& { return b.distance.body1_point[k]; });
+    distance_points2 = interleave<Eigen::Vector3d>(systems, buckets.distance.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector3d& { return b.distance.body2_point[k]; });
+    fixed_orientations = interleave<Eigen::Vector4d>(systems, buckets.fixed_orientation.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector4d& { return b.fixed_orientation.orientation[k]; });
+    fixed_positions = interleave<Eigen::Vector3d>(systems, buckets.fixed_position.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector3d& { return b.fixed_position.position[k]; });
+    ball_joint_points1 = interleave<Eigen::Vector3d>(systems, buckets.ball_joint.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector3d& { return b.ball_joint.body1_point[k]; });
+    ball_joint_points2 = interleave<Eigen::Vector3d>(systems, buckets.ball_joint.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector3d& { return b.ball_joint.body2_point[k]; });
+    revolute_points1 = interleave<Eigen::Vector3d>(systems, buckets.revolute.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector3d& { return b.revolute.body1_point[k]; });
+    revolute_points2 = interleave<Eigen::Vector3d>(systems, buckets.revolute.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector3d& { return b.revolute.body2_point[k]; });
+    revolute_axes1 = interleave<Eigen::Vector3d>(systems, buckets.revolute.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector3d& { return b.revolute.body1_axis[k]; });
+    revolute_axes2 = interleave<Eigen::Vector3d>(systems, buckets.revolute.row.size(),
+        [](const ConstraintBuckets& b, std::size_t k) -> const Eigen::Vector3d& { return b.revolute.body2_axis[k]; });
+
+    distance_functions.resize(buckets.distance.row.size() * W);
+    for(std::size_t k = 0; k < buckets.distance.row.size(); k++)
+    {
+        for(int s = 0; s < W; s++)
+            distance_functions[k * W + s] = systems[s < num_systems ? s : 0]->getBuckets().distance.distance[k];
+    }
+
+    q.resize(static_cast<std::size_t>(num_coordinates) * W);
+    for(int s = 0; s < W; s++)
+        setQ(s, systems[s < num_systems ? s : 0]->getInitialQ());
+
+    const int num_bodies = topology.getNumBodies();
+    rotations.assign(static_cast<std::size_t>(num_bodies + 1) * 9 * W, 0.0);
+    positions.assign(static_cast<std::size_t>(num_bodies + 1) * 3 * W, 0.0);
+    for(int i = 0; i < 3; i++)
+        for(int s = 0; s < W; s++)
+            rotations[(i * 4) * W + s] = 1.0;
+
+    phi.resize(static_cast<std::size_t>(num_equations) * W);
+    b.resize(static_cast<std::size_t>(num_equations) * W);
+    delta_q.resize(static_cast<std::size_t>(num_coordinates) * W);
+    jacobian_values.resize(symbolic.jacobian_nonzeros * W);
+
+    iterations.assign(W, 0);
+}
+
+int EnsembleBatch::getNumSystems() const
+{
+    return num_systems;
+}
+
+void EnsembleBatch::setQ(int system, const Eigen::VectorXd& state)
+{
+    for(int c = 0; c < num_coordinates; c++)
+        q[c * W + system] = state(c);
+}
+
+void EnsembleBatch::getQ(int system, Eigen::VectorXd& state) const
+{
+    state.resize(num_coordinates);
+    for(int c = 0; c < num_coordinates; c++)
+        state(c) = q[c * W + system];
+}
+
+int EnsembleBatch::getIterations(int system) const
+{
+    return iterations[system];
+}
+
+void EnsembleBatch::updateFrame(std::int32_t body)
+{
+    const double* e = q.data() + (body * 7) * W;
+    double* m = rotations.data() + (body + 1) * 9 * W;
+    double* r = positions.data() + (body + 1) * 3 * W;
+
+    for(int s = 0; s < W; s++)
+    {
+        rotation_matrix(e[3 * W + s], e[4 * W + s], e[5 * W + s], e[6 * W + s], m + s, W);
+
+        for(int i = 0; i < 3; i++)
+            r[i * W + s] = e[i * W + s];
+    }
+}
+
+void EnsembleBatch::updateFrames()
+{
+    for(std::int32_t body = 0; body < topology.getNumBodies(); body++)
+        updateFrame(body);
+}
+
+void EnsembleBatch::evaluateConstraint(const ConstraintRef& ref, double t, double* out) const
+{
+    // one lane per system, every parameter interleaved like the state
+    using Lanes = InterleavedLanes<W>;
+    const auto& buckets = topology.getBuckets();
+    const std::size_t k = static_cast<std::size_t>(ref.index);
+
+    const auto frame = [&](std::int32_t body) -> LaneFrame
+    {
+        return {rotations.data() + (body + 1) * 9 * W, positions.data() + (body + 1) * 3 * W};
+    };
+    // coordinates c, c + 1, ... of a body; ground is the same in every system
+    const auto coordinates = [&](std::int32_t body, int c, auto kernel)
+    {
+        if(body == ground_index)
+            kernel(SharedLanes{ground.data() + c});
+        else
+            kernel(Lanes{q.data() + (body * 7 + c) * W});
+    };
+
+    switch(ref.type)
+    {
+        case ConstraintType::distance:
+        {
+            double dist[3 * W];
+            for(int s = 0; s < W; s++)
+            {
+                const Eigen::Vector3d value = distance_functions[k * W + s](t);
+                for(int i = 0; i < 3; i++)
+                    dist[i * W + s] = value(i);
+            }
+            distance_lanes<W>(frame(ref.body1), Lanes{distance_points1.data() + k * 3 * W},
+                              frame(ref.body2), Lanes{distance_points2.data() + k * 3 * W}, Lanes{dist}, out);
+            break;
+        }
+        case ConstraintType::fixed_parameter:
+            coordinates(buckets.fixed_parameter.body[k], buckets.fixed_parameter.parameter_index[k],
+                        [&](const auto& value) { parameter_lanes<W>(value, out); });
+            break;
+        case ConstraintType::fixed_orientation:
+            coordinates(buckets.fixed_orientation.body[k], 3, [&](const auto& value)
+            {
+                difference_lanes<W>(4, value, Lanes{fixed_orientations.data() + k * 4 * W}, out);
+            });
+            break;
+        case ConstraintType::fixed_position:
+            coordinates(buckets.fixed_position.body[k], 0, [&](const auto& value)
+            {
+                difference_lanes<W>(3, value, Lanes{fixed_positions.data() + k * 3 * W}, out);
+            });
+            break;
+        case ConstraintType::ball_joint:
+            point_difference_lanes<W>(frame(ref.body1), Lanes{ball_joint_points1.data() + k * 3 * W},
+                                      frame(ref.body2), Lanes{ball_joint_points2.data() + k * 3 * W}, out);
+            break;
+        case ConstraintType::revolute:
+            revolute_lanes<W>(frame(ref.body1), Lanes{revolute_points1.data() + k * 3 * W}, Lanes{revolute_axes1.data() + k * 3 * W},
+                              frame(ref.body2), Lanes{revolute_points2.data() + k * 3 * W}, Lanes{revolute_axes2.data() + k * 3 * W},
+                              out);
+            break;
+        case ConstraintType::quaternion:
+            coordinates(buckets.quaternion.body[k], 3, [&](const auto& e) { quaternion_norm_lanes<W>(e, out); });
+            break;
+        case ConstraintType::generic:
+            break;
+    }
+}
+
+void EnsembleBatch::evaluate(double t, std::vector<double>& out)
+{
+    for(const auto& ref : topology.getBuckets().getRefs())
+        evaluateConstraint(ref, t, out.data() + ref.row * W);
+}
+
+void EnsembleBatch::jacobian(double t)
+{
+    const int* outer = topology.getJacobianPattern().outerIndexPtr();
+    const auto& offsets = topology.getBodyConstraintOffsets();
+    const auto& body_constraints = topology.getBodyConstraints();
+
+    // constraint functions at the unperturbed state are shared by all columns
+    evaluate(t, phi);
+
+    double residual[5 * W];
+    for(std::int32_t body = 0; body < topology.getNumBodies(); body++)
+    {
+        for(int c = 0; c < 7; c++)
+        {
+            // every system is perturbed in place in the same coordinate
+            const int i = body * 7 + c;
+            double saved[W];
+            for(int s = 0; s < W; s++)
+            {
+                saved[s] = q[i * W + s];
+                q[i * W + s] += 1e-4;
+            }
+            updateFrame(body);
+
+            int offset = 0;
+            for(std::int32_t k = offsets[body]; k < offsets[body + 1]; k++)
+            {
+                const auto& ref = body_constraints[k];
+                evaluateConstraint(ref, t, residual);
+
+                double* values = jacobian_values.data() + static_cast<std::size_t>(outer[i] + offset) * W;
+                for(int e = 0; e < ref.equations; e++)
+                    for(int s = 0; s < W; s++)
+                        values[e * W + s] = (residual[e * W + s] - phi[(ref.row + e) * W + s]) / 1e-4;
+
+                offset += ref.equations;
+            }
+
+            for(int s = 0; s < W; s++)
+                q[i * W + s] = saved[s];
+        }
+        updateFrame(body);
+    }
+}
+
+bool EnsembleBatch::factorize()
+{
+    return linear.factorize(jacobian_values.data(), num_systems);
+}
+
+void EnsembleBatch::solveLinear()
+{
+    const auto& pattern = topology.getJacobianPattern();
+    linear.solve(pattern.outerIndexPtr(), pattern.innerIndexPtr(), jacobian_values.data(), b.data(), delta_q.data());
+}
+
+void EnsembleBatch::solve(double t)
+{
+    double norm[W];
+    bool active[W];
+
+    const auto residual = [&]()
+    {
+        updateFrames();
+        evaluate(t, b);
+        for(double& value : b)
+            value = -value;
+
+        std::fill(norm, norm + W, 0.0);
+        for(int row = 0; row < num_equations; row++)
+            for(int s = 0; s < W; s++)
+                norm[s] += b[row * W + s] * b[row * W + s];
+    };
+
+    residual();
+    bool any_active = false;
+    bool factorized = false;
+    for(int s = 0; s < W; s++)
+    {
+        iterations[s] = 0;
+        active[s] = s < num_systems && NewtonControl::next(norm[s], 0, factorized) != NewtonStage::done;
+        any_active = any_active || active[s];
+    }
+
+    while(any_active)
+    {
+        // Jacobian and its factorization are taken at the initial guess and reused
+        // by all iterations of this solve
+        if(!factorized)
+        {
+            jacobian(t);
+            if(!factorize()) {
+                std::cerr << "Decomposition failed!\n";
+            }
+            factorized = true;
+        }
+
+        solveLinear();
+        for(int c = 0; c < num_coordinates; c++)
+            for(int s = 0; s < W; s++)
+                if(active[s])
+                    q[c * W + s] += delta_q[c * W + s];
+
+        residual();
+
+        any_active = false;
+        for(int s = 0; s < W; s++)
+        {
+            if(!active[s])
+                continue;
+
+            iterations[s]++;
+            active[s] = NewtonControl::next(norm[s], iterations[s], factorized) != NewtonStage::done;
+            any_active = any_active || active[s];
+        }
+    }
+}
+
+std::vector<std::vector<State>> ensemble_solver(const std::vector<CompiledSystem>& systems, double end_time)
+{
+    // Group structurally identical systems; systems with user constraints are solved one by one
+    std::vector<std::vector<int>> groups;
+    std::vector<int> singles;
+    for(int i = 0; i < static_cast<int>(systems.size()); i++)
+    {
+        if(!systems[i].getBuckets().generic.row.empty())
+        {
+            singles.push_back(i);
+            continue;
+        }
+
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const std::vector<int>& g)
+        {
+            return systems[g.front()].sameTopology(systems[i]);
+        });
+        if(group == groups.end())
+            groups.push_back({i});
+        else
+            group->push_back(i);
+    }
+
+    // one symbolic analysis per topology (shared cache), batches of up to ensemble_width systems
+    struct Task
+    {
+        const NormalEquationsSymbolic* symbolic;
+        std::vector<int> members;
+    };
+    std::vector<Task> tasks;
+    for(const auto& group : groups)
+    {
+        const auto& symbolic = systems[group.front()].getSymbolic().getNormalEquations();
+        for(std::size_t begin = 0; begin < group.size(); begin += W)
+        {
+            const std::size_t end = std::min(group.size(), begin + W);
+            tasks.push_back({&symbolic, std::vector<int>(group.begin() + begin, group.begin() + end)});
+        }
+    }
+    for(int i : singles)
+        tasks.push_back({nullptr, {i}});
+
+    std::vector<std::vector<State>> results(systems.size());
+    parallel_for_each_index(std::size_t{0}, tasks.size(), [&](std::size_t task_index)
+    {
+        const auto& task = tasks[task_index];
+        if(!task.symbolic)
+        {
+            NormalEquationsSession session{systems[task.members.front()]};
+            results[task.members.front()] = multibody_solver(session, end_time);
+            return;
+        }
+
+        std::vector<const CompiledSystem*> members;
+        for(int i : task.members)
+            members.push_back(&systems[i]);
+
+        EnsembleBatch batch{members, *task.symbolic};
+        Eigen::VectorXd q;
+        for(double t : time_steps(end_time))
+        {
+            batch.solve(t);
+            for(int s = 0; s < batch.getNumSystems(); s++)
+            {
+                batch.getQ(s, q);
+                results[task.members[s]].emplace_back(q, t);
+            }
+        }
+    });
+
+    return results;
+}
@@ -0,0 +1,106 @@
+#include "flow_solver.hpp"
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <oneapi/tbb.h>
+#include <oneapi/tbb/flow_graph.h>
+#include "multibody_solver.hpp"
+
+namespace
+{
+    namespace flow = oneapi::tbb::flow;
+
+    // Newton state of one system between the nodes of the graph
+    struct FlowJob
+    {
+        std::unique_ptr<RuntimeSolverSession> session;
+        Eigen::VectorXd q;
+        std::size_t step = 0;
+        std::vector<State> states;
+    };
+
+    using Routing = flow::multifunction_node<std::size_t, std::tuple<std::size_t, std::size_t, std::size_t>>;
+    using Stepping = flow::multifunction_node<std::size_t, std::tuple<std::size_t>>;
+    using Stage = flow::function_node<std::size_t, std::size_t>;
+}
+
+std::vector<std::vector<State>> flow_solver(const std::vector<CompiledSystem>& systems, double end_time,
+                                            int block_size, LinearSolverType linear_solver)
+{
+    const std::vector<double> times = time_steps(end_time);
+    std::vector<FlowJob> jobs(systems.size());
+    for(std::size_t i = 0; i < systems.size(); i++)
+    {
+        jobs[i].session = std::make_unique<RuntimeSolverSession>(systems[i], block_size, linear_solver);
+        jobs[i].q = systems[i].getInitialQ();
+    }
+
+    flow::graph g;
+
+    // residual and the next stage decided by the session: 0 - Jacobian, 1 - update, 2 - step finished
+    Routing residual(g, flow::unlimited, [&](std::size_t i, Routing::output_ports_type& ports)
+    {
+        FlowJob& job = jobs[i];
+        const double norm = job.session->residual(job.q, times[job.step]);
+
+        switch(job.session->nextStage(norm))
+        {
+            case NewtonStage::refactorize: std::get<0>(ports).try_put(i); break;
+            case NewtonStage::iterate:     std::get<1>(ports).try_put(i); break;
+            case NewtonStage::done:        std::get<2>(ports).try_put(i); break;
+        }
+    });
+
+    Stage jacobian(g, flow::unlimited, [&](std::size_t i)
+    {
+        jobs[i].session->jacobian(jobs[i].q, times[jobs[i].step]);
+        return i;
+    });
+
+    Stage factor(g, flow::unlimited, [&](std::size_t i)
+    {
+        jobs[i].session->factorize();
+        return i;
+    });
+
+    Stage update(g, flow::unlimited, [&](std::size_t i)
+    {
+        jobs[i].session->update(jobs[i].q);
+        return i;
+    });
+
+    // previous solution is the initial guess for the next time step
+    Stepping step(g, flow::unlimited, [&](std::size_t i, Stepping::output_ports_type& ports)
+    {
+        FlowJob& job = jobs[i];
+        job.states.emplace_back(job.q, times[job.step]);
+
+        job.step++;
+        job.session->beginStep();
+
+        if(job.step < times.size())
+            std::get<0>(ports).try_put(i);
+    });
+
+    flow::make_edge(flow::output_port<0>(residual), jacobian);
+    flow::make_edge(flow::output_port<1>(residual), update);
+    flow::make_edge(flow::output_port<2>(residual), step);
+    flow::make_edge(jacobian, factor);
+    flow::make_edge(factor, update);
+    flow::make_edge(update, residual);
+    flow::make_edge(flow::output_port<0>(step), residual);
+
+    // first time step t = 0, as in multibody_solver
+    if(!times.empty())
+    {
+        for(std::size_t i = 0; i < jobs.size(); i++)
+            residual.try_put(i);
+    }
+    g.wait_for_all();
+
+    std::vector<std::vector<State>> results;
+    results.reserve(jobs.size());
+    for(auto& job : jobs)
+        results.push_back(std::move(job.states));
+    return results;
+}
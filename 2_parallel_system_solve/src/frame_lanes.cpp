@@ -0,0 +1,38 @@
+#include "frame_lanes.hpp"
+#include <eigen3/Eigen/Dense>
+#include "quaternion_operations.hpp"
+
+void FrameLanes::perturb(const Eigen::VectorXd& q, std::int32_t index, double h)
+{
+    const double* coordinates = q.data() + index * 7;
+
+    for(int l = 0; l < lane_count; l++)
+    {
+        for(int i = 0; i < 3; i++)
+            position[i][l] = coordinates[i];
+        for(int i = 0; i < 4; i++)
+            quaternion[i][l] = coordinates[3 + i];
+    }
+    for(int j = 0; j < 3; j++)
+        position[j][j] += h;
+    for(int j = 0; j < 4; j++)
+        quaternion[j][3 + j] += h;
+
+    // One lane per state, the rotation written lane-minor
+    for(int l = 0; l < lane_count; l++)
+        rotation_matrix(quaternion[0][l], quaternion[1][l], quaternion[2][l], quaternion[3][l], &rotation[0][l], lane_count);
+}
+
+void FrameLanes::broadcast(const BodyFrames& frames, std::int32_t index)
+{
+    const Eigen::Vector3d& r = frames.position(index);
+    const Eigen::Matrix3d& m = frames.rotation(index);
+
+    for(int l = 0; l < lane_count; l++)
+    {
+        for(int i = 0; i < 3; i++)
+            position[i][l] = r(i);
+        for(int i = 0; i < 9; i++)
+            rotation[i][l] = m.data()[i];
+    }
+}
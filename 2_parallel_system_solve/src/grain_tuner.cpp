@@ -0,0 +1,171 @@
+#include "grain_tuner.hpp"
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <iterator>
+
+namespace
+{
+    // Multiples of the 7 coordinates of a body, the same values the benchmark sweeps
+    constexpr int candidate_block_sizes[] = {7, 14, 28, 56, 70};
+
+    constexpr Partitioner candidate_partitioners[] = {Partitioner::simple, Partitioner::automatic, Partitioner::affinity};
+}
+
+GrainTuner::GrainTuner(int num_coordinates, int trials)
+    : trials(trials), best{7, Partitioner::automatic}
+{
+    for(int block_size : candidate_block_sizes)
+    {
+        for(Partitioner partitioner : candidate_partitioners)
+            candidates.push_back({{block_size, partitioner}, std::numeric_limits<double>::infinity(), 0});
+
+        // bigger blocks than the whole Jacobian would all run the same way
+        if(block_size >= num_coordinates)
+            break;
+    }
+}
+
+GrainTuner::GrainTuner(JacobianSchedule schedule)
+    : trials(0), locked(true), best(schedule)
+{
+}
+
+JacobianSchedule GrainTuner::next() const
+{
+    if(locked.load(std::memory_order_acquire))
+        return best;
+
+    std::lock_guard lock(mutex);
+    if(current < candidates.size())
+        return candidates[current].schedule;
+    return best;
+}
+
+void GrainTuner::record(const JacobianSchedule& schedule, double seconds)
+{
+    if(locked.load(std::memory_order_acquire))
+        return;
+
+    std::lock_guard lock(mutex);
+    if(current >= candidates.size())
+        return;
+
+    // the first Jacobian runs cold (thread start-up, page faults, empty caches); it is not compared
+    if(!warmed_up)
+    {
+        warmed_up = true;
+        return;
+    }
+
+    // sessions running at the same time may report a candidate that has already been passed
+    for(auto& candidate : candidates)
+    {
+        if(candidate.schedule == schedule)
+        {
+            candidate.time = std::min(candidate.time, seconds);
+            candidate.trials++;
+        }
+    }
+
+    while(current < candidates.size() && candidates[current].trials >= trials)
+        current++;
+
+    if(current == candidates.size())
+    {
+        const auto fastest = std::min_element(candidates.begin(), candidates.end(),
+                                              [](const Candidate& a, const Candidate& b) { return a.time < b.time; });
+        best = fastest->schedule;
+        locked.store(true, std::memory_order_release);
+    }
+}
+
+bool GrainTuner::isLocked() const
+{
+    return locked.load(std::memory_order_acquire);
+}
+
+JacobianSchedule GrainTuner::getBest() const
+{
+    std::lock_guard lock(mutex);
+    return best;
+}
+
+TuningStore& TuningStore::global()
+{
+    static TuningStore store;
+    return store;
+}
+
+std::shared_ptr<GrainTuner> TuningStore::get(std::uint64_t topology_hash, int num_threads, int num_coordinates)
+{
+    std::lock_guard lock(mutex);
+    auto& tuner = tuners[{topology_hash, num_threads}];
+    if(!tuner)
+        tuner = std::make_shared<GrainTuner>(num_coordinates);
+    return tuner;
+}
+
+bool TuningStore::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if(!file)
+        return false;
+
+    std::uint64_t hash;
+    int threads, block_size;
+    std::string name;
+
+    std::lock_guard lock(mutex);
+    while(file >> hash >> threads >> block_size >> name)
+    {
+        const auto partitioner = std::find_if(std::begin(candidate_partitioners), std::end(candidate_partitioners),
+                                              [&](Partitioner candidate) { return name == partitioner_name(candidate); });
+        if(partitioner == std::end(candidate_partitioners))
+            throw std::runtime_error("Unknown partitioner '" + name + "' in tuning file: " + path);
+
+        if(block_size <= 0)
+            throw std::runtime_error("Invalid block size in tuning file: " + path);
+
+        tuners[{hash, threads}] = std::make_shared<GrainTuner>(JacobianSchedule{block_size, *partitioner});
+    }
+    return true;
+}
+
+bool TuningStore::save(const std::string& path) const
+{
+    std::ofstream file(path);
+    if(!file)
+        return false;
+
+    std::lock_guard lock(mutex);
+    for(const auto& [key, tuner] : tuners)
+    {
+        // only settled results; a tuning still in progress starts over in the next run
+        if(!tuner->isLocked())
+            continue;
+
+        const JacobianSchedule schedule = tuner->getBest();
+        file << key.first << ' ' << key.second << ' ' << schedule.block_size << ' '
+             << partitioner_name(schedule.partitioner) << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+std::size_t TuningStore::size() const
+{
+    std::lock_guard lock(mutex);
+    return tuners.size();
+}
+
+void TuningStore::clear()
+{
+    std::lock_guard lock(mutex);
+    tuners.clear();
+}
@@ -0,0 +1,540 @@
+#include "model_image.hpp"
+#include <vector>
+#include <map>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+#include <cerrno>
+#include <fstream>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include <limits>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "compiled_system.hpp"
+
+// Fixed-size header at the start of the file
+struct ImageHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t file_bytes;
+    std::int64_t num_bodies;
+    std::int64_t num_equations;
+    std::uint64_t topology_hash;
+    std::int64_t normal_rows;
+    std::int64_t normal_cols;
+    std::uint64_t jacobian_nonzeros;
+    std::uint32_t ref_bytes;
+    std::uint32_t section_count;
+    ImageSectionEntry sections[static_cast<std::size_t>(ImageSection::count)];
+};
+
+namespace
+{
+    constexpr char image_magic[8] = {'M', 'B', 'I', 'M', 'A', 'G', 'E', '\0'};
+
+    // Written as a number, read back in the machine's byte order
+    constexpr std::uint32_t image_byte_order = 0x01020304;
+
+    constexpr std::uint64_t section_alignment = 64;
+
+    static_assert(std::is_trivially_copyable_v<ConstraintRef>, "ConstraintRef is stored as raw bytes");
+    static_assert(sizeof(Eigen::Vector3d) == 3 * sizeof(double) && sizeof(Eigen::Vector4d) == 4 * sizeof(double),
+                  "Fixed-size vectors are stored as plain doubles");
+
+    // Sections are appended one after another, each starting at a multiple of section_alignment
+    class ImageWriter
+    {
+    public:
+        explicit ImageWriter(const std::string& path) : path(path), file(path, std::ios::binary | std::ios::trunc)
+        {
+            if(!file)
+                throw std::runtime_error("Cannot create model image: " + path);
+
+            // the header is written last, once the sections are known
+            std::memset(&header, 0, sizeof(header));
+            pad(sizeof(header));
+        }
+
+        template<typename T>
+        void write(ImageSection section, const T* values, std::size_t count)
+        {
+            pad((position + section_alignment - 1) / section_alignment * section_alignment - position);
+
+            const std::uint64_t bytes = count * sizeof(T);
+            header.sections[static_cast<std::size_t>(section)] = {position, bytes};
+            file.write(reinterpret_cast<const char*>(values), static_cast<std::streamsize>(bytes));
+            position += bytes;
+        }
+
+        template<typename T>
+        void write(ImageSection section, const std::vector<T>& values)
+        {
+            write(section, values.data(), values.size());
+        }
+
+        template<int N>
+        void write(ImageSection section, const std::vector<Eigen::Matrix<double, N, 1>>& values)
+        {
+            write(section, reinterpret_cast<const double*>(values.data()), values.size() * N);
+        }
+
+        ImageHeader& getHeader()
+        {
+            return header;
+        }
+
+        void finish()
+        {
+            std::memcpy(header.magic, image_magic, sizeof(image_magic));
+            header.version = model_image_version;
+            header.byte_order = image_byte_order;
+            header.file_bytes = position;
+            header.ref_bytes = sizeof(ConstraintRef);
+            header.section_count = static_cast<std::uint32_t>(ImageSection::count);
+
+            file.seekp(0);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.flush();
+            if(!file)
+                throw std::runtime_error("Failed to write model image: " + path);
+        }
+
+    private:
+        void pad(std::uint64_t bytes)
+        {
+            static const char zeros[section_alignment] = {};
+            while(bytes > 0)
+            {
+                const std::uint64_t n = std::min<std::uint64_t>(bytes, section_alignment);
+                file.write(zeros, static_cast<std::streamsize>(n));
+                position += n;
+                bytes -= n;
+            }
+        }
+
+        std::string path;
+        std::ofstream file;
+        ImageHeader header;
+        std::uint64_t position = 0;
+    };
+}
+
+ModelImage::ModelImage(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Cannot open model image " + path + ": " + std::strerror(errno));
+
+    struct stat status;
+    if(fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(ImageHeader))
+    {
+        close(fd);
+        throw std::runtime_error("Not a model image: " + path);
+    }
+
+    // read-only private mapping: processes opening the same image share its page cache pages
+    bytes = static_cast<std::size_t>(status.st_size);
+    void* mapping = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        bytes = 0;
+        throw std::runtime_error("Failed to map model image " + path + ": " + std::strerror(errno));
+    }
+    data = static_cast<const unsigned char*>(mapping);
+    header = reinterpret_cast<const ImageHeader*>(data);
+
+    try
+    {
+        if(std::memcmp(header->magic, image_magic, sizeof(image_magic)) != 0)
+            throw std::runtime_error("Not a model image: " + path);
+        if(header->byte_order != image_byte_order)
+            throw std::runtime_error("Model image has a different byte order: " + path);
+        if(header->version != model_image_version)
+            throw std::runtime_error("Unsupported model image version " + std::to_string(header->version) +
+                                     " (expected " + std::to_string(model_image_version) + "): " + path);
+        if(header->file_bytes != bytes || header->ref_bytes != sizeof(ConstraintRef) ||
+           header->section_count != static_cast<std::uint32_t>(ImageSection::count))
+            throw std::runtime_error("Corrupted model image: " + path);
+
+        for(const auto& entry : header->sections)
+        {
+            if(entry.offset % section_alignment != 0 || entry.offset > bytes || entry.bytes > bytes - entry.offset)
+                throw std::runtime_error("Corrupted model image: " + path);
+        }
+
+        // names are '\0'-terminated one after another
+        const auto names = array<char>(ImageSection::driver_names);
+        if(names.size > 0 && names[names.size - 1] != '\0')
+            throw std::runtime_error("Corrupted model image: " + path);
+        for(std::size_t i = 0; i < names.size; i += std::strlen(names.data + i) + 1)
+            driver_names.push_back(names.data + i);
+
+        checkSections(path);
+    }
+    catch(...)
+    {
+        release();
+        throw;
+    }
+}
+
+ModelImage::~ModelImage()
+{
+    release();
+}
+
+ModelImage::ModelImage(ModelImage&& other) noexcept
+    : data(std::exchange(other.data, nullptr)), bytes(std::exchange(other.bytes, 0)),
+      header(std::exchange(other.header, nullptr)), driver_names(std::move(other.driver_names))
+{
+}
+
+ModelImage& ModelImage::operator=(ModelImage&& other) noexcept
+{
+    if(this != &other)
+    {
+        release();
+        data = std::exchange(other.data, nullptr);
+        bytes = std::exchange(other.bytes, 0);
+        header = std::exchange(other.header, nullptr);
+        driver_names = std::move(other.driver_names);
+    }
+    return *this;
+}
+
+void ModelImage::release()
+{
+    if(data)
+        munmap(const_cast<unsigned char*>(data), bytes);
+    data = nullptr;
+    bytes = 0;
+    header = nullptr;
+    driver_names.clear();
+}
+
+const ImageSectionEntry& ModelImage::sectionEntry(ImageSection section) const
+{
+    return header->sections[static_cast<std::size_t>(section)];
+}
+
+void ModelImage::checkSections(const std::string& path) const
+{
+    const auto corrupted = [&path]()
+    {
+        return std::runtime_error("Corrupted model image: " + path);
+    };
+
+    // number of elements of a section, which must hold whole elements
+    const auto count = [&](ImageSection section, std::size_t element_bytes)
+    {
+        const std::uint64_t section_bytes = sectionEntry(section).bytes;
+        if(section_bytes % element_bytes != 0)
+            throw corrupted();
+        return static_cast<std::size_t>(section_bytes / element_bytes);
+    };
+
+    const auto expect = [&](ImageSection section, std::size_t element_bytes, std::size_t expected)
+    {
+        if(count(section, element_bytes) != expected)
+            throw corrupted();
+    };
+
+    if(header->num_bodies < 0 || header->num_equations < 0 || header->num_bodies > std::numeric_limits<int>::max() / 7)
+        throw corrupted();
+    const std::int64_t num_bodies = header->num_bodies;
+    const std::int64_t num_equations = header->num_equations;
+    const auto num_coordinates = static_cast<std::size_t>(num_bodies) * 7;
+
+    const auto valid_body = [num_bodies](std::int32_t body)
+    {
+        return body >= ground_index && body < num_bodies;
+    };
+
+    const auto check_bodies = [&](ImageSection section, std::size_t expected)
+    {
+        expect(section, sizeof(std::int32_t), expected);
+        for(const std::int32_t body : array<std::int32_t>(section))
+        {
+            if(!valid_body(body))
+                throw corrupted();
+        }
+    };
+
+    const auto check_refs = [&](ImageSection section)
+    {
+        count(section, sizeof(ConstraintRef));
+        for(const ConstraintRef& ref : array<ConstraintRef>(section))
+        {
+            if(!valid_body(ref.body1) || !valid_body(ref.body2) || ref.row < 0 || ref.equations < 0 ||
+               ref.row + static_cast<std::int64_t>(ref.equations) > num_equations)
+                throw corrupted();
+        }
+    };
+
+    expect(ImageSection::body_ids, sizeof(std::int64_t), static_cast<std::size_t>(num_bodies));
+    expect(ImageSection::initial_q, sizeof(double), num_coordinates);
+
+    check_refs(ImageSection::refs);
+    check_refs(ImageSection::body_constraints);
+    expect(ImageSection::body_constraint_offsets, sizeof(std::int32_t), static_cast<std::size_t>(num_bodies) + 1);
+    const auto offsets = getBodyConstraintOffsets();
+    if(offsets[offsets.size - 1] < 0 ||
+       static_cast<std::size_t>(offsets[offsets.size - 1]) != count(ImageSection::body_constraints, sizeof(ConstraintRef)))
+        throw corrupted();
+
+    // CSC pattern: one column per coordinate, as many row indices as zeros
+    expect(ImageSection::jacobian_outer, sizeof(int), num_coordinates + 1);
+    const auto outer = array<int>(ImageSection::jacobian_outer);
+    const std::size_t nonzeros = count(ImageSection::jacobian_inner, sizeof(int));
+    if(outer[num_coordinates] < 0 || static_cast<std::size_t>(outer[num_coordinates]) != nonzeros ||
+       header->jacobian_nonzeros != nonzeros)
+        throw corrupted();
+    expect(ImageSection::jacobian_values, sizeof(double), nonzeros);
+
+    // every array of a bucket has one entry (or one vector) per constraint
+    const std::size_t distances = count(ImageSection::distance_row, sizeof(std::int32_t));
+    check_bodies(ImageSection::distance_body1, distances);
+    check_bodies(ImageSection::distance_body2, distances);
+    expect(ImageSection::distance_body1_point, sizeof(double), 3 * distances);
+    expect(ImageSection::distance_body2_point, sizeof(double), 3 * distances);
+    expect(ImageSection::distance_driver, sizeof(std::uint32_t), distances);
+    for(const std::uint32_t driver : array<std::uint32_t>(ImageSection::distance_driver))
+    {
+        if(driver >= driver_names.size())
+            throw corrupted();
+    }
+
+    const std::size_t parameters = count(ImageSection::fixed_parameter_row, sizeof(std::int32_t));
+    check_bodies(ImageSection::fixed_parameter_body, parameters);
+    expect(ImageSection::fixed_parameter_index, sizeof(int), parameters);
+
+    const std::size_t orientations = count(ImageSection::fixed_orientation_row, sizeof(std::int32_t));
+    check_bodies(ImageSection::fixed_orientation_body, orientations);
+    expect(ImageSection::fixed_orientation_orientation, sizeof(double), 4 * orientations);
+
+    const std::size_t positions = count(ImageSection::fixed_position_row, sizeof(std::int32_t));
+    check_bodies(ImageSection::fixed_position_body, positions);
+    expect(ImageSection::fixed_position_position, sizeof(double), 3 * positions);
+
+    const std::size_t balls = count(ImageSection::ball_joint_row, sizeof(std::int32_t));
+    check_bodies(ImageSection::ball_joint_body1, balls);
+    check_bodies(ImageSection::ball_joint_body2, balls);
+    expect(ImageSection::ball_joint_body1_point, sizeof(double), 3 * balls);
+    expect(ImageSection::ball_joint_body2_point, sizeof(double), 3 * balls);
+
+    const std::size_t revolutes = count(ImageSection::revolute_row, sizeof(std::int32_t));
+    check_bodies(ImageSection::revolute_body1, revolutes);
+    check_bodies(ImageSection::revolute_body2, revolutes);
+    expect(ImageSection::revolute_body1_point, sizeof(double), 3 * revolutes);
+    expect(ImageSection::revolute_body2_point, sizeof(double), 3 * revolutes);
+    expect(ImageSection::revolute_body1_axis, sizeof(double), 3 * revolutes);
+    expect(ImageSection::revolute_body2_axis, sizeof(double), 3 * revolutes);
+
+    const std::size_t quaternions = count(ImageSection::quaternion_row, sizeof(std::int32_t));
+    check_bodies(ImageSection::quaternion_body, quaternions);
+
+    // normal equations analysis of this Jacobian: one entry per column, CSC pointers one more
+    if(header->normal_rows != num_equations || header->normal_cols != static_cast<std::int64_t>(num_coordinates))
+        throw corrupted();
+    expect(ImageSection::normal_perm, sizeof(int), num_coordinates);
+    expect(ImageSection::normal_inverse_perm, sizeof(int), num_coordinates);
+    expect(ImageSection::normal_a_diagonal, sizeof(int), num_coordinates);
+    expect(ImageSection::normal_parent, sizeof(int), num_coordinates);
+    expect(ImageSection::normal_a_outer, sizeof(int), num_coordinates + 1);
+    expect(ImageSection::normal_l_outer, sizeof(int), num_coordinates + 1);
+    const auto a_outer = array<int>(ImageSection::normal_a_outer);
+    if(a_outer[num_coordinates] < 0 ||
+       static_cast<std::size_t>(a_outer[num_coordinates]) != count(ImageSection::normal_a_inner, sizeof(int)))
+        throw corrupted();
+    const std::size_t products = count(ImageSection::normal_product_target, sizeof(int));
+    expect(ImageSection::normal_product_left, sizeof(int), products);
+    expect(ImageSection::normal_product_right, sizeof(int), products);
+}
+
+int ModelImage::getNumBodies() const
+{
+    return static_cast<int>(header->num_bodies);
+}
+
+int ModelImage::getNumCoordinates() const
+{
+    return static_cast<int>(header->num_bodies) * 7;
+}
+
+int ModelImage::getNumEquations() const
+{
+    return static_cast<int>(header->num_equations);
+}
+
+std::uint64_t ModelImage::getTopologyHash() const
+{
+    return header->topology_hash;
+}
+
+ImageArray<std::int64_t> ModelImage::getBodyIds() const
+{
+    return array<std::int64_t>(ImageSection::body_ids);
+}
+
+Eigen::Map<const Eigen::VectorXd> ModelImage::getInitialQ() const
+{
+    const auto q = array<double>(ImageSection::initial_q);
+    return Eigen::Map<const Eigen::VectorXd>(q.data, static_cast<Eigen::Index>(q.size));
+}
+
+ImageArray<ConstraintRef> ModelImage::getRefs() const
+{
+    return array<ConstraintRef>(ImageSection::refs);
+}
+
+ImageArray<std::int32_t> ModelImage::getBodyConstraintOffsets() const
+{
+    return array<std::int32_t>(ImageSection::body_constraint_offsets);
+}
+
+ImageArray<ConstraintRef> ModelImage::getBodyConstraints() const
+{
+    return array<ConstraintRef>(ImageSection::body_constraints);
+}
+
+Eigen::Map<const Eigen::SparseMatrix<double>> ModelImage::getJacobianPattern() const
+{
+    const auto outer = array<int>(ImageSection::jacobian_outer);
+    const auto inner = array<int>(ImageSection::jacobian_inner);
+    const auto values = array<double>(ImageSection::jacobian_values);
+    return Eigen::Map<const Eigen::SparseMatrix<double>>(getNumEquations(), getNumCoordinates(),
+                                                         static_cast<Eigen::Index>(inner.size), outer.data, inner.data,
+                                                         values.data);
+}
+
+int ModelImage::getNormalRows() const
+{
+    return static_cast<int>(header->normal_rows);
+}
+
+int ModelImage::getNormalCols() const
+{
+    return static_cast<int>(header->normal_cols);
+}
+
+std::size_t ModelImage::getJacobianNonzeros() const
+{
+    return static_cast<std::size_t>(header->jacobian_nonzeros);
+}
+
+const char* ModelImage::getDriverName(std::uint32_t index) const
+{
+    return driver_names.at(index);
+}
+
+std::size_t ModelImage::getNumDrivers() const
+{
+    return driver_names.size();
+}
+
+void save_model_image(const CompiledSystem& system, const std::string& path, const DriverRegistry& drivers)
+{
+    const auto& buckets = system.getBuckets();
+    if(!buckets.generic.row.empty())
+        throw std::runtime_error("Model image supports built-in constraint types only");
+
+    // driver functions by name, numbered in order of first use
+    std::map<Eigen::Vector3d (*)(double), std::uint32_t> driver_numbers;
+    std::string driver_names;
+    std::vector<std::uint32_t> distance_driver;
+    distance_driver.reserve(buckets.distance.distance.size());
+    for(auto function : buckets.distance.distance)
+    {
+        auto it = driver_numbers.find(function);
+        if(it == driver_numbers.end())
+        {
+            const std::string_view name = drivers.name(function);
+            if(name.empty())
+                throw std::runtime_error("Driver function of a distance constraint is not registered");
+            it = driver_numbers.emplace(function, static_cast<std::uint32_t>(driver_numbers.size())).first;
+            driver_names.append(name);
+            driver_names.push_back('\0');
+        }
+        distance_driver.push_back(it->second);
+    }
+
+    const std::vector<std::int64_t> body_ids(system.getBodyIds().begin(), system.getBodyIds().end());
+    const auto& pattern = system.getJacobianPattern();
+    const auto& normal = system.getSymbolic().getNormalEquations();
+
+    ImageWriter writer{path};
+    auto& header = writer.getHeader();
+    header.num_bodies = system.getNumBodies();
+    header.num_equations = system.getNumEquations();
+    header.topology_hash = system.getTopologyHash();
+    header.normal_rows = normal.rows;
+    header.normal_cols = normal.cols;
+    header.jacobian_nonzeros = normal.jacobian_nonzeros;
+
+    writer.write(ImageSection::body_ids, body_ids);
+    writer.write(ImageSection::initial_q, system.getInitialQ().data(), static_cast<std::size_t>(system.getInitialQ().size()));
+    writer.write(ImageSection::refs, buckets.getRefs());
+    writer.write(ImageSection::body_constraint_offsets, system.getBodyConstraintOffsets());
+    writer.write(ImageSection::body_constraints, system.getBodyConstraints());
+    writer.write(ImageSection::jacobian_outer, pattern.outerIndexPtr(), static_cast<std::size_t>(pattern.outerSize() + 1));
+    writer.write(ImageSection::jacobian_inner, pattern.innerIndexPtr(), static_cast<std::size_t>(pattern.nonZeros()));
+    writer.write(ImageSection::jacobian_values, pattern.valuePtr(), static_cast<std::size_t>(pattern.nonZeros()));
+
+    writer.write(ImageSection::distance_body1, buckets.distance.body1);
+    writer.write(ImageSection::distance_body2, buckets.distance.body2);
+    writer.write(ImageSection::distance_row, buckets.distance.row);
+    writer.write(ImageSection::distance_body1_point, buckets.distance.body1_point);
+    writer.write(ImageSection::distance_body2_point, buckets.distance.body2_point);
+    writer.write(ImageSection::distance_driver, distance_driver);
+
+    writer.write(ImageSection::fixed_parameter_body, buckets.fixed_parameter.body);
+    writer.write(ImageSection::fixed_parameter_row, buckets.fixed_parameter.row);
+    writer.write(ImageSection::fixed_parameter_index, buckets.fixed_parameter.parameter_index);
+    writer.write(ImageSection::fixed_orientation_body, buckets.fixed_orientation.body);
+    writer.write(ImageSection::fixed_orientation_row, buckets.fixed_orientation.row);
+    writer.write(ImageSection::fixed_orientation_orientation, buckets.fixed_orientation.orientation);
+    writer.write(ImageSection::fixed_position_body, buckets.fixed_position.body);
+    writer.write(ImageSection::fixed_position_row, buckets.fixed_position.row);
+    writer.write(ImageSection::fixed_position_position, buckets.fixed_position.position);
+    writer.write(ImageSection::ball_joint_body1, buckets.ball_joint.body1);
+    writer.write(ImageSection::ball_joint_body2, buckets.ball_joint.body2);
+    writer.write(ImageSection::ball_joint_row, buckets.ball_joint.row);
+    writer.write(ImageSection::ball_joint_body1_point, buckets.ball_joint.body1_point);
+    writer.write(ImageSection::ball_joint_body2_point, buckets.ball_joint.body2_point);
+    writer.write(ImageSection::revolute_body1, buckets.revolute.body1);
+    writer.write(ImageSection::revolute_body2, buckets.revolute.body2);
+    writer.write(ImageSection::revolute_row, buckets.revolute.row);
+    writer.write(ImageSection::revolute_body1_point, buckets.revolute.body1_point);
+    writer.write(ImageSection::revolute_body2_point, buckets.revolute.body2_point);
+    writer.write(ImageSection::revolute_body1_axis, buckets.revolute.body1_axis);
+    writer.write(ImageSection::revolute_body2_axis, buckets.revolute.body2_axis);
+    writer.write(ImageSection::quaternion_body, buckets.quaternion.body);
+    writer.write(ImageSection::quaternion_row, buckets.quaternion.row);
+
+    writer.write(ImageSection::normal_perm, normal.perm);
+    writer.write(ImageSection::normal_inverse_perm, normal.inverse_perm);
+    writer.write(ImageSection::normal_a_outer, normal.a_outer);
+    writer.write(ImageSection::normal_a_inner, normal.a_inner);
+    writer.write(ImageSection::normal_a_diagonal, normal.a_diagonal);
+    writer.write(ImageSection::normal_product_target, normal.product_target);
+    writer.write(ImageSection::normal_product_left, normal.product_left);
+    writer.write(ImageSection::normal_product_right, normal.product_right);
+    writer.write(ImageSection::normal_parent, normal.parent);
+    writer.write(ImageSection::normal_l_outer, normal.l_outer);
+
+    writer.write(ImageSection::driver_names, driver_names.data(), driver_names.size());
+
+    writer.finish();
+}
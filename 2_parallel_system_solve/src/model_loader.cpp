@@ -0,0 +1,277 @@
+#include "model_loader.hpp"
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <eigen3/Eigen/Dense>
+
+namespace
+{
+    Eigen::Vector3d zero_driver(double)
+    {
+        return Eigen::Vector3d::Zero();
+    }
+
+    // Cursor over one line of the model; every read skips leading blanks
+    class LineReader
+    {
+    public:
+        LineReader(std::string_view line, std::size_t number) : line(line), number(number) {}
+
+        std::string_view token()
+        {
+            skipBlanks();
+            const std::size_t begin = position;
+            while(position < line.size() && !isBlank(line[position]))
+                position++;
+            if(begin == position)
+                fail("missing value");
+            return line.substr(begin, position - begin);
+        }
+
+        double real()
+        {
+            const std::string_view text = token();
+            double value;
+            const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+            if(result.ec != std::errc{} || result.ptr != text.data() + text.size())
+                fail("invalid number '" + std::string{text} + "'");
+            return value;
+        }
+
+        long int integer()
+        {
+            const std::string_view text = token();
+            long int value;
+            const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+            if(result.ec != std::errc{} || result.ptr != text.data() + text.size())
+                fail("invalid integer '" + std::string{text} + "'");
+            return value;
+        }
+
+        Eigen::Vector3d vector3()
+        {
+            const double x = real();
+            const double y = real();
+            const double z = real();
+            return Eigen::Vector3d(x, y, z);
+        }
+
+        Eigen::Vector4d vector4()
+        {
+            const double e0 = real();
+            const double e1 = real();
+            const double e2 = real();
+            const double e3 = real();
+            return Eigen::Vector4d(e0, e1, e2, e3);
+        }
+
+        // Only blanks or a comment in the line
+        bool blank()
+        {
+            skipBlanks();
+            return position == line.size();
+        }
+
+        // Nothing but blanks or a comment may follow the last field
+        void end()
+        {
+            skipBlanks();
+            if(position < line.size())
+                fail("unexpected '" + std::string{line.substr(position)} + "'");
+        }
+
+        [[noreturn]] void fail(const std::string& message) const
+        {
+            throw std::runtime_error("Model line " + std::to_string(number) + ": " + message);
+        }
+
+    private:
+        static bool isBlank(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        void skipBlanks()
+        {
+            while(position < line.size() && isBlank(line[position]))
+                position++;
+            if(position < line.size() && line[position] == '#')
+                position = line.size();
+        }
+
+        std::string_view line;
+        std::size_t position = 0;
+        std::size_t number;
+    };
+
+    ConstraintVariant read_constraint(std::string_view keyword, LineReader& reader, const DriverRegistry& drivers)
+    {
+        const long int id = reader.integer();
+
+        if(keyword == "distance")
+        {
+            const long int body1 = reader.integer();
+            const long int body2 = reader.integer();
+            const Eigen::Vector3d point1 = reader.vector3();
+            const Eigen::Vector3d point2 = reader.vector3();
+            const std::string_view name = reader.token();
+            const DriverFunction driver = drivers.find(name);
+            if(!driver)
+                reader.fail("unknown driver function '" + std::string{name} + "'");
+            return DistanceConstraint{id, body1, body2, point1, point2, driver};
+        }
+        if(keyword == "fixed_parameter")
+        {
+            const long int body = reader.integer();
+            const long int parameter_index = reader.integer();
+            if(parameter_index < 0 || parameter_index > 6)
+                reader.fail("parameter index must be in 0..6");
+            return FixedParameterConstraint{id, body, static_cast<int>(parameter_index)};
+        }
+        if(keyword == "fixed_orientation")
+        {
+            const long int body = reader.integer();
+            return FixedOrientationConstraint{id, body, reader.vector4()};
+        }
+        if(keyword == "fixed_position")
+        {
+            const long int body = reader.integer();
+            return FixedPositionConstraint{id, body, reader.vector3()};
+        }
+        if(keyword == "ball_joint")
+        {
+            const long int body1 = reader.integer();
+            const long int body2 = reader.integer();
+            const Eigen::Vector3d point1 = reader.vector3();
+            const Eigen::Vector3d point2 = reader.vector3();
+            return BallJointConstraint{id, body1, body2, point1, point2};
+        }
+        if(keyword == "revolute")
+        {
+            const long int body1 = reader.integer();
+            const long int body2 = reader.integer();
+            const Eigen::Vector3d point1 = reader.vector3();
+            const Eigen::Vector3d point2 = reader.vector3();
+            const Eigen::Vector3d axis1 = reader.vector3();
+            const Eigen::Vector3d axis2 = reader.vector3();
+            return RevoluteConstraint{id, body1, body2, point1, point2, axis1, axis2};
+        }
+        if(keyword == "quaternion")
+        {
+            return QuaternionConstraint{id, reader.integer()};
+        }
+
+        reader.fail("unknown element '" + std::string{keyword} + "'");
+    }
+}
+
+DriverRegistry::DriverRegistry()
+{
+    drivers.emplace("zero", zero_driver);
+}
+
+void DriverRegistry::add(const std::string& name, DriverFunction function)
+{
+    drivers[name] = function;
+}
+
+DriverFunction DriverRegistry::find(std::string_view name) const
+{
+    // heterogeneous lookup: no std::string per distance constraint
+    auto it = drivers.find(name);
+    return it == drivers.end() ? nullptr : it->second;
+}
+
+std::string_view DriverRegistry::name(DriverFunction function) const
+{
+    for(const auto& [name, driver] : drivers)
+    {
+        if(driver == function)
+            return name;
+    }
+    return {};
+}
+
+MultibodySystem parse_model(std::string_view text, const DriverRegistry& drivers)
+{
+    MultibodySystem mbs;
+
+    // constraints wait until all bodies are known, so that no addBody has to re-resolve them
+    std::vector<ConstraintVariant> constraints;
+    std::size_t num_bodies = 0;
+
+    // one element per line: a larger reservation count cannot come from a valid model
+    const std::size_t num_lines = static_cast<std::size_t>(std::count(text.begin(), text.end(), '\n')) + 1;
+
+    std::size_t number = 0;
+    std::size_t begin = 0;
+    while(begin < text.size())
+    {
+        std::size_t end = text.find('\n', begin);
+        if(end == std::string_view::npos)
+            end = text.size();
+
+        LineReader reader{text.substr(begin, end - begin), ++number};
+        begin = end + 1;
+
+        if(reader.blank())
+            continue;
+
+        const std::string_view keyword = reader.token();
+        if(keyword == "body")
+        {
+            const long int id = reader.integer();
+            const Eigen::Vector3d r = reader.vector3();
+            const Eigen::Vector4d e = reader.vector4();
+            mbs.addBody(Body{id, r(0), r(1), r(2), e(0), e(1), e(2), e(3)});
+            num_bodies++;
+        }
+        else if(keyword == "bodies" || keyword == "constraints")
+        {
+            const long int count = reader.integer();
+            if(count < 0)
+                reader.fail("negative count");
+            if(static_cast<unsigned long>(count) > num_lines)
+                reader.fail("count exceeds the number of lines");
+            if(keyword == "bodies")
+                mbs.reserve(static_cast<std::size_t>(count), 0);
+            else
+                constraints.reserve(static_cast<std::size_t>(count));
+        }
+        else
+        {
+            constraints.push_back(read_constraint(keyword, reader, drivers));
+        }
+
+        reader.end();
+    }
+
+    mbs.reserve(num_bodies, constraints.size());
+    for(auto& constraint : constraints)
+    {
+        mbs.addConstraint(std::move(constraint));
+    }
+    mbs.finalize();
+
+    return mbs;
+}
+
+MultibodySystem load_model(const std::string& path, const DriverRegistry& drivers)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if(!file)
+        throw std::runtime_error("Cannot open model file: " + path);
+
+    // whole file in one read
+    std::string text(static_cast<std::size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    if(!file.read(text.data(), static_cast<std::streamsize>(text.size())))
+        throw std::runtime_error("Cannot read model file: " + path);
+
+    return parse_model(text, drivers);
+}
@@ -2,6 +2,9 @@
 #include <algorithm>
 #include <memory>
 #include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <variant>
 
 MultibodySystem::MultibodySystem() = default;
 
@@ -9,10 +12,38 @@ void MultibodySystem::addBody(const Body& body)
 {
     bodies.push_back(body);
     body_ids.push_back(body.getId());
+    body_index.emplace(body.getId(), static_cast<std::int32_t>(bodies.size() - 1));
 }
 
 void MultibodySystem::addConstraint(const Constraint& constraint) {
-    constraints.push_back(constraint.clone());
+    constraints.push_back(make_constraint_variant(constraint));
+    if(!resolveConstraint(constraints.size() - 1))
+        unresolved.push_back(constraints.size() - 1);
+}
+
+void MultibodySystem::addConstraint(ConstraintVariant&& constraint)
+{
+    constraints.push_back(std::move(constraint));
+    if(!resolveConstraint(constraints.size() - 1))
+        unresolved.push_back(constraints.size() - 1);
+}
+
+bool MultibodySystem::resolveConstraint(std::size_t k)
+{
+    // a user constraint shared with another system (or a copy of this one) gets its own
+    // instance first, so that resolving never changes the indices seen by the other owner
+    auto* shared = std::get_if<std::shared_ptr<Constraint>>(&constraints[k]);
+    if(shared && shared->use_count() > 1)
+        *shared = (*shared)->clone();
+    return resolve_bodies(constraints[k], body_index);
+}
+
+void MultibodySystem::reserve(std::size_t num_bodies, std::size_t num_constraints)
+{
+    bodies.reserve(num_bodies);
+    body_ids.reserve(num_bodies);
+    body_index.reserve(num_bodies);
+    constraints.reserve(num_constraints);
 }
 
 int MultibodySystem::getNumBodies() const
@@ -25,7 +56,7 @@ int MultibodySystem::getNumConstraints() const
     int total_constraints = 0;
     for (const auto& constraint : constraints)
     {
-        total_constraints += constraint->equations_number();
+        total_constraints += equations_number(constraint);
     }
     return total_constraints;
 }
@@ -40,18 +71,42 @@ const std::vector<long int>& MultibodySystem::getBodyIds() const
     return body_ids;
 }
 
-const std::vector<std::shared_ptr<Constraint>>& MultibodySystem::getConstraints() const
+const std::vector<ConstraintVariant>& MultibodySystem::getConstraints() const
 {
     return constraints;
 }
 
-const Eigen::VectorXd& MultibodySystem::getBodyParameters(long int id) const
+const Eigen::Matrix<double, 7, 1>& MultibodySystem::getBodyParameters(long int id) const
 {
-    auto it = std::find(body_ids.begin(), body_ids.end(), id);
-    if (it == body_ids.end())
+    auto it = body_index.find(id);
+    if (it == body_index.end())
         throw std::runtime_error("Body ID not found");
-    int i = static_cast<int>(std::distance(body_ids.begin(), it));
-    return bodies[i].getPosition();
+    return bodies[it->second].getPosition();
+}
+
+std::int32_t MultibodySystem::getBodyIndex(long int id) const
+{
+    if(id == 0)
+        return ground_index;
+    auto it = body_index.find(id);
+    if (it == body_index.end())
+        throw std::runtime_error("Body ID not found");
+    return it->second;
+}
+
+void MultibodySystem::finalize()
+{
+    // only constraints added before their bodies are left; each is resolved once, here
+    std::size_t remaining = 0;
+    for(std::size_t k : unresolved)
+    {
+        if(!resolveConstraint(k))
+            unresolved[remaining++] = k;
+    }
+    unresolved.resize(remaining);
+
+    if(!unresolved.empty())
+        throw std::runtime_error("Constraint references a body that was not added to the system");
 }
 
 // State implementation
@@ -0,0 +1,23 @@
+#include "newton_control.hpp"
+#include <iostream>
+
+NewtonStage NewtonControl::next(double norm, int iterations, bool factorized)
+{
+    if(iterations > max_iterations)
+    {
+        std::cerr << "Newton solver did not converge after " << max_iterations << " iterations.\n";
+        return NewtonStage::done;
+    }
+
+    if(iterations > 0 && norm > divergence_norm)
+    {
+        std::cerr << "Newton solver diverged, norm is too high: " << norm << "\n";
+        return NewtonStage::done;
+    }
+
+    // NaN ends the step as well
+    if(!(norm > tolerance))
+        return NewtonStage::done;
+
+    return factorized ? NewtonStage::iterate : NewtonStage::refactorize;
+}
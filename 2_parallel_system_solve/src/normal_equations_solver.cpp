@@ -0,0 +1,296 @@
+#include "normal_equations_solver.hpp"
+#include <vector>
+#include <algorithm>
+#include <tuple>
+#include <stdexcept>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/OrderingMethods>
+#include "ensemble_solver.hpp"
+
+NormalEquationsSymbolic::NormalEquationsSymbolic(const Eigen::SparseMatrix<double>& jacobian_pattern)
+    : rows(static_cast<int>(jacobian_pattern.rows())), cols(static_cast<int>(jacobian_pattern.cols())),
+      jacobian_nonzeros(static_cast<std::size_t>(jacobian_pattern.nonZeros()))
+{
+    if(!jacobian_pattern.isCompressed())
+        throw std::runtime_error("Jacobian pattern must be compressed");
+
+    const int* outer = jacobian_pattern.outerIndexPtr();
+    const int* inner = jacobian_pattern.innerIndexPtr();
+
+    // Row-wise view of J: columns and value positions of every row
+    std::vector<int> row_outer(rows + 1, 0);
+    for(int p = 0; p < outer[cols]; p++)
+        row_outer[inner[p] + 1]++;
+    for(int r = 0; r < rows; r++)
+        row_outer[r + 1] += row_outer[r];
+
+    std::vector<int> row_cols(outer[cols]), row_values(outer[cols]);
+    std::vector<int> fill(row_outer.begin(), row_outer.end() - 1);
+    for(int c = 0; c < cols; c++)
+    {
+        for(int p = outer[c]; p < outer[c + 1]; p++)
+        {
+            row_cols[fill[inner[p]]] = c;
+            row_values[fill[inner[p]]++] = p;
+        }
+    }
+
+    // Fill-reducing ordering of the full J^T J pattern
+    std::vector<Eigen::Triplet<double>> triplets;
+    for(int c = 0; c < cols; c++)
+        triplets.emplace_back(c, c, 1.0);
+    for(int r = 0; r < rows; r++)
+    {
+        for(int a = row_outer[r]; a < row_outer[r + 1]; a++)
+            for(int b = row_outer[r]; b < row_outer[r + 1]; b++)
+                triplets.emplace_back(row_cols[a], row_cols[b], 1.0);
+    }
+    Eigen::SparseMatrix<double> normal_pattern(cols, cols);
+    normal_pattern.setFromTriplets(triplets.begin(), triplets.end());
+
+    Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> ordering;
+    Eigen::AMDOrdering<int> amd;
+    amd(normal_pattern, ordering);
+
+    perm.assign(ordering.indices().data(), ordering.indices().data() + cols);
+    inverse_perm.resize(cols);
+    for(int k = 0; k < cols; k++)
+        inverse_perm[perm[k]] = k;
+
+    // Upper triangle of the permuted J^T J; every product J(r,a) * J(r,b) gets its target entry
+    struct Product
+    {
+        int col, row, left, right;
+    };
+    std::vector<Product> products;
+    for(int c = 0; c < cols; c++)
+        products.push_back({c, c, -1, -1});
+    for(int r = 0; r < rows; r++)
+    {
+        for(int a = row_outer[r]; a < row_outer[r + 1]; a++)
+        {
+            for(int b = a; b < row_outer[r + 1]; b++)
+            {
+                const int pa = inverse_perm[row_cols[a]];
+                const int pb = inverse_perm[row_cols[b]];
+                products.push_back({std::max(pa, pb), std::min(pa, pb), row_values[a], row_values[b]});
+            }
+        }
+    }
+    std::sort(products.begin(), products.end(), [](const Product& x, const Product& y)
+    {
+        return std::tie(x.col, x.row) < std::tie(y.col, y.row);
+    });
+
+    a_outer.assign(cols + 1, 0);
+    a_diagonal.resize(cols);
+    for(std::size_t k = 0; k < products.size(); k++)
+    {
+        const auto& product = products[k];
+        if(k == 0 || product.col != products[k - 1].col || product.row != products[k - 1].row)
+        {
+            a_inner.push_back(product.row);
+            a_outer[product.col + 1]++;
+            if(product.row == product.col)
+                a_diagonal[product.col] = static_cast<int>(a_inner.size()) - 1;
+        }
+        if(product.left >= 0)
+        {
+            product_target.push_back(static_cast<int>(a_inner.size()) - 1);
+            product_left.push_back(product.left);
+            product_right.push_back(product.right);
+        }
+    }
+    for(int c = 0; c < cols; c++)
+        a_outer[c + 1] += a_outer[c];
+
+    // Elimination tree and column counts of L (LDL symbolic phase)
+    parent.assign(cols, -1);
+    std::vector<int> flag(cols), l_count(cols, 0);
+    for(int k = 0; k < cols; k++)
+    {
+        flag[k] = k;
+        for(int p = a_outer[k]; p < a_outer[k + 1]; p++)
+        {
+            for(int i = a_inner[p]; i < k && flag[i] != k; i = parent[i])
+            {
+                if(parent[i] == -1)
+                    parent[i] = k;
+                l_count[i]++;
+                flag[i] = k;
+            }
+        }
+    }
+
+    l_outer.assign(cols + 1, 0);
+    for(int k = 0; k < cols; k++)
+        l_outer[k + 1] = l_outer[k] + l_count[k];
+}
+
+template<int W>
+NormalEquationsLanes<W>::NormalEquationsLanes(const NormalEquationsSymbolic& symbolic, double regularization)
+    : symbolic(symbolic), regularization(regularization),
+      a_values(symbolic.a_inner.size() * W), l_inner(symbolic.l_outer.back()),
+      l_values(static_cast<std::size_t>(symbolic.l_outer.back()) * W), d(static_cast<std::size_t>(symbolic.cols) * W),
+      y(static_cast<std::size_t>(symbolic.cols) * W), pattern(symbolic.cols), flag(symbolic.cols), l_count(symbolic.cols),
+      x_perm(static_cast<std::size_t>(symbolic.cols) * W)
+{
+}
+
+template<int W>
+bool NormalEquationsLanes<W>::factorize(const double* jacobian, int num_systems)
+{
+    const int n = symbolic.cols;
+
+    std::fill(a_values.begin(), a_values.end(), 0.0);
+    for(std::size_t k = 0; k < symbolic.product_target.size(); k++)
+    {
+        double* target = a_values.data() + static_cast<std::size_t>(symbolic.product_target[k]) * W;
+        const double* left = jacobian + static_cast<std::size_t>(symbolic.product_left[k]) * W;
+        const double* right = jacobian + static_cast<std::size_t>(symbolic.product_right[k]) * W;
+        for(int s = 0; s < W; s++)
+            target[s] += left[s] * right[s];
+    }
+
+    double max_diagonal[W] = {};
+    for(int k = 0; k < n; k++)
+        for(int s = 0; s < W; s++)
+            max_diagonal[s] = std::max(max_diagonal[s], a_values[symbolic.a_diagonal[k] * W + s]);
+    for(int s = 0; s < W; s++)
+    {
+        const double mu = regularization * std::max(max_diagonal[s], 1.0);
+        for(int k = 0; k < n; k++)
+            a_values[symbolic.a_diagonal[k] * W + s] += mu;
+    }
+
+    // LDL numeric phase (up-looking, row pattern from the elimination tree); the pattern
+    // depends on the structure only, the arithmetic runs over all systems
+    const auto& a_outer = symbolic.a_outer;
+    const auto& a_inner = symbolic.a_inner;
+    const auto& parent = symbolic.parent;
+    const auto& l_outer = symbolic.l_outer;
+
+    bool success = true;
+    for(int k = 0; k < n; k++)
+    {
+        for(int s = 0; s < W; s++)
+            y[k * W + s] = 0.0;
+        int top = n;
+        flag[k] = k;
+        l_count[k] = 0;
+
+        for(int p = a_outer[k]; p < a_outer[k + 1]; p++)
+        {
+            int i = a_inner[p];
+            for(int s = 0; s < W; s++)
+                y[i * W + s] += a_values[p * W + s];
+            int len = 0;
+            for(; flag[i] != k; i = parent[i])
+            {
+                pattern[len++] = i;
+                flag[i] = k;
+            }
+            while(len > 0)
+                pattern[--top] = pattern[--len];
+        }
+
+        for(int s = 0; s < W; s++)
+        {
+            d[k * W + s] = y[k * W + s];
+            y[k * W + s] = 0.0;
+        }
+        for(; top < n; top++)
+        {
+            const int i = pattern[top];
+            double yi[W];
+            for(int s = 0; s < W; s++)
+            {
+                yi[s] = y[i * W + s];
+                y[i * W + s] = 0.0;
+            }
+
+            int p = l_outer[i];
+            const int p2 = l_outer[i] + l_count[i];
+            for(; p < p2; p++)
+            {
+                const int row = l_inner[p];
+                for(int s = 0; s < W; s++)
+                    y[row * W + s] -= l_values[p * W + s] * yi[s];
+            }
+
+            for(int s = 0; s < W; s++)
+            {
+                const double l_ki = yi[s] / d[i * W + s];
+                d[k * W + s] -= l_ki * yi[s];
+                l_values[p * W + s] = l_ki;
+            }
+            l_inner[p] = k;
+            l_count[i]++;
+        }
+
+        for(int s = 0; s < num_systems; s++)
+            success = success && d[k * W + s] != 0.0;
+    }
+
+    return success;
+}
+
+template<int W>
+void NormalEquationsLanes<W>::solve(const int* outer, const int* inner, const double* jacobian, const double* b, double* x)
+{
+    const int n = symbolic.cols;
+    const auto& l_outer = symbolic.l_outer;
+    const auto& inverse_perm = symbolic.inverse_perm;
+
+    // permuted right-hand side J^T b
+    for(int c = 0; c < n; c++)
+    {
+        double sum[W] = {};
+        for(int p = outer[c]; p < outer[c + 1]; p++)
+            for(int s = 0; s < W; s++)
+                sum[s] += jacobian[p * W + s] * b[inner[p] * W + s];
+        for(int s = 0; s < W; s++)
+            x_perm[inverse_perm[c] * W + s] = sum[s];
+    }
+
+    for(int j = 0; j < n; j++)
+        for(int p = l_outer[j]; p < l_outer[j + 1]; p++)
+            for(int s = 0; s < W; s++)
+                x_perm[l_inner[p] * W + s] -= l_values[p * W + s] * x_perm[j * W + s];
+
+    for(int j = 0; j < n; j++)
+        for(int s = 0; s < W; s++)
+            x_perm[j * W + s] /= d[j * W + s];
+
+    for(int j = n - 1; j >= 0; j--)
+        for(int p = l_outer[j]; p < l_outer[j + 1]; p++)
+            for(int s = 0; s < W; s++)
+                x_perm[j * W + s] -= l_values[p * W + s] * x_perm[l_inner[p] * W + s];
+
+    for(int c = 0; c < n; c++)
+        for(int s = 0; s < W; s++)
+            x[c * W + s] = x_perm[inverse_perm[c] * W + s];
+}
+
+template class NormalEquationsLanes<1>;
+template class NormalEquationsLanes<ensemble_width>;
+
+NormalEquationsSolver::NormalEquationsSolver(const NormalEquationsSymbolic& symbolic, double regularization)
+    : symbolic(symbolic), lanes(symbolic, regularization)
+{
+}
+
+bool NormalEquationsSolver::factorize(const Eigen::SparseMatrix<double>& J)
+{
+    if(static_cast<std::size_t>(J.nonZeros()) != symbolic.jacobian_nonzeros)
+        return false;
+
+    return lanes.factorize(J.valuePtr());
+}
+
+void NormalEquationsSolver::solve(const Eigen::SparseMatrix<double>& J, const Eigen::VectorXd& b, Eigen::VectorXd& x)
+{
+    x.resize(symbolic.cols);
+    lanes.solve(J.outerIndexPtr(), J.innerIndexPtr(), J.valuePtr(), b.data(), x.data());
+}
@@ -0,0 +1,182 @@
+#include "numa_solver.hpp"
+#include <vector>
+#include <memory>
+#include <map>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+#include <oneapi/tbb.h>
+
+#include "multibody_solver.hpp"
+#include "system_scheduler.hpp"
+
+NumaBatch::NumaBatch(const std::vector<CompiledSystem>& systems, int block_size)
+    : home(systems.size()), budgets(systems.size(), 1), local_systems(systems.size()), sessions(systems.size())
+{
+    // without tbbbind (or on a single node) this is one unconstrained arena
+    const auto node_ids = oneapi::tbb::info::numa_nodes();
+
+    std::vector<double> capacity;
+    for(const auto id : node_ids)
+    {
+        auto node = std::make_unique<Node>();
+        node->arena.initialize(oneapi::tbb::task_arena::constraints{id});
+        capacity.push_back(std::max(1, oneapi::tbb::info::default_concurrency(id)));
+        nodes.push_back(std::move(node));
+    }
+
+    // most expensive first, each to the node that would finish it earliest
+    std::vector<double> costs(systems.size());
+    for(std::size_t i = 0; i < systems.size(); i++)
+        costs[i] = system_cost(systems[i]);
+
+    std::vector<std::size_t> order(systems.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return costs[a] > costs[b]; });
+
+    std::vector<double> load(nodes.size(), 0.0);
+    for(const std::size_t i : order)
+    {
+        std::size_t best = 0;
+        for(std::size_t n = 1; n < nodes.size(); n++)
+        {
+            if((load[n] + costs[i]) / capacity[n] < (load[best] + costs[i]) / capacity[best])
+                best = n;
+        }
+        load[best] += costs[i];
+        home[i] = static_cast<int>(best);
+        nodes[best]->systems.push_back(i);
+    }
+
+    // threads of a node shared by its systems by cost; one low-priority arena per budget,
+    // bound to the node, with the sum of the budgets of its systems as concurrency
+    for(std::size_t n = 0; n < nodes.size(); n++)
+    {
+        Node& node = *nodes[n];
+        std::vector<double> node_costs;
+        for(const std::size_t i : node.systems)
+            node_costs.push_back(costs[i]);
+        const std::vector<int> node_budgets = thread_budgets(node_costs, static_cast<int>(capacity[n]));
+
+        std::map<int, int> arena_threads, arena_systems;
+        for(std::size_t k = 0; k < node.systems.size(); k++)
+        {
+            budgets[node.systems[k]] = node_budgets[k];
+            arena_threads[node_budgets[k]] += node_budgets[k];
+            arena_systems[node_budgets[k]]++;
+        }
+        for(const auto& [budget, threads] : arena_threads)
+        {
+            const int concurrency = std::min(threads, static_cast<int>(capacity[n]));
+            oneapi::tbb::task_arena::constraints constraints{node_ids[n]};
+            constraints.set_max_concurrency(concurrency);
+            node.inner[budget] = std::make_unique<oneapi::tbb::task_arena>(
+                constraints, std::min(arena_systems[budget], concurrency), oneapi::tbb::task_arena::priority::low);
+        }
+    }
+
+    // first touch: compiled data and session buffers are written by threads of the home node
+    for(auto& node : nodes)
+    {
+        node->arena.execute([&]()
+        {
+            oneapi::tbb::parallel_for(std::size_t{0}, node->systems.size(), [&](std::size_t k)
+            {
+                const std::size_t i = node->systems[k];
+                local_systems[i] = std::make_unique<CompiledSystem>(systems[i]);
+                sessions[i] = std::make_unique<SolverSession>(*local_systems[i], block_size);
+            });
+        });
+    }
+}
+
+bool NumaBatch::take(std::size_t node, std::size_t& system, bool& remote)
+{
+    // own systems first, other nodes only when none are left
+    for(std::size_t k = 0; k < nodes.size(); k++)
+    {
+        Node& source = *nodes[(node + k) % nodes.size()];
+        if(source.next.load(std::memory_order_relaxed) >= source.systems.size())
+            continue;
+
+        const std::size_t index = source.next.fetch_add(1, std::memory_order_relaxed);
+        if(index < source.systems.size())
+        {
+            system = source.systems[index];
+            remote = k != 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::vector<State>> NumaBatch::solve(double end_time)
+{
+    std::vector<std::vector<State>> results(sessions.size());
+    stolen = 0;
+    for(auto& node : nodes)
+        node->next = 0;
+
+    std::vector<oneapi::tbb::task_group> groups(nodes.size());
+    for(std::size_t n = 0; n < nodes.size(); n++)
+    {
+        nodes[n]->arena.execute([&, n]()
+        {
+            groups[n].run([&, n]()
+            {
+                // one worker loop per thread of the node; an own system's Jacobian runs in the
+                // arena of its budget, a stolen one in this node's arena
+                const int slots = nodes[n]->arena.max_concurrency();
+                oneapi::tbb::parallel_for(0, slots, [&, n](int)
+                {
+                    std::size_t i;
+                    bool remote;
+                    while(take(n, i, remote))
+                    {
+                        if(remote)
+                        {
+                            stolen++;
+                            results[i] = multibody_solver(*sessions[i], end_time);
+                            continue;
+                        }
+
+                        nodes[n]->inner.at(budgets[i])->execute([&]()
+                        {
+                            results[i] = multibody_solver(*sessions[i], end_time);
+                        });
+                    }
+                });
+            });
+        });
+    }
+
+    for(std::size_t n = 0; n < nodes.size(); n++)
+    {
+        nodes[n]->arena.execute([&, n]()
+        {
+            groups[n].wait();
+        });
+    }
+
+    return results;
+}
+
+int NumaBatch::getNumNodes() const
+{
+    return static_cast<int>(nodes.size());
+}
+
+int NumaBatch::getNode(std::size_t system) const
+{
+    return home[system];
+}
+
+int NumaBatch::getBudget(std::size_t system) const
+{
+    return budgets[system];
+}
+
+std::size_t NumaBatch::getNumStolen() const
+{
+    return stolen.load();
+}
@@ -0,0 +1,251 @@
+#include "process_solver.hpp"
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <eigen3/Eigen/Dense>
+#include <oneapi/tbb.h>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "solver_session.hpp"
+#include "multibody_solver.hpp"
+#include "system_scheduler.hpp"
+
+SharedTrajectories::SharedTrajectories(const std::vector<CompiledSystem>& systems, double end_time)
+{
+    const std::vector<double> times = time_steps(end_time);
+    num_steps = times.size();
+
+    std::size_t size = num_steps;
+    for(const auto& system : systems)
+    {
+        offsets.push_back(size);
+        sizes.push_back(system.getNumCoordinates());
+        size += num_steps * system.getNumCoordinates();
+    }
+
+    bytes = size * sizeof(double);
+    if(bytes == 0)
+        return;
+
+    // shared with the children created by fork, which write their results straight into it
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(mapping == MAP_FAILED)
+        throw std::runtime_error(std::string("Failed to map trajectory region: ") + std::strerror(errno));
+
+    data = static_cast<double*>(mapping);
+    std::copy(times.begin(), times.end(), data);
+}
+
+SharedTrajectories::~SharedTrajectories()
+{
+    release();
+}
+
+SharedTrajectories::SharedTrajectories(SharedTrajectories&& other) noexcept
+    : data(std::exchange(other.data, nullptr)), bytes(std::exchange(other.bytes, 0)),
+      num_steps(std::exchange(other.num_steps, 0)), offsets(std::move(other.offsets)), sizes(std::move(other.sizes)),
+      num_unpinned(std::exchange(other.num_unpinned, 0))
+{
+}
+
+SharedTrajectories& SharedTrajectories::operator=(SharedTrajectories&& other) noexcept
+{
+    if(this != &other)
+    {
+        release();
+        data = std::exchange(other.data, nullptr);
+        bytes = std::exchange(other.bytes, 0);
+        num_steps = std::exchange(other.num_steps, 0);
+        offsets = std::move(other.offsets);
+        sizes = std::move(other.sizes);
+        num_unpinned = std::exchange(other.num_unpinned, 0);
+    }
+    return *this;
+}
+
+void SharedTrajectories::release()
+{
+    if(data)
+        munmap(data, bytes);
+    data = nullptr;
+    bytes = 0;
+}
+
+std::size_t SharedTrajectories::getNumSystems() const
+{
+    return offsets.size();
+}
+
+std::size_t SharedTrajectories::getNumSteps() const
+{
+    return num_steps;
+}
+
+double SharedTrajectories::getTime(std::size_t step) const
+{
+    return data[step];
+}
+
+Eigen::Map<Eigen::VectorXd> SharedTrajectories::getQ(std::size_t system, std::size_t step)
+{
+    return Eigen::Map<Eigen::VectorXd>(data + offsets[system] + step * sizes[system], sizes[system]);
+}
+
+Eigen::Map<const Eigen::VectorXd> SharedTrajectories::getQ(std::size_t system, std::size_t step) const
+{
+    return Eigen::Map<const Eigen::VectorXd>(data + offsets[system] + step * sizes[system], sizes[system]);
+}
+
+std::vector<State> SharedTrajectories::getStates(std::size_t system) const
+{
+    std::vector<State> states;
+    states.reserve(num_steps);
+    for(std::size_t k = 0; k < num_steps; k++)
+        states.emplace_back(getQ(system, k), getTime(k));
+    return states;
+}
+
+std::size_t SharedTrajectories::getNumUnpinned() const
+{
+    return num_unpinned;
+}
+
+namespace
+{
+    // exit status of a child that solved its shard without being pinned to its CPUs
+    constexpr int unpinned_status = 2;
+
+    // Contiguous share of the CPUs the parent may run on; neighbouring cores usually share a socket
+    cpu_set_t process_cpus(const std::vector<int>& cpus, int process, int num_processes)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        const std::size_t begin = cpus.size() * process / num_processes;
+        const std::size_t end = cpus.size() * (process + 1) / num_processes;
+        for(std::size_t k = begin; k < end; k++)
+            CPU_SET(cpus[k], &set);
+
+        // more processes than CPUs: processes share them round-robin
+        if(begin == end && !cpus.empty())
+            CPU_SET(cpus[process % cpus.size()], &set);
+        return set;
+    }
+
+    void solve_shard(const std::vector<CompiledSystem>& systems, const std::vector<std::size_t>& shard,
+                     double end_time, int block_size, SharedTrajectories& trajectories)
+    {
+        oneapi::tbb::parallel_for(std::size_t{0}, shard.size(), [&](std::size_t k)
+        {
+            const std::size_t i = shard[k];
+            SolverSession session{systems[i], block_size};
+
+            // the same grid as SharedTrajectories, so step k of the solution is step k of the region
+            const std::vector<State> states = multibody_solver(session, end_time);
+            for(std::size_t step = 0; step < states.size(); step++)
+                trajectories.getQ(i, step) = states[step].getQ();
+        });
+    }
+}
+
+SharedTrajectories process_solver(const std::vector<CompiledSystem>& systems, double end_time, int num_processes,
+                                  int block_size)
+{
+    if(num_processes < 1)
+        throw std::runtime_error("At least one worker process is needed");
+
+    SharedTrajectories trajectories{systems, end_time};
+
+    // most expensive systems first, each to the least loaded process
+    std::vector<std::size_t> order(systems.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+    {
+        return system_cost(systems[a]) > system_cost(systems[b]);
+    });
+
+    std::vector<std::vector<std::size_t>> shards(num_processes);
+    std::vector<double> load(num_processes, 0.0);
+    for(const std::size_t i : order)
+    {
+        const auto p = std::min_element(load.begin(), load.end()) - load.begin();
+        load[p] += system_cost(systems[i]);
+        shards[p].push_back(i);
+    }
+
+    cpu_set_t parent_set;
+    CPU_ZERO(&parent_set);
+    if(sched_getaffinity(0, sizeof(parent_set), &parent_set) != 0)
+        throw std::runtime_error(std::string("Failed to read CPU affinity: ") + std::strerror(errno));
+
+    std::vector<int> cpus;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if(CPU_ISSET(cpu, &parent_set))
+            cpus.push_back(cpu);
+    }
+
+    // TBB worker threads would not survive fork; wait until they are gone
+    oneapi::tbb::task_scheduler_handle handle{oneapi::tbb::attach{}};
+    if(!oneapi::tbb::finalize(handle, std::nothrow))
+        throw std::runtime_error("TBB scheduler is still in use, worker processes cannot be forked");
+
+    std::vector<pid_t> children;
+    for(int p = 0; p < num_processes; p++)
+    {
+        const pid_t pid = fork();
+        if(pid < 0)
+        {
+            for(const pid_t child : children)
+                waitpid(child, nullptr, 0);
+            throw std::runtime_error(std::string("Failed to fork a worker process: ") + std::strerror(errno));
+        }
+
+        if(pid == 0)
+        {
+            // the child has its own scheduler and heap; the default concurrency follows the affinity mask
+            int status = 0;
+            try
+            {
+                // an unpinned child still solves its shard, the parent only counts it
+                const cpu_set_t set = process_cpus(cpus, p, num_processes);
+                if(sched_setaffinity(0, sizeof(set), &set) != 0)
+                    status = unpinned_status;
+                solve_shard(systems, shards[p], end_time, block_size, trajectories);
+            }
+            catch(...)
+            {
+                status = 1;
+            }
+            _exit(status);
+        }
+
+        children.push_back(pid);
+    }
+
+    bool failed = false;
+    for(const pid_t child : children)
+    {
+        int status = 0;
+        if(waitpid(child, &status, 0) < 0 || !WIFEXITED(status))
+            failed = true;
+        else if(WEXITSTATUS(status) == unpinned_status)
+            trajectories.num_unpinned++;
+        else if(WEXITSTATUS(status) != 0)
+            failed = true;
+    }
+
+    if(failed)
+        throw std::runtime_error("A worker process failed");
+
+    return trajectories;
+}
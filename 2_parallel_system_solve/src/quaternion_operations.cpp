@@ -1,51 +1,52 @@
 #include <eigen3/Eigen/Dense>
 #include "quaternion_operations.hpp"
 
-Eigen::MatrixXd L(Eigen::Map<const Eigen::VectorXd> e)
+Eigen::Matrix<double, 3, 4> L(const Eigen::Ref<const Eigen::Vector4d>& e)
 {
-    Eigen::MatrixXd L(3, 4);
+    Eigen::Matrix<double, 3, 4> L;
     
-    L(1, 0) = -e(1);
-    L(1, 1) = e(0);
-    L(1, 2) = -e(3);
-    L(1, 3) = e(2);
+    L(0, 0) = -e(1);
+    L(0, 1) = e(0);
+    L(0, 2) = -e(3);
+    L(0, 3) = e(2);
     
-    L(2, 0) = -e(2);
-    L(2, 1) = e(3);
-    L(2, 2) = e(0);
-    L(2, 3) = -e(1);
+    L(1, 0) = -e(2);
+    L(1, 1) = e(3);
+    L(1, 2) = e(0);
+    L(1, 3) = -e(1);
     
-    L(3, 0) = -e(3);
-    L(3, 1) = -e(2);
-    L(3, 2) = e(1);
-    L(3, 3) = e(0);
+    L(2, 0) = -e(3);
+    L(2, 1) = -e(2);
+    L(2, 2) = e(1);
+    L(2, 3) = e(0);
 
     return L;
 }
 
-Eigen::MatrixXd E(Eigen::Map<const Eigen::VectorXd> e)
+Eigen::Matrix<double, 3, 4> E(const Eigen::Ref<const Eigen::Vector4d>& e)
 {
-    Eigen::MatrixXd L(3, 4);
+    Eigen::Matrix<double, 3, 4> L;
     
-    L(1, 0) = -e(1);
-    L(1, 1) = e(0);
-    L(1, 2) = e(3);
-    L(1, 3) = -e(2);
+    L(0, 0) = -e(1);
+    L(0, 1) = e(0);
+    L(0, 2) = e(3);
+    L(0, 3) = -e(2);
     
-    L(2, 0) = -e(2);
-    L(2, 1) = -e(3);
-    L(2, 2) = e(0);
-    L(2, 3) = e(1);
+    L(1, 0) = -e(2);
+    L(1, 1) = -e(3);
+    L(1, 2) = e(0);
+    L(1, 3) = e(1);
     
-    L(3, 0) = -e(3);
-    L(3, 1) = e(2);
-    L(3, 2) = -e(1);
-    L(3, 3) = e(0);
+    L(2, 0) = -e(3);
+    L(2, 1) = e(2);
+    L(2, 2) = -e(1);
+    L(2, 3) = e(0);
 
     return L;
 }
 
-Eigen::Matrix3d R(Eigen::Map<const Eigen::VectorXd> q) {
-    Eigen::Quaterniond quat(q[0], q[1], q[2], q[3]); // assuming q = [x, y, z, w]
-    return quat.toRotationMatrix();
+Eigen::Matrix3d R(const Eigen::Ref<const Eigen::Vector4d>& q) {
+    Eigen::Matrix3d m; // q = [w, x, y, z]
+    rotation_matrix(q[0], q[1], q[2], q[3], m.data());
+    return m;
 }
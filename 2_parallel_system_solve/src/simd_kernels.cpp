@@ -0,0 +1,278 @@
+#include "simd_kernels.hpp"
+#include "quaternion_operations.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SIMD_KERNELS_X86 1
+#endif
+
+// Every variant evaluates the expressions of rotation_matrix() (the scalar one calls it) and
+// r + R * p with explicit parentheses, in the same order; see rotation_matrix() for why this
+// file is built without FMA contraction. Gathers use the masked forms with a zero source,
+// which the unmasked ones leave undefined.
+
+namespace
+{
+    void rotation_matrices_scalar(const double* quaternions, std::size_t stride, std::size_t count, double* rotations)
+    {
+        for(std::size_t k = 0; k < count; k++)
+        {
+            const double* e = quaternions + k * stride;
+            double* m = rotations + k * 9;
+            rotation_matrix(e[0], e[1], e[2], e[3], m);
+        }
+    }
+
+    void transform_points_scalar(const double* rotations, const double* positions, const std::int32_t* body,
+                                 const double* points, std::size_t count, double* out)
+    {
+        for(std::size_t k = 0; k < count; k++)
+        {
+            const double* m = rotations + static_cast<std::ptrdiff_t>(body[k]) * 9;
+            const double* r = positions + static_cast<std::ptrdiff_t>(body[k]) * 3;
+            const double* p = points + k * 3;
+
+            out[k * 3 + 0] = r[0] + ((m[0] * p[0] + m[3] * p[1]) + m[6] * p[2]);
+            out[k * 3 + 1] = r[1] + ((m[1] * p[0] + m[4] * p[1]) + m[7] * p[2]);
+            out[k * 3 + 2] = r[2] + (m[2] * p[0] + (m[5] * p[1] + m[8] * p[2]));
+        }
+    }
+
+#if defined(SIMD_KERNELS_X86)
+    __attribute__((target("avx2")))
+    void rotation_matrices_avx2(const double* quaternions, std::size_t stride, std::size_t count, double* rotations)
+    {
+        const std::int32_t s = static_cast<std::int32_t>(stride);
+        const __m128i lanes = _mm_setr_epi32(0, s, 2 * s, 3 * s);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d two = _mm256_set1_pd(2.0);
+
+        std::size_t k = 0;
+        for(; k + 4 <= count; k += 4)
+        {
+            const double* e = quaternions + k * stride;
+            const __m256d w = _mm256_mask_i32gather_pd(zero, e + 0, lanes, all, 8);
+            const __m256d x = _mm256_mask_i32gather_pd(zero, e + 1, lanes, all, 8);
+            const __m256d y = _mm256_mask_i32gather_pd(zero, e + 2, lanes, all, 8);
+            const __m256d z = _mm256_mask_i32gather_pd(zero, e + 3, lanes, all, 8);
+
+            const __m256d tx = _mm256_mul_pd(two, x), ty = _mm256_mul_pd(two, y), tz = _mm256_mul_pd(two, z);
+            const __m256d twx = _mm256_mul_pd(tx, w), twy = _mm256_mul_pd(ty, w), twz = _mm256_mul_pd(tz, w);
+            const __m256d txx = _mm256_mul_pd(tx, x), txy = _mm256_mul_pd(ty, x), txz = _mm256_mul_pd(tz, x);
+            const __m256d tyy = _mm256_mul_pd(ty, y), tyz = _mm256_mul_pd(tz, y), tzz = _mm256_mul_pd(tz, z);
+
+            alignas(32) double m[9][4];
+            _mm256_store_pd(m[0], _mm256_sub_pd(one, _mm256_add_pd(tyy, tzz)));
+            _mm256_store_pd(m[1], _mm256_add_pd(txy, twz));
+            _mm256_store_pd(m[2], _mm256_sub_pd(txz, twy));
+            _mm256_store_pd(m[3], _mm256_sub_pd(txy, twz));
+            _mm256_store_pd(m[4], _mm256_sub_pd(one, _mm256_add_pd(txx, tzz)));
+            _mm256_store_pd(m[5], _mm256_add_pd(tyz, twx));
+            _mm256_store_pd(m[6], _mm256_add_pd(txz, twy));
+            _mm256_store_pd(m[7], _mm256_sub_pd(tyz, twx));
+            _mm256_store_pd(m[8], _mm256_sub_pd(one, _mm256_add_pd(txx, tyy)));
+
+            for(int lane = 0; lane < 4; lane++)
+                for(int j = 0; j < 9; j++)
+                    rotations[(k + lane) * 9 + j] = m[j][lane];
+        }
+
+        rotation_matrices_scalar(quaternions + k * stride, stride, count - k, rotations + k * 9);
+    }
+
+    __attribute__((target("avx2")))
+    void transform_points_avx2(const double* rotations, const double* positions, const std::int32_t* body,
+                               const double* points, std::size_t count, double* out)
+    {
+        const __m128i point_lanes = _mm_setr_epi32(0, 3, 6, 9);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+        std::size_t k = 0;
+        for(; k + 4 <= count; k += 4)
+        {
+            const __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(body + k));
+            const __m128i matrix_lanes = _mm_mullo_epi32(index, _mm_set1_epi32(9));
+            const __m128i position_lanes = _mm_mullo_epi32(index, _mm_set1_epi32(3));
+
+            const double* p = points + k * 3;
+            const __m256d p0 = _mm256_mask_i32gather_pd(zero, p + 0, point_lanes, all, 8);
+            const __m256d p1 = _mm256_mask_i32gather_pd(zero, p + 1, point_lanes, all, 8);
+            const __m256d p2 = _mm256_mask_i32gather_pd(zero, p + 2, point_lanes, all, 8);
+
+            alignas(32) double result[3][4];
+            for(int i = 0; i < 3; i++)
+            {
+                const __m256d m0 = _mm256_mask_i32gather_pd(zero, rotations + i, matrix_lanes, all, 8);
+                const __m256d m1 = _mm256_mask_i32gather_pd(zero, rotations + 3 + i, matrix_lanes, all, 8);
+                const __m256d m2 = _mm256_mask_i32gather_pd(zero, rotations + 6 + i, matrix_lanes, all, 8);
+                const __m256d r = _mm256_mask_i32gather_pd(zero, positions + i, position_lanes, all, 8);
+
+                const __m256d a0 = _mm256_mul_pd(m0, p0), a1 = _mm256_mul_pd(m1, p1), a2 = _mm256_mul_pd(m2, p2);
+                const __m256d rotated = i < 2 ? _mm256_add_pd(_mm256_add_pd(a0, a1), a2)
+                                              : _mm256_add_pd(a0, _mm256_add_pd(a1, a2));
+                _mm256_store_pd(result[i], _mm256_add_pd(r, rotated));
+            }
+
+            for(int lane = 0; lane < 4; lane++)
+                for(int i = 0; i < 3; i++)
+                    out[(k + lane) * 3 + i] = result[i][lane];
+        }
+
+        transform_points_scalar(rotations, positions, body + k, points + k * 3, count - k, out + k * 3);
+    }
+
+    __attribute__((target("avx512f")))
+    void rotation_matrices_avx512(const double* quaternions, std::size_t stride, std::size_t count, double* rotations)
+    {
+        const std::int32_t s = static_cast<std::int32_t>(stride);
+        const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(s));
+        const __m256i out_lanes = _mm256_setr_epi32(0, 9, 18, 27, 36, 45, 54, 63);
+        const __m512d zero = _mm512_setzero_pd();
+        const __mmask8 all = 0xFF;
+        const __m512d one = _mm512_set1_pd(1.0);
+        const __m512d two = _mm512_set1_pd(2.0);
+
+        std::size_t k = 0;
+        for(; k + 8 <= count; k += 8)
+        {
+            const double* e = quaternions + k * stride;
+            const __m512d w = _mm512_mask_i32gather_pd(zero, all, lanes, e + 0, 8);
+            const __m512d x = _mm512_mask_i32gather_pd(zero, all, lanes, e + 1, 8);
+            const __m512d y = _mm512_mask_i32gather_pd(zero, all, lanes, e + 2, 8);
+            const __m512d z = _mm512_mask_i32gather_pd(zero, all, lanes, e + 3, 8);
+
+            const __m512d tx = _mm512_mul_pd(two, x), ty = _mm512_mul_pd(two, y), tz = _mm512_mul_pd(two, z);
+            const __m512d twx = _mm512_mul_pd(tx, w), twy = _mm512_mul_pd(ty, w), twz = _mm512_mul_pd(tz, w);
+            const __m512d txx = _mm512_mul_pd(tx, x), txy = _mm512_mul_pd(ty, x), txz = _mm512_mul_pd(tz, x);
+            const __m512d tyy = _mm512_mul_pd(ty, y), tyz = _mm512_mul_pd(tz, y), tzz = _mm512_mul_pd(tz, z);
+
+            double* m = rotations + k * 9;
+            _mm512_i32scatter_pd(m + 0, out_lanes, _mm512_sub_pd(one, _mm512_add_pd(tyy, tzz)), 8);
+            _mm512_i32scatter_pd(m + 1, out_lanes, _mm512_add_pd(txy, twz), 8);
+            _mm512_i32scatter_pd(m + 2, out_lanes, _mm512_sub_pd(txz, twy), 8);
+            _mm512_i32scatter_pd(m + 3, out_lanes, _mm512_sub_pd(txy, twz), 8);
+            _mm512_i32scatter_pd(m + 4, out_lanes, _mm512_sub_pd(one, _mm512_add_pd(txx, tzz)), 8);
+            _mm512_i32scatter_pd(m + 5, out_lanes, _mm512_add_pd(tyz, twx), 8);
+            _mm512_i32scatter_pd(m + 6, out_lanes, _mm512_add_pd(txz, twy), 8);
+            _mm512_i32scatter_pd(m + 7, out_lanes, _mm512_sub_pd(tyz, twx), 8);
+            _mm512_i32scatter_pd(m + 8, out_lanes, _mm512_sub_pd(one, _mm512_add_pd(txx, tyy)), 8);
+        }
+
+        rotation_matrices_scalar(quaternions + k * stride, stride, count - k, rotations + k * 9);
+    }
+
+    __attribute__((target("avx512f")))
+    void transform_points_avx512(const double* rotations, const double* positions, const std::int32_t* body,
+                                 const double* points, std::size_t count, double* out)
+    {
+        const __m256i point_lanes = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+        const __m512d zero = _mm512_setzero_pd();
+        const __mmask8 all = 0xFF;
+
+        std::size_t k = 0;
+        for(; k + 8 <= count; k += 8)
+        {
+            const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(body + k));
+            const __m256i matrix_lanes = _mm256_mullo_epi32(index, _mm256_set1_epi32(9));
+            const __m256i position_lanes = _mm256_mullo_epi32(index, _mm256_set1_epi32(3));
+
+            const double* p = points + k * 3;
+            const __m512d p0 = _mm512_mask_i32gather_pd(zero, all, point_lanes, p + 0, 8);
+            const __m512d p1 = _mm512_mask_i32gather_pd(zero, all, point_lanes, p + 1, 8);
+            const __m512d p2 = _mm512_mask_i32gather_pd(zero, all, point_lanes, p + 2, 8);
+
+            for(int i = 0; i < 3; i++)
+            {
+                const __m512d m0 = _mm512_mask_i32gather_pd(zero, all, matrix_lanes, rotations + i, 8);
+                const __m512d m1 = _mm512_mask_i32gather_pd(zero, all, matrix_lanes, rotations + 3 + i, 8);
+                const __m512d m2 = _mm512_mask_i32gather_pd(zero, all, matrix_lanes, rotations + 6 + i, 8);
+                const __m512d r = _mm512_mask_i32gather_pd(zero, all, position_lanes, positions + i, 8);
+
+                const __m512d a0 = _mm512_mul_pd(m0, p0), a1 = _mm512_mul_pd(m1, p1), a2 = _mm512_mul_pd(m2, p2);
+                const __m512d rotated = i < 2 ? _mm512_add_pd(_mm512_add_pd(a0, a1), a2)
+                                              : _mm512_add_pd(a0, _mm512_add_pd(a1, a2));
+                _mm512_i32scatter_pd(out + k * 3 + i, point_lanes, _mm512_add_pd(r, rotated), 8);
+            }
+        }
+
+        transform_points_scalar(rotations, positions, body + k, points + k * 3, count - k, out + k * 3);
+    }
+#endif
+
+    SimdLevel detect_level()
+    {
+#if defined(SIMD_KERNELS_X86)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f"))
+            return SimdLevel::avx512;
+        if(__builtin_cpu_supports("avx2"))
+            return SimdLevel::avx2;
+#endif
+        return SimdLevel::scalar;
+    }
+
+    std::atomic<SimdLevel>& active_level()
+    {
+        static std::atomic<SimdLevel> level{simd_supported_level()};
+        return level;
+    }
+}
+
+SimdLevel simd_supported_level()
+{
+    static const SimdLevel level = detect_level();
+    return level;
+}
+
+SimdLevel simd_level()
+{
+    return active_level().load(std::memory_order_relaxed);
+}
+
+void set_simd_level(SimdLevel level)
+{
+    if(static_cast<int>(level) > static_cast<int>(simd_supported_level()))
+        level = simd_supported_level();
+    active_level().store(level, std::memory_order_relaxed);
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    switch(level)
+    {
+        case SimdLevel::avx512: return "avx512";
+        case SimdLevel::avx2:   return "avx2";
+        default:                return "scalar";
+    }
+}
+
+void rotation_matrices(const double* quaternions, std::size_t stride, std::size_t count, double* rotations)
+{
+    switch(simd_level())
+    {
+#if defined(SIMD_KERNELS_X86)
+        case SimdLevel::avx512: rotation_matrices_avx512(quaternions, stride, count, rotations); break;
+        case SimdLevel::avx2:   rotation_matrices_avx2(quaternions, stride, count, rotations); break;
+#endif
+        default:                rotation_matrices_scalar(quaternions, stride, count, rotations); break;
+    }
+}
+
+void transform_points(const double* rotations, const double* positions, const std::int32_t* body,
+                      const double* points, std::size_t count, double* out)
+{
+    switch(simd_level())
+    {
+#if defined(SIMD_KERNELS_X86)
+        case SimdLevel::avx512: transform_points_avx512(rotations, positions, body, points, count, out); break;
+        case SimdLevel::avx2:   transform_points_avx2(rotations, positions, body, points, count, out); break;
+#endif
+        default:                transform_points_scalar(rotations, positions, body, points, count, out); break;
+    }
+}
@@ -0,0 +1,90 @@
+#include "solver_policies.hpp"
+#include <memory>
+#include <iostream>
+#include <algorithm>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+
+SparseQRSolve::SparseQRSolve(const CompiledSystem& system, LinearSolverType)
+    : system(system)
+{
+}
+
+void SparseQRSolve::factorize(const Eigen::SparseMatrix<double>& J)
+{
+    // the ordering is shared by all systems of this topology; only the elimination tree is per session
+    if(!ordering)
+    {
+        ordering = &system.getSymbolic().getColumnOrdering();
+        permuted = ordering->pattern;
+        qr.analyzePattern(permuted);
+    }
+
+    double* values = permuted.valuePtr();
+    for(std::size_t k = 0; k < ordering->value_source.size(); k++)
+        values[k] = J.valuePtr()[ordering->value_source[k]];
+    qr.factorize(permuted);
+
+    if (qr.info() != Eigen::Success) {
+        std::cerr << "Decomposition failed!\n";
+    }
+}
+
+void SparseQRSolve::solve(const Eigen::SparseMatrix<double>&, const Eigen::VectorXd& b, Eigen::VectorXd& delta_q)
+{
+    solution = qr.solve(b);
+
+    if (qr.info() != Eigen::Success) {
+        std::cerr << "Solving failed!\n";
+    }
+
+    // back to the order of the coordinates
+    for(Eigen::Index i = 0; i < delta_q.size(); i++)
+        delta_q(i) = solution(ordering->position[i]);
+}
+
+NormalEquationsSolve::NormalEquationsSolve(const CompiledSystem& system, LinearSolverType)
+    : system(system)
+{
+}
+
+void NormalEquationsSolve::factorize(const Eigen::SparseMatrix<double>& J)
+{
+    if(!solver)
+    {
+        // ordering and elimination structure are shared by all systems of this topology
+        solver = std::make_unique<NormalEquationsSolver>(system.getSymbolic().getNormalEquations());
+    }
+    if(!solver->factorize(J)) {
+        std::cerr << "Decomposition failed!\n";
+    }
+}
+
+void NormalEquationsSolve::solve(const Eigen::SparseMatrix<double>& J, const Eigen::VectorXd& b, Eigen::VectorXd& delta_q)
+{
+    solver->solve(J, b, delta_q);
+}
+
+RuntimeLinearSolve::RuntimeLinearSolve(const CompiledSystem& system, LinearSolverType type)
+{
+    if(type == LinearSolverType::sparse_qr)
+        qr = std::make_unique<SparseQRSolve>(system, type);
+    else
+        normal = std::make_unique<NormalEquationsSolve>(system, type);
+}
+
+void RuntimeLinearSolve::factorize(const Eigen::SparseMatrix<double>& J)
+{
+    if(qr)
+        qr->factorize(J);
+    else
+        normal->factorize(J);
+}
+
+void RuntimeLinearSolve::solve(const Eigen::SparseMatrix<double>& J, const Eigen::VectorXd& b, Eigen::VectorXd& delta_q)
+{
+    if(qr)
+        qr->solve(J, b, delta_q);
+    else
+        normal->solve(J, b, delta_q);
+}
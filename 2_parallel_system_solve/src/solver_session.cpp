@@ -0,0 +1,285 @@
+#include "solver_session.hpp"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <eigen3/Eigen/Dense>
+#include <Eigen/Sparse>
+#include "parallel_backend.hpp"
+
+namespace
+{
+    // Rows per partial sum of the residual norm
+    constexpr Eigen::Index norm_block_size = 256;
+
+    // The thread's state copy is refreshed once per range; columns perturb and restore it in place
+    JacobianWorkspace& range_workspace(const JacobianTask& task)
+    {
+        auto& workspace = task.workspaces.local();
+        workspace.q_h = task.q;
+        workspace.phi_h.resize(task.system.getNumEquations());
+        workspace.frames = task.frames;
+        return workspace;
+    }
+
+    // Column i of the rows of constraint ref, from the thread's perturbed state
+    void perturbed_column(const JacobianTask& task, JacobianWorkspace& workspace, const ConstraintRef& ref,
+                          std::int32_t body, Eigen::Index i, std::int32_t offset)
+    {
+        workspace.q_h(i) += 1e-4;
+        workspace.frames.update(workspace.q_h, body);
+
+        task.system.getBuckets().evaluate(ref, workspace.q_h, workspace.frames, task.t, workspace.phi_h);
+
+        double* values = task.J.valuePtr() + task.J.outerIndexPtr()[i] + offset;
+        for (int e = 0; e < ref.equations; ++e)
+        {
+            values[e] = (workspace.phi_h(ref.row + e) - task.phi(ref.row + e)) / 1e-4;
+        }
+
+        workspace.q_h(i) = task.q(i);
+        workspace.frames.restore(task.frames, body);
+    }
+}
+
+// Jacobian policies are defined next to the session instantiations below, so each combination can inline them
+void ColumnJacobian::columns(const JacobianTask& task, Eigen::Index first, Eigen::Index last)
+{
+    const auto& offsets = task.system.getBodyConstraintOffsets();
+    const auto& body_constraints = task.system.getBodyConstraints();
+    auto& workspace = range_workspace(task);
+
+    for (Eigen::Index i = first; i != last; ++i)
+    {
+        const std::int32_t body = static_cast<std::int32_t>(i / 7);
+
+        // the constraint rows of a column are stored in the order of the body's constraints
+        std::int32_t offset = 0;
+        for (std::int32_t k = offsets[body]; k < offsets[body + 1]; ++k)
+        {
+            perturbed_column(task, workspace, body_constraints[k], body, i, offset);
+            offset += body_constraints[k].equations;
+        }
+    }
+}
+
+void LaneJacobian::columns(const JacobianTask& task, Eigen::Index first, Eigen::Index last)
+{
+    const auto& buckets = task.system.getBuckets();
+    const auto& offsets = task.system.getBodyConstraintOffsets();
+    const auto& body_constraints = task.system.getBodyConstraints();
+    auto& workspace = range_workspace(task);
+
+    // columns of one body are evaluated together, one perturbation per SIMD lane
+    for (Eigen::Index begin = first; begin != last;)
+    {
+        const std::int32_t body = static_cast<std::int32_t>(begin / 7);
+        const Eigen::Index end = std::min<Eigen::Index>(last, (body + 1) * 7);
+
+        workspace.lanes.perturb(task.q, body, 1e-4);
+
+        // all columns of a body share its constraint rows, so the offset in each column is the same
+        std::int32_t offset = 0;
+        for (std::int32_t k = offsets[body]; k < offsets[body + 1]; ++k)
+        {
+            const auto& ref = body_constraints[k];
+
+            if (buckets.evaluateLanes(ref, body, workspace.lanes, task.frames, task.t, workspace.residuals))
+            {
+                for (Eigen::Index i = begin; i != end; ++i)
+                {
+                    double* values = task.J.valuePtr() + task.J.outerIndexPtr()[i] + offset;
+                    const Eigen::Index lane = i - body * 7;
+
+                    for (int e = 0; e < ref.equations; ++e)
+                    {
+                        values[e] = (workspace.residuals.values[e][lane] - task.phi(ref.row + e)) / 1e-4;
+                    }
+                }
+            }
+            else
+            {
+                // user constraints: column by column on the thread's copy of the state
+                for (Eigen::Index i = begin; i != end; ++i)
+                {
+                    perturbed_column(task, workspace, ref, body, i, offset);
+                }
+            }
+
+            offset += ref.equations;
+        }
+
+        begin = end;
+    }
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::BasicSolverSession(
+    const CompiledSystem& system, int block_size, LinearSolverType linear_solver)
+    : system(system), schedule{block_size, Partitioner::automatic},
+      b(system.getNumEquations()), phi(system.getNumEquations()), delta_q(system.getNumCoordinates()),
+      J(system.getJacobianPattern()), frames(system.getNumBodies()),
+      partial_norms((system.getNumEquations() + norm_block_size - 1) / norm_block_size),
+      linear(system, linear_solver)
+{
+    if(block_size == autotune_block_size)
+    {
+        tuner = TuningStore::global().get(system.getTopologyHash(), current_thread_count(), system.getNumCoordinates());
+        schedule = tuner->next();
+    }
+    else if(block_size < 1)
+    {
+        throw std::runtime_error("Block size must be positive");
+    }
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+void BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::evaluate(
+    const Eigen::VectorXd& q, double t, Eigen::Ref<Eigen::VectorXd> out)
+{
+    const auto& buckets = system.getBuckets();
+    const auto& chunks = buckets.getChunks();
+
+    // rotation matrices first: every chunk reads frames of arbitrary bodies
+    ExecutionPolicy::forRange(std::int32_t{0}, system.getNumBodies(), 64, [&](std::int32_t first, std::int32_t last)
+    {
+        frames.update(q, first, last);
+    });
+
+    // chunks write disjoint rows of out (offsets precomputed in ConstraintBuckets)
+    ExecutionPolicy::forRange(std::size_t{0}, chunks.size(), 4, [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t c = first; c != last; ++c)
+        {
+            buckets.evaluate(chunks[c], q, frames, t, out);
+        }
+    });
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+double BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::residual(const Eigen::VectorXd& q, double t)
+{
+    evaluate(q, t, b);
+
+    // fixed blocks summed in order, so the norm is the same for any number of threads
+    const Eigen::Index rows = b.size();
+    return ExecutionPolicy::orderedSum(partial_norms.size(), partial_norms.data(), [&](std::size_t k)
+    {
+        const Eigen::Index begin = static_cast<Eigen::Index>(k) * norm_block_size;
+        auto block = b.segment(begin, std::min<Eigen::Index>(norm_block_size, rows - begin));
+
+        block = -block;
+        return block.squaredNorm();
+    });
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+const Eigen::SparseMatrix<double>& BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::jacobian(
+    const Eigen::VectorXd& q, double t)
+{
+    // constraint functions and rotation matrices at the unperturbed state are shared by all columns
+    evaluate(q, t, phi);
+
+    if(tuner)
+    {
+        schedule = tuner->next();
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    const JacobianTask task{system, q, t, phi, frames, workspaces, J};
+    ExecutionPolicy::forRange(Eigen::Index{0}, q.size(), static_cast<std::size_t>(schedule.block_size),
+                              [&](Eigen::Index first, Eigen::Index last)
+                              {
+                                  JacobianPolicy::columns(task, first, last);
+                              },
+                              schedule.partitioner, affinity);
+
+    if(tuner)
+    {
+        tuner->record(schedule, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return J;
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+void BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::factorize()
+{
+    linear.factorize(J);
+    factorized = true;
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+void BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::update(Eigen::VectorXd& q)
+{
+    linear.solve(J, b, delta_q);
+    q += delta_q;
+    iterations++;
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+void BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::beginStep()
+{
+    iterations = 0;
+    factorized = false;
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+NewtonStage BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::nextStage(double norm) const
+{
+    return NewtonControl::next(norm, iterations, factorized);
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+void BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::solve(Eigen::VectorXd& q, double t)
+{
+    beginStep();
+    double norm = residual(q, t);
+
+    for(NewtonStage stage = nextStage(norm); stage != NewtonStage::done; stage = nextStage(norm))
+    {
+        // Jacobian and its factorization are taken at the initial guess and reused
+        // by all iterations of this solve
+        if(stage == NewtonStage::refactorize)
+        {
+            jacobian(q, t);
+            factorize();
+        }
+
+        update(q);
+        norm = residual(q, t);
+    }
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+const CompiledSystem& BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::getSystem() const
+{
+    return system;
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+int BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::getIterations() const
+{
+    return iterations;
+}
+
+template<class JacobianPolicy, class LinearPolicy, class ExecutionPolicy>
+JacobianSchedule BasicSolverSession<JacobianPolicy, LinearPolicy, ExecutionPolicy>::getSchedule() const
+{
+    return schedule;
+}
+
+// Every combination of policies
+template class BasicSolverSession<ColumnJacobian, SparseQRSolve, SequentialExecution>;
+template class BasicSolverSession<ColumnJacobian, SparseQRSolve, ParallelExecution>;
+template class BasicSolverSession<ColumnJacobian, NormalEquationsSolve, SequentialExecution>;
+template class BasicSolverSession<ColumnJacobian, NormalEquationsSolve, ParallelExecution>;
+template class BasicSolverSession<ColumnJacobian, RuntimeLinearSolve, SequentialExecution>;
+template class BasicSolverSession<ColumnJacobian, RuntimeLinearSolve, ParallelExecution>;
+template class BasicSolverSession<LaneJacobian, SparseQRSolve, SequentialExecution>;
+template class BasicSolverSession<LaneJacobian, SparseQRSolve, ParallelExecution>;
+template class BasicSolverSession<LaneJacobian, NormalEquationsSolve, SequentialExecution>;
+template class BasicSolverSession<LaneJacobian, NormalEquationsSolve, ParallelExecution>;
+template class BasicSolverSession<LaneJacobian, RuntimeLinearSolve, SequentialExecution>;
+template class BasicSolverSession<LaneJacobian, RuntimeLinearSolve, ParallelExecution>;
@@ -0,0 +1,201 @@
+#include "symbolic_cache.hpp"
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <Eigen/Sparse>
+#include "compiled_system.hpp"
+
+ColumnOrdering::ColumnOrdering(const Eigen::SparseMatrix<double>& jacobian_pattern)
+{
+    Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> permutation;
+    Eigen::COLAMDOrdering<int>()(jacobian_pattern, permutation);
+
+    const int cols = static_cast<int>(jacobian_pattern.cols());
+    position.assign(permutation.indices().data(), permutation.indices().data() + cols);
+    std::vector<int> source(cols);
+    for(int i = 0; i < cols; i++)
+        source[position[i]] = i;
+
+    // columns copied whole in the new order, so their row indices stay sorted
+    pattern.resize(jacobian_pattern.rows(), cols);
+    pattern.reserve(jacobian_pattern.nonZeros());
+    value_source.reserve(static_cast<std::size_t>(jacobian_pattern.nonZeros()));
+    for(int p = 0; p < cols; p++)
+    {
+        pattern.startVec(p);
+        const int col = source[p];
+        for(int k = jacobian_pattern.outerIndexPtr()[col]; k < jacobian_pattern.outerIndexPtr()[col + 1]; k++)
+        {
+            pattern.insertBack(jacobian_pattern.innerIndexPtr()[k], p) = 0.0;
+            value_source.push_back(k);
+        }
+    }
+    pattern.finalize();
+}
+
+SymbolicAnalysis::SymbolicAnalysis(const CompiledSystem& system)
+{
+    const int num_bodies = system.getNumBodies();
+    const auto& offsets = system.getBodyConstraintOffsets();
+    const auto& body_constraints = system.getBodyConstraints();
+
+    // Every coordinate of a body depends on the rows of all constraints of that body
+    Eigen::VectorXi column_sizes(num_bodies * 7);
+    for(int i = 0; i < num_bodies; i++)
+    {
+        int rows = 0;
+        for(int k = offsets[i]; k < offsets[i + 1]; k++)
+            rows += body_constraints[k].equations;
+        column_sizes.segment<7>(i * 7).setConstant(rows);
+    }
+
+    jacobian_pattern.resize(system.getNumEquations(), num_bodies * 7);
+    jacobian_pattern.reserve(column_sizes);
+    for(int col = 0; col < num_bodies * 7; col++)
+    {
+        const int body = col / 7;
+        for(int k = offsets[body]; k < offsets[body + 1]; k++)
+        {
+            const auto& ref = body_constraints[k];
+            for(int row = 0; row < ref.equations; row++)
+                jacobian_pattern.insert(ref.row + row, col) = 0.0;
+        }
+    }
+    jacobian_pattern.makeCompressed();
+}
+
+SymbolicAnalysis::SymbolicAnalysis(Eigen::SparseMatrix<double> jacobian_pattern,
+                                   std::unique_ptr<NormalEquationsSymbolic> normal_equations)
+    : jacobian_pattern(std::move(jacobian_pattern)), normal_equations(std::move(normal_equations))
+{
+    this->jacobian_pattern.makeCompressed();
+}
+
+const Eigen::SparseMatrix<double>& SymbolicAnalysis::getJacobianPattern() const
+{
+    return jacobian_pattern;
+}
+
+const NormalEquationsSymbolic& SymbolicAnalysis::getNormalEquations() const
+{
+    // ordering and elimination structure only for systems solved with normal equations
+    std::call_once(normal_equations_once, [this]()
+    {
+        if(!normal_equations)
+            normal_equations = std::make_unique<NormalEquationsSymbolic>(jacobian_pattern);
+    });
+    return *normal_equations;
+}
+
+const ColumnOrdering& SymbolicAnalysis::getColumnOrdering() const
+{
+    // only for systems solved with SparseQR
+    std::call_once(column_ordering_once, [this]()
+    {
+        column_ordering = std::make_unique<ColumnOrdering>(jacobian_pattern);
+    });
+    return *column_ordering;
+}
+
+SymbolicCache::SymbolicCache(std::size_t capacity)
+    : capacity(std::max<std::size_t>(capacity, 1))
+{
+}
+
+SymbolicCache& SymbolicCache::global()
+{
+    static SymbolicCache cache;
+    return cache;
+}
+
+bool SymbolicCache::matches(const Entry& entry, const CompiledSystem& system)
+{
+    return entry.num_bodies == system.getNumBodies() && entry.refs == system.getBuckets().getRefs() &&
+           entry.parameter_index == system.getBuckets().fixed_parameter.parameter_index;
+}
+
+std::shared_ptr<const SymbolicAnalysis> SymbolicCache::get(const CompiledSystem& system)
+{
+    return get(system, [&system]() { return std::make_shared<const SymbolicAnalysis>(system); });
+}
+
+std::shared_ptr<const SymbolicAnalysis> SymbolicCache::get(const CompiledSystem& system,
+                                                           const std::function<std::shared_ptr<const SymbolicAnalysis>()>& build)
+{
+    const std::uint64_t hash = system.getTopologyHash();
+    std::shared_ptr<Entry> entry;
+
+    {
+        std::shared_lock lock(mutex);
+        auto it = entries.find(hash);
+        if(it != entries.end())
+            entry = it->second;
+    }
+
+    if(!entry)
+    {
+        std::unique_lock lock(mutex);
+        auto it = entries.find(hash);
+        if(it == entries.end())
+        {
+            if(entries.size() >= capacity)
+                evictLeastRecent();
+
+            auto slot = std::make_shared<Entry>();
+            slot->num_bodies = system.getNumBodies();
+            slot->refs = system.getBuckets().getRefs();
+            slot->parameter_index = system.getBuckets().fixed_parameter.parameter_index;
+            it = entries.emplace(hash, std::move(slot)).first;
+        }
+        entry = it->second;
+    }
+
+    // a different topology with the same hash is analysed on its own, without caching
+    if(!matches(*entry, system))
+        return this->build(build);
+
+    entry->last_use.store(++clock, std::memory_order_relaxed);
+    std::lock_guard lock(entry->build_mutex);
+    if(!entry->analysis)
+        entry->analysis = this->build(build);
+    return entry->analysis;
+}
+
+std::shared_ptr<const SymbolicAnalysis> SymbolicCache::build(
+    const std::function<std::shared_ptr<const SymbolicAnalysis>()>& build)
+{
+    num_builds++;
+    return build();
+}
+
+void SymbolicCache::evictLeastRecent()
+{
+    // an entry still being built stays alive for its builder, it is only no longer cached
+    const auto oldest = std::min_element(entries.begin(), entries.end(), [](const auto& a, const auto& b)
+    {
+        return a.second->last_use.load(std::memory_order_relaxed) < b.second->last_use.load(std::memory_order_relaxed);
+    });
+    if(oldest != entries.end())
+        entries.erase(oldest);
+}
+
+std::size_t SymbolicCache::size() const
+{
+    std::shared_lock lock(mutex);
+    return entries.size();
+}
+
+void SymbolicCache::clear()
+{
+    std::unique_lock lock(mutex);
+    entries.clear();
+}
+
+std::size_t SymbolicCache::getNumBuilds() const
+{
+    return num_builds.load();
+}
@@ -0,0 +1,122 @@
+#include "system_scheduler.hpp"
+#include <vector>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <oneapi/tbb.h>
+
+#include "multibody_solver.hpp"
+#include "solver_session.hpp"
+
+double system_cost(const CompiledSystem& system)
+{
+    return static_cast<double>(system.getNumCoordinates()) * static_cast<double>(system.getBuckets().getRefs().size());
+}
+
+std::vector<int> thread_budgets(const std::vector<double>& costs, int num_threads)
+{
+    const std::size_t n = costs.size();
+    const double total_cost = std::accumulate(costs.begin(), costs.end(), 0.0);
+
+    // the thread running a system, then the spare threads by cost share
+    std::vector<int> budgets(n, 1);
+    const int spare = num_threads - static_cast<int>(n);
+    if(spare <= 0 || !(total_cost > 0.0))
+        return budgets;
+
+    // whole parts first, the rest one by one to the largest remainders
+    int assigned = 0;
+    std::vector<double> remainders(n);
+    for(std::size_t i = 0; i < n; i++)
+    {
+        const double exact = spare * costs[i] / total_cost;
+        const int whole = std::min(static_cast<int>(std::floor(exact)), spare - assigned);
+        budgets[i] += whole;
+        assigned += whole;
+        remainders[i] = exact - whole;
+    }
+
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return remainders[a] > remainders[b]; });
+    for(std::size_t k = 0; assigned < spare; k++, assigned++)
+        budgets[order[k]]++;
+
+    return budgets;
+}
+
+SystemScheduler::SystemScheduler(int num_threads)
+    : num_threads(num_threads), max_concurrency(std::min(num_threads, current_thread_count())),
+      outer(std::max(max_concurrency, 1), 1, oneapi::tbb::task_arena::priority::high)
+{
+    if(num_threads < 1)
+        throw std::runtime_error("Scheduler needs at least one thread");
+}
+
+std::vector<std::vector<State>> SystemScheduler::solve(const std::vector<CompiledSystem>& systems, double end_time,
+                                                       int block_size)
+{
+    const std::size_t n = systems.size();
+    std::vector<std::vector<State>> results(n);
+
+    std::vector<double> costs(n);
+    for(std::size_t i = 0; i < n; i++)
+        costs[i] = system_cost(systems[i]);
+    budgets = thread_budgets(costs, num_threads);
+
+    // one arena per budget; its concurrency is the sum of the budgets of its systems
+    std::map<int, int> arena_threads, arena_systems;
+    for(std::size_t i = 0; i < n; i++)
+    {
+        arena_threads[budgets[i]] += budgets[i];
+        arena_systems[budgets[i]]++;
+    }
+    inner.clear();
+    for(const auto& [budget, threads] : arena_threads)
+    {
+        // low priority: workers join only when the outer arena has nothing left for them;
+        // every outer thread running one of the systems may enter
+        const int concurrency = std::min(threads, max_concurrency);
+        inner[budget] = std::make_unique<oneapi::tbb::task_arena>(concurrency, std::min(arena_systems[budget], concurrency),
+                                                                  oneapi::tbb::task_arena::priority::low);
+    }
+
+    // most expensive systems start first, so the small ones fill the gaps at the end
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return costs[a] > costs[b]; });
+
+    outer.execute([&]()
+    {
+        oneapi::tbb::parallel_for(oneapi::tbb::blocked_range<std::size_t>(0, n, 1), [&](const auto& r)
+        {
+            for(std::size_t k = r.begin(); k != r.end(); ++k)
+            {
+                const std::size_t i = order[k];
+
+                // the session is created inside the arena, so an autotuned grain size
+                // is tuned for the thread budget of the system
+                inner.at(budgets[i])->execute([&]()
+                {
+                    SolverSession session{systems[i], block_size};
+                    results[i] = multibody_solver(session, end_time);
+                });
+            }
+        }, oneapi::tbb::simple_partitioner{});
+    });
+
+    return results;
+}
+
+const std::vector<int>& SystemScheduler::getBudgets() const
+{
+    return budgets;
+}
+
+int SystemScheduler::getNumThreads() const
+{
+    return num_threads;
+}
@@ -1,7 +1,125 @@
 #include <vector>
 #include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <cmath>
 
 #include "multibody_solver.hpp"
+#include "trajectory.hpp"
+#include "quaternion_operations.hpp"
+#include "simd_kernels.hpp"
+#include "ensemble_solver.hpp"
+#include "model_loader.hpp"
+#include "model_image.hpp"
+#include "symbolic_cache.hpp"
+#include "parallel_backend.hpp"
+#ifdef MULTIBODY_PARALLEL_TBB
+#include "system_scheduler.hpp"
+#include "flow_solver.hpp"
+#include "numa_solver.hpp"
+#include "process_solver.hpp"
+#endif
+
+// Heap allocation counter (glibc): every malloc/calloc/realloc in the process is counted. Eigen
+// allocates with malloc, so operator new alone would miss it. Sanitizers replace the allocator
+// themselves and are left alone.
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#if defined(__has_feature)
+#if !__has_feature(address_sanitizer) && !__has_feature(thread_sanitizer) && !__has_feature(memory_sanitizer)
+#define COUNT_HEAP_ALLOCATIONS
+#endif
+#else
+#define COUNT_HEAP_ALLOCATIONS
+#endif
+#endif
+
+#if defined(COUNT_HEAP_ALLOCATIONS)
+static std::atomic<long> heap_allocations{0};
+
+extern "C" void* __libc_malloc(std::size_t size);
+extern "C" void* __libc_calloc(std::size_t count, std::size_t size);
+extern "C" void* __libc_realloc(void* ptr, std::size_t size);
+
+extern "C" void* malloc(std::size_t size) noexcept
+{
+    heap_allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(std::size_t count, std::size_t size) noexcept
+{
+    heap_allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, std::size_t size) noexcept
+{
+    heap_allocations++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+Eigen::Vector3d lift(double t)
+{
+    return Eigen::Vector3d(0.0, 0.0, cos(t));
+}
+
+// User extension of a built-in constraint: solved through the virtual interface
+class UserDistanceConstraint : public DistanceConstraint
+{
+public:
+    using DistanceConstraint::DistanceConstraint;
+
+    std::shared_ptr<Constraint> clone() const override
+    {
+        return std::make_shared<UserDistanceConstraint>(*this);
+    }
+};
+
+// User constraint written against the original interface: body lookup by id, result by value
+class LegacyLiftConstraint : public LegacyConstraint
+{
+public:
+    LegacyLiftConstraint(long int id, long int body_id) : LegacyConstraint(id, 0, body_id) {}
+
+    std::shared_ptr<Constraint> clone() const override
+    {
+        return std::make_shared<LegacyLiftConstraint>(*this);
+    }
+
+    Eigen::VectorXd ConstrainingFunctions(const Eigen::VectorXd& q, double t, const std::vector<long int>& body_ids) override
+    {
+        return get_body_position(q, body2_id, body_ids) - get_body_position(q, body1_id, body_ids) - lift(t);
+    }
+
+    double equations_number() override
+    {
+        return 3;
+    }
+};
+
+// Trajectory of a session with the given policies, compared to the default SolverSession
+template<class Session>
+bool policy_matches(const CompiledSystem& compiled, const std::vector<State>& reference)
+{
+    Session session{compiled};
+    const auto states = multibody_solver(session, 1.0);
+    if(states.size() != reference.size())
+        return false;
+
+    for(std::size_t k = 0; k < states.size(); k++)
+    {
+        if((states[k].getQ() - reference[k].getQ()).cwiseAbs().maxCoeff() > 1e-9)
+            return false;
+    }
+    return true;
+}
 
 int main() 
 {
@@ -50,5 +168,712 @@ int main()
     // Output results
     std::cout << "Multibody system solved successfully!" << std::endl;
 
+    // Dense output of a driven trajectory
+    MultibodySystem driven;
+    driven.addBody(Body{1, 0.0, 0.0, 1.0, 1.0, 0.0, 0.0, 0.0});
+    driven.addConstraint(DistanceConstraint{1, 0, 1, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), lift});
+    driven.addConstraint(FixedOrientationConstraint{2, 1, Eigen::Vector4d(1.0, 0.0, 0.0, 0.0)});
+
+    Trajectory trajectory{multibody_solver(driven, 1.0)};
+    double z = trajectory.at(0.55).getQ()(2);
+    double vz = trajectory.velocity(0.55)(2);
+    if(std::abs(z - cos(0.55)) > 1e-3 || std::abs(vz + sin(0.55)) > 1e-2)
+    {
+        std::cerr << "Trajectory interpolation failed: z = " << z << ", vz = " << vz << std::endl;
+        return 1;
+    }
+    std::cout << "Trajectory interpolated successfully!" << std::endl;
+
+    // The interpolant passes through every stored state, also across a sign flip of a quaternion
+    {
+        const auto states = multibody_solver(driven, 1.0);
+        bool nodes = true;
+        for(const auto& state : states)
+        {
+            nodes = nodes && trajectory.at(state.getTime()).getQ() == state.getQ();
+        }
+
+        std::vector<State> flipped = states;
+        Eigen::VectorXd q = flipped[1].getQ();
+        q.segment<4>(3) = -q.segment<4>(3);
+        flipped[1] = State{q, flipped[1].getTime()};
+
+        const Trajectory flipped_trajectory{flipped};
+        const double t1 = flipped[1].getTime();
+        const Eigen::Vector4d e1 = flipped_trajectory.at(t1).getQ().segment<4>(3);
+        const Eigen::Vector4d before = flipped_trajectory.at(t1 - 1e-9).getQ().segment<4>(3);
+        const bool continuous = (e1 - before).norm() < 1e-6 && e1 == states[1].getQ().segment<4>(3);
+
+        if(!nodes || !continuous)
+        {
+            std::cerr << "Trajectory does not reproduce its nodes" << std::endl;
+            return 1;
+        }
+        std::cout << "Trajectory reproduces its nodes!" << std::endl;
+    }
+
+    // Built-in constraints are stored in place, user classes (even derived from built-ins) stay virtual
+    {
+        MultibodySystem user;
+        user.addBody(Body{1, 0.0, 0.0, 1.0, 1.0, 0.0, 0.0, 0.0});
+        user.addConstraint(UserDistanceConstraint{1, 0, 1, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), lift});
+        user.addConstraint(FixedOrientationConstraint{2, 1, Eigen::Vector4d(1.0, 0.0, 0.0, 0.0)});
+
+        const auto& stored = driven.getConstraints();
+        const auto& user_stored = user.getConstraints();
+        const CompiledSystem compiled{user};
+
+        const Eigen::VectorXd q = CompiledSystem{driven}.getInitialQ();
+        Eigen::VectorXd static_phi(3), virtual_phi(3);
+        evaluate(stored[0], q, 0.3, static_phi);
+        as_constraint(stored[0]).evaluate(q, 0.3, virtual_phi);
+
+        const auto reference = multibody_solver(driven, 1.0);
+        const auto states = multibody_solver(user, 1.0);
+        bool same = states.size() == reference.size();
+        for(std::size_t k = 0; same && k < states.size(); k++)
+        {
+            same = (states[k].getQ() - reference[k].getQ()).cwiseAbs().maxCoeff() < 1e-9;
+        }
+
+        if(!std::holds_alternative<DistanceConstraint>(stored[0]) ||
+           !std::holds_alternative<std::shared_ptr<Constraint>>(user_stored[0]) ||
+           equations_number(stored[0]) != 3 || equations_number(user_stored[0]) != 3 ||
+           compiled.getBuckets().generic.row.size() != 1 || !compiled.getBuckets().distance.row.empty() ||
+           static_phi != virtual_phi || !same)
+        {
+            std::cerr << "Static constraint dispatch failed" << std::endl;
+            return 1;
+        }
+        std::cout << "Constraints dispatched statically, user constraints virtually!" << std::endl;
+    }
+
+    // Constraints before their bodies are resolved by finalize(); a shared user constraint is never re-resolved in place
+    {
+        const auto shared = std::make_shared<UserDistanceConstraint>(1, 1, 2, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), lift);
+
+        MultibodySystem forward;
+        forward.addBody(Body{1, 0.0, 0.0, 1.0, 1.0, 0.0, 0.0, 0.0});
+        forward.addBody(Body{2, 0.0, 0.0, 2.0, 1.0, 0.0, 0.0, 0.0});
+        forward.addConstraint(ConstraintVariant{shared});
+
+        MultibodySystem backward;
+        backward.addConstraint(ConstraintVariant{shared});
+        backward.addBody(Body{2, 0.0, 0.0, 2.0, 1.0, 0.0, 0.0, 0.0});
+        backward.addBody(Body{1, 0.0, 0.0, 1.0, 1.0, 0.0, 0.0, 0.0});
+        backward.finalize();
+
+        const Constraint& in_forward = as_constraint(forward.getConstraints()[0]);
+        const Constraint& in_backward = as_constraint(backward.getConstraints()[0]);
+        if(in_forward.getBody1Index() != 0 || in_forward.getBody2Index() != 1 ||
+           in_backward.getBody1Index() != 1 || in_backward.getBody2Index() != 0)
+        {
+            std::cerr << "Deferred constraint resolution failed" << std::endl;
+            return 1;
+        }
+        std::cout << "Constraints resolved at finalize!" << std::endl;
+    }
+
+    // Subclasses of the original Constraint interface are still solved, through the LegacyConstraint adapter
+    {
+        MultibodySystem legacy;
+        legacy.addBody(Body{1, 0.0, 0.0, 1.0, 1.0, 0.0, 0.0, 0.0});
+        legacy.addConstraint(LegacyLiftConstraint{1, 1});
+        legacy.addConstraint(FixedOrientationConstraint{2, 1, Eigen::Vector4d(1.0, 0.0, 0.0, 0.0)});
+
+        const auto reference = multibody_solver(driven, 1.0);
+        const auto states = multibody_solver(legacy, 1.0);
+        bool same = states.size() == reference.size() && legacy.getNumConstraints() == 7;
+        for(std::size_t k = 0; same && k < states.size(); k++)
+        {
+            same = (states[k].getQ() - reference[k].getQ()).cwiseAbs().maxCoeff() < 1e-9;
+        }
+
+        if(!same)
+        {
+            std::cerr << "Legacy constraint interface failed" << std::endl;
+            return 1;
+        }
+        std::cout << "Legacy constraint interface solved!" << std::endl;
+    }
+
+    // Text model: the same trajectories as the hand-built system, errors reported with the line
+    {
+        const std::string text =
+            "# driven body\n"
+            "bodies 1\n"
+            "distance 1  0 1  0 0 0  0 0 0  lift   # constraint before its body\n"
+            "body 1  0.0 0.0 1.0  1.0 0.0 0.0 0.0\n"
+            "\n"
+            "fixed_orientation 2 1  1 0 0 0\n";
+
+        DriverRegistry drivers;
+        drivers.add("lift", lift);
+
+        const std::string path = "driven_model.txt";
+        {
+            std::ofstream file(path);
+            file << text;
+        }
+        MultibodySystem loaded = load_model(path, drivers);
+        std::remove(path.c_str());
+
+        const auto reference = multibody_solver(driven, 1.0);
+        const auto states = multibody_solver(loaded, 1.0);
+        bool same = states.size() == reference.size();
+        for(std::size_t k = 0; same && k < states.size(); k++)
+        {
+            same = states[k].getQ() == reference[k].getQ();
+        }
+
+        std::string error;
+        try
+        {
+            parse_model("body 1 0 0 1 1 0 0 0\ndistance 1 0 1 0 0 0 0 0 0 lift\n");
+        }
+        catch(const std::runtime_error& e)
+        {
+            error = e.what();
+        }
+
+        // a reservation count is checked before anything is allocated for it
+        std::string count_error;
+        try
+        {
+            parse_model("body 1 0 0 1 1 0 0 0\nconstraints 4000000000000000000\n");
+        }
+        catch(const std::runtime_error& e)
+        {
+            count_error = e.what();
+        }
+
+        if(!same || loaded.getNumBodies() != 1 || loaded.getNumConstraints() != 7 ||
+           error != "Model line 2: unknown driver function 'lift'" ||
+           count_error != "Model line 2: count exceeds the number of lines")
+        {
+            std::cerr << "Text model loading failed: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Text model loaded!" << std::endl;
+    }
+
+    // Binary model image: mapped without parsing, the same trajectories and symbolic analysis
+    {
+        DriverRegistry drivers;
+        drivers.add("lift", lift);
+
+        const std::string path = "driven_model.image";
+        const CompiledSystem compiled{driven};
+        save_model_image(compiled, path, drivers);
+
+        bool same = false;
+        bool view = false;
+        {
+            const ModelImage image{path};
+            const CompiledSystem mapped{image, drivers};
+
+            view = image.getNumBodies() == 1 && image.getNumEquations() == compiled.getNumEquations() &&
+                   image.getTopologyHash() == compiled.getTopologyHash() && image.getInitialQ() == compiled.getInitialQ() &&
+                   image.getJacobianPattern().nonZeros() == compiled.getJacobianPattern().nonZeros() &&
+                   image.getNumDrivers() == 1 && std::string{image.getDriverName(0)} == "lift";
+
+            NormalEquationsSession reference_session{compiled};
+            NormalEquationsSession mapped_session{mapped};
+            const auto reference = multibody_solver(reference_session, 1.0);
+            const auto states = multibody_solver(mapped_session, 1.0);
+            same = states.size() == reference.size() && mapped.sameTopology(compiled);
+            for(std::size_t k = 0; same && k < states.size(); k++)
+            {
+                same = states[k].getQ() == reference[k].getQ();
+            }
+        }
+
+        // sections that do not match the header are rejected: initial_q is too short for two bodies
+        std::string size_error;
+        {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(24);
+            const std::int64_t num_bodies = 2;
+            file.write(reinterpret_cast<const char*>(&num_bodies), sizeof(num_bodies));
+        }
+        try
+        {
+            ModelImage image{path};
+        }
+        catch(const std::runtime_error& e)
+        {
+            size_error = e.what();
+        }
+
+        // a newer format version is rejected instead of being misread
+        {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(8);
+            const std::uint32_t version = model_image_version + 1;
+            file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        }
+        std::string error;
+        try
+        {
+            ModelImage image{path};
+        }
+        catch(const std::runtime_error& e)
+        {
+            error = e.what();
+        }
+        std::remove(path.c_str());
+
+        if(!same || !view || error.find("Unsupported model image version") == std::string::npos ||
+           size_error.find("Corrupted model image") == std::string::npos)
+        {
+            std::cerr << "Model image failed: " << error << " / " << size_error << std::endl;
+            return 1;
+        }
+        std::cout << "Model image mapped!" << std::endl;
+    }
+
+    // Trajectory file: written on the background thread, read back whole and by steps
+    {
+        const CompiledSystem compiled{driven};
+        const std::string path = "driven.trajectory";
+        {
+            // small chunks and queue: several chunks, the last one partial, and a full queue
+            TrajectoryWriter writer{path, compiled.getBodyIds(), 4, 2};
+            multibody_solver(compiled, 1.0, writer);
+            writer.close();
+        }
+
+        // a writer that never reached close(): no index, and the last chunk (3 steps) cut one byte short
+        const std::string truncated_path = "truncated.trajectory";
+        {
+            std::ifstream in(path, std::ios::binary);
+            std::string bytes{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+            const std::size_t index_bytes = 4 * sizeof(std::uint64_t);
+            bytes.resize(bytes.size() - index_bytes - 1);
+            std::fill(bytes.begin() + 32, bytes.begin() + 56, '\0');  // num_steps, num_chunks, index_offset
+            std::ofstream(truncated_path, std::ios::binary) << bytes;
+        }
+
+        const auto reference = multibody_solver(compiled, 1.0);
+        TrajectoryReader reader{path};
+        const auto states = reader.readAll();
+        const auto window = reader.read(3, 6);
+        std::remove(path.c_str());
+
+        TrajectoryReader truncated_reader{truncated_path};
+        const auto recovered = truncated_reader.readAll();
+        std::remove(truncated_path.c_str());
+
+        bool same = states.size() == reference.size() && window.size() == 6 &&
+                    reader.getBodyIds() == compiled.getBodyIds() && reader.getTimes().size() == reference.size() &&
+                    reader.isClosed() && !truncated_reader.isClosed() && recovered.size() == 8;
+        for(std::size_t k = 0; same && k < recovered.size(); k++)
+        {
+            same = recovered[k].getQ() == reference[k].getQ() && recovered[k].getTime() == reference[k].getTime();
+        }
+        for(std::size_t k = 0; same && k < states.size(); k++)
+        {
+            same = states[k].getQ() == reference[k].getQ() && states[k].getTime() == reference[k].getTime() &&
+                   reader.getTimes()[k] == reference[k].getTime();
+        }
+        for(std::size_t k = 0; same && k < window.size(); k++)
+        {
+            same = window[k].getQ() == reference[k + 3].getQ() && window[k].getTime() == reference[k + 3].getTime();
+        }
+
+        if(!same)
+        {
+            std::cerr << "Trajectory file failed" << std::endl;
+            return 1;
+        }
+        std::cout << "Trajectory file written in the background!" << std::endl;
+    }
+
+    // Compressed trajectory: errors within the tolerances, time windows decoded on their own
+    {
+        // a body spinning about z (the largest quaternion component and its sign change) and one moving far away
+        std::vector<State> reference;
+        for(int k = 0; k < 200; k++)
+        {
+            const double t = 0.1 * k;
+            Eigen::VectorXd q(14);
+            q << std::sin(t), std::cos(t), 0.5 * t, std::cos(0.5 * t), 0.0, 0.0, std::sin(0.5 * t),
+                 100.0 + 3.0 * t, -50.0, 1e-3 * t * t, 0.6, 0.8 * std::cos(t), 0.8 * std::sin(t), 0.0;
+            reference.emplace_back(q, t);
+        }
+
+        const TrajectoryCompression compression{1e-6, 1e-5};
+        const std::string path = "compressed.trajectory";
+        {
+            TrajectoryWriter writer{path, {1, 2}, compression, 16};
+            for(const auto& state : reference)
+            {
+                writer.push(state.getQ(), state.getTime());
+            }
+            writer.close();
+        }
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        const auto bytes = static_cast<std::size_t>(file.tellg());
+
+        TrajectoryReader reader{path};
+        const auto states = reader.readAll();
+        const auto window = reader.readWindow(5.05, 7.0);
+        std::remove(path.c_str());
+
+        // window: steps 51 .. 70
+        bool same = reader.getEncoding() == TrajectoryEncoding::compressed && states.size() == reference.size() &&
+                    window.size() == 20 && window.front().getTime() == reference[51].getTime();
+        double position_error = 0.0;
+        double orientation_error = 0.0;
+        for(std::size_t k = 0; same && k < states.size(); k++)
+        {
+            const Eigen::VectorXd difference = (states[k].getQ() - reference[k].getQ()).cwiseAbs();
+            position_error = std::max({position_error, difference.segment<3>(0).maxCoeff(), difference.segment<3>(7).maxCoeff()});
+            orientation_error = std::max({orientation_error, difference.segment<4>(3).maxCoeff(), difference.segment<4>(10).maxCoeff()});
+            same = states[k].getTime() == reference[k].getTime();
+        }
+        for(std::size_t k = 0; same && k < window.size(); k++)
+        {
+            same = window[k].getQ() == states[k + 51].getQ();
+        }
+
+        if(!same || position_error > compression.position_tolerance ||
+           orientation_error > compression.orientation_tolerance || bytes * 3 > reference.size() * 14 * sizeof(double))
+        {
+            std::cerr << "Compressed trajectory failed: position error " << position_error << ", orientation error "
+                      << orientation_error << ", " << bytes << " bytes" << std::endl;
+            return 1;
+        }
+        std::cout << "Trajectory compressed to " << bytes << " bytes!" << std::endl;
+    }
+
+    // Lockstep ensemble: same trajectories as solving every system on its own
+    {
+        std::vector<CompiledSystem> variants;
+        for(int i = 0; i < 3; i++)
+        {
+            MultibodySystem variant;
+            variant.addBody(Body{1, 0.1 * i, 0.0, 1.0, 1.0, 0.0, 0.0, 0.0});
+            variant.addConstraint(DistanceConstraint{1, 0, 1, Eigen::Vector3d(0.1 * i, 0.0, 0.0), Eigen::Vector3d::Zero(), lift});
+            variant.addConstraint(FixedOrientationConstraint{2, 1, Eigen::Vector4d(1.0, 0.0, 0.0, 0.0)});
+            variants.emplace_back(variant);
+        }
+        variants.emplace_back(sys);
+
+        const auto ensemble = ensemble_solver(variants, 1.0);
+        double difference = 0.0;
+        for(std::size_t i = 0; i < variants.size(); i++)
+        {
+            NormalEquationsSession session{variants[i]};
+            const auto single = multibody_solver(session, 1.0);
+            for(std::size_t k = 0; k < single.size(); k++)
+            {
+                difference = std::max(difference, (ensemble[i][k].getQ() - single[k].getQ()).cwiseAbs().maxCoeff());
+            }
+        }
+
+        if(difference > 1e-9 || std::abs(ensemble[2].back().getQ()(2) - cos(1.0)) > 1e-6)
+        {
+            std::cerr << "Ensemble solver differs from single solves by " << difference << std::endl;
+            return 1;
+        }
+        std::cout << "Ensemble solver matches single solves!" << std::endl;
+
+        // one symbolic analysis per topology
+        if(&variants[0].getSymbolic() != &variants[2].getSymbolic() || &variants[0].getSymbolic() == &variants[3].getSymbolic() ||
+           variants[0].getTopologyHash() != variants[1].getTopologyHash())
+        {
+            std::cerr << "Symbolic analysis is not shared by systems of the same topology" << std::endl;
+            return 1;
+        }
+        std::cout << "Symbolic analysis shared by topology!" << std::endl;
+    }
+
+    // The cache keeps analyses between solves and drops the least recently used topology over its capacity
+    {
+        SymbolicCache& global = SymbolicCache::global();
+        global.clear();
+        const std::size_t before = global.getNumBuilds();
+        multibody_solver(driven, 1.0);
+        multibody_solver(driven, 1.0);
+        const std::size_t sequential_builds = global.getNumBuilds() - before;
+
+        SymbolicCache cache{1};
+        const CompiledSystem first{driven};
+        const CompiledSystem second{sys};
+        cache.get(first);
+        cache.get(first);
+        cache.get(second);
+        const std::size_t entries = cache.size();
+        const auto again = cache.get(first);
+
+        if(sequential_builds != 1 || entries != 1 || cache.getNumBuilds() != 3 || again->getJacobianPattern().nonZeros() == 0)
+        {
+            std::cerr << "Symbolic cache built " << sequential_builds << " analyses for one topology, kept "
+                      << entries << " entries" << std::endl;
+            return 1;
+        }
+        std::cout << "Symbolic cache reused analyses across solves!" << std::endl;
+    }
+
+    // Autotuned grain size: the schedule never changes the result, tuning settles and survives a save/load
+    {
+        TuningStore::global().clear();
+        const CompiledSystem compiled{driven};
+        const auto fixed = multibody_solver(compiled, 1.0);
+
+        SolverSession session{compiled, autotune_block_size};
+        const auto tuned = multibody_solver(session, 1.0);
+
+        const auto tuner = TuningStore::global().get(compiled.getTopologyHash(), current_thread_count(), compiled.getNumCoordinates());
+        bool same = tuned.size() == fixed.size();
+        for(std::size_t k = 0; same && k < fixed.size(); k++)
+        {
+            same = tuned[k].getQ() == fixed[k].getQ();
+        }
+
+        const std::string path = "grain_tuning.txt";
+        const JacobianSchedule best = tuner->getBest();
+        TuningStore::global().save(path);
+        TuningStore::global().clear();
+        TuningStore::global().load(path);
+        std::remove(path.c_str());
+
+        const auto loaded = TuningStore::global().get(compiled.getTopologyHash(), current_thread_count(), compiled.getNumCoordinates());
+
+        // a partitioner name from another version is an error, not a silent default
+        bool rejected = false;
+        std::ofstream(path) << "1 1 7 guided\n";
+        try
+        {
+            TuningStore{}.load(path);
+        }
+        catch(const std::runtime_error&)
+        {
+            rejected = true;
+        }
+        std::remove(path.c_str());
+
+        // an empty block is not a request for autotuning
+        bool zero_rejected = false;
+        try
+        {
+            SolverSession zero{compiled, 0};
+        }
+        catch(const std::runtime_error&)
+        {
+            zero_rejected = true;
+        }
+
+        if(!same || !tuner->isLocked() || !loaded->isLocked() || !(loaded->getBest() == best) || !(session.getSchedule() == best) ||
+           !rejected || !zero_rejected)
+        {
+            std::cerr << "Grain size autotuning failed" << std::endl;
+            return 1;
+        }
+        std::cout << "Grain size tuned to " << best.block_size << " (" << partitioner_name(best.partitioner) << ")!" << std::endl;
+    }
+
+    // Compile-time policies: every combination gives the default session's trajectories
+    {
+        for(const MultibodySystem* mbs : {&sys, &driven})
+        {
+            const CompiledSystem compiled{*mbs};
+            SolverSession session{compiled};
+            const auto reference = multibody_solver(session, 1.0);
+
+            const bool same =
+                policy_matches<BasicSolverSession<ColumnJacobian, SparseQRSolve, SequentialExecution>>(compiled, reference) &&
+                policy_matches<BasicSolverSession<ColumnJacobian, SparseQRSolve, ParallelExecution>>(compiled, reference) &&
+                policy_matches<BasicSolverSession<ColumnJacobian, NormalEquationsSolve, SequentialExecution>>(compiled, reference) &&
+                policy_matches<BasicSolverSession<ColumnJacobian, NormalEquationsSolve, ParallelExecution>>(compiled, reference) &&
+                policy_matches<BasicSolverSession<LaneJacobian, SparseQRSolve, SequentialExecution>>(compiled, reference) &&
+                policy_matches<BasicSolverSession<LaneJacobian, SparseQRSolve, ParallelExecution>>(compiled, reference) &&
+                policy_matches<BasicSolverSession<LaneJacobian, NormalEquationsSolve, SequentialExecution>>(compiled, reference) &&
+                policy_matches<BasicSolverSession<LaneJacobian, NormalEquationsSolve, ParallelExecution>>(compiled, reference) &&
+                policy_matches<BasicSolverSession<LaneJacobian, RuntimeLinearSolve, SequentialExecution>>(compiled, reference) &&
+                policy_matches<RuntimeSolverSession>(compiled, reference);
+            if(!same)
+            {
+                std::cerr << "Solver policies give different trajectories" << std::endl;
+                return 1;
+            }
+        }
+        std::cout << "All solver policies agree!" << std::endl;
+    }
+
+#ifdef MULTIBODY_PARALLEL_TBB
+    // Hierarchical scheduler: same trajectories as solving every system on its own
+    {
+        std::vector<CompiledSystem> batch;
+        batch.emplace_back(sys);
+        batch.emplace_back(driven);
+
+        SystemScheduler scheduler{2};
+        const auto scheduled = scheduler.solve(batch, 1.0);
+
+        bool same = scheduled.size() == batch.size();
+        for(std::size_t i = 0; same && i < batch.size(); i++)
+        {
+            const auto single = multibody_solver(batch[i], 1.0);
+            same = scheduled[i].size() == single.size();
+            for(std::size_t k = 0; same && k < single.size(); k++)
+                same = scheduled[i][k].getQ() == single[k].getQ();
+        }
+
+        // sys: 14 coordinates, 4 constraints; driven: 7 coordinates, 2 constraints. The budgets never
+        // add up to more threads than the scheduler has
+        if(!same || scheduler.getBudgets() != std::vector<int>{1, 1} ||
+           thread_budgets({56.0, 14.0}, 8) != std::vector<int>{6, 2} || thread_budgets({1.0, 1.0, 1.0}, 4) != std::vector<int>{2, 1, 1})
+        {
+            std::cerr << "Hierarchical scheduler differs from single solves" << std::endl;
+            return 1;
+        }
+        std::cout << "Hierarchical scheduler matches single solves!" << std::endl;
+
+        // the same batch as one flow graph
+        const auto flowed = flow_solver(batch, 1.0);
+        for(std::size_t i = 0; same && i < batch.size(); i++)
+        {
+            same = flowed[i].size() == scheduled[i].size();
+            for(std::size_t k = 0; same && k < flowed[i].size(); k++)
+                same = flowed[i][k].getQ() == scheduled[i][k].getQ() && flowed[i][k].getTime() == scheduled[i][k].getTime();
+        }
+
+        if(!same)
+        {
+            std::cerr << "Flow graph solver differs from single solves" << std::endl;
+            return 1;
+        }
+        std::cout << "Flow graph solver matches single solves!" << std::endl;
+
+        // NUMA batch: systems copied to their nodes, same results
+        NumaBatch numa{batch};
+        const auto placed = numa.solve(1.0);
+        for(std::size_t i = 0; same && i < batch.size(); i++)
+        {
+            same = placed[i].size() == scheduled[i].size() && numa.getNode(i) < numa.getNumNodes();
+            for(std::size_t k = 0; same && k < placed[i].size(); k++)
+                same = placed[i][k].getQ() == scheduled[i][k].getQ();
+        }
+
+        if(!same)
+        {
+            std::cerr << "NUMA batch differs from single solves" << std::endl;
+            return 1;
+        }
+        std::cout << "NUMA batch (" << numa.getNumNodes() << " nodes) matches single solves!" << std::endl;
+    }
+
+    // Worker processes write the trajectories into shared memory; no arena may be alive here
+    {
+        std::vector<CompiledSystem> batch;
+        batch.emplace_back(sys);
+        batch.emplace_back(driven);
+        batch.emplace_back(driven);
+
+        const auto shared = process_solver(batch, 1.0, 2);
+
+        bool same = shared.getNumSystems() == batch.size() && shared.getNumUnpinned() == 0;
+        for(std::size_t i = 0; same && i < batch.size(); i++)
+        {
+            const auto single = multibody_solver(batch[i], 1.0);
+            const auto states = shared.getStates(i);
+            same = states.size() == single.size();
+            for(std::size_t k = 0; same && k < single.size(); k++)
+                same = states[k].getQ() == single[k].getQ() && states[k].getTime() == single[k].getTime();
+        }
+
+        if(!same)
+        {
+            std::cerr << "Worker processes differ from single solves" << std::endl;
+            return 1;
+        }
+        std::cout << "Worker processes match single solves!" << std::endl;
+    }
+
+#endif
+
+    // Vector kernels give the same bits as the scalar kernels and agree with R() and r + R * p
+    {
+        const int count = 37;
+        Eigen::VectorXd q = Eigen::VectorXd::Random(count * 7);
+        Eigen::Matrix<double, 3, Eigen::Dynamic> points = Eigen::Matrix<double, 3, Eigen::Dynamic>::Random(3, count);
+        std::vector<std::int32_t> body(count);
+        for(int k = 0; k < count; k++)
+        {
+            body[k] = (k * 5) % count;
+        }
+
+        std::vector<Eigen::Matrix3d> rotations(count);
+        Eigen::Matrix<double, 3, Eigen::Dynamic> positions(3, count), expected(3, count), actual(3, count);
+        for(int k = 0; k < count; k++)
+        {
+            positions.col(k) = q.segment<3>(k * 7);
+        }
+        for(int k = 0; k < count; k++)
+        {
+            const int i = body[k];
+            expected.col(k) = positions.col(i) + R(q.segment<4>(i * 7 + 3)) * points.col(k);
+        }
+
+        bool exact = true;
+        Eigen::Matrix<double, 3, Eigen::Dynamic> scalar_result(3, count);
+        for(SimdLevel level : {SimdLevel::scalar, simd_supported_level()})
+        {
+            set_simd_level(level);
+            rotation_matrices(q.data() + 3, 7, count, rotations[0].data());
+            transform_points(rotations[0].data(), positions.data(), body.data(), points.data(), count, actual.data());
+
+            for(int k = 0; k < count; k++)
+            {
+                exact = exact && rotations[k].isApprox(R(q.segment<4>(k * 7 + 3)), 1e-14);
+            }
+            exact = exact && actual.isApprox(expected, 1e-14);
+
+            if(level == SimdLevel::scalar)
+                scalar_result = actual;
+            else
+                exact = exact && actual == scalar_result;
+        }
+        set_simd_level(simd_supported_level());
+
+        if(!exact)
+        {
+            std::cerr << "SIMD kernels (" << simd_level_name(simd_supported_level()) << ") differ from scalar code" << std::endl;
+            return 1;
+        }
+        std::cout << "SIMD kernels (" << simd_level_name(simd_level()) << ") match scalar code!" << std::endl;
+    }
+
+#if defined(COUNT_HEAP_ALLOCATIONS)
+    // Steady-state solver session: no heap allocations after the first step. The guarantee covers the
+    // normal-equations solver on one thread only; SparseQR allocates in every factorization
+    {
+        const ThreadLimit single_thread{1};
+
+        CompiledSystem compiled{driven};
+        NormalEquationsSession session{compiled};
+        Eigen::VectorXd q = compiled.getInitialQ();
+
+        // the first step pays for the symbolic analysis and the thread buffers
+        session.solve(q, 0.05);
+
+        const long before = heap_allocations;
+        for(int k = 1; k <= 10; k++)
+        {
+            session.solve(q, 0.1 * k);
+        }
+        const long allocated = heap_allocations - before;
+
+        if(allocated != 0 || std::abs(q(2) - cos(1.0)) > 1e-6)
+        {
+            std::cerr << "Solver session allocated " << allocated << " times in steady state, z = " << q(2) << std::endl;
+            return 1;
+        }
+        std::cout << "Solver session ran without allocations!" << std::endl;
+    }
+#endif
+
     return 0;
 }
\ No newline at end of file
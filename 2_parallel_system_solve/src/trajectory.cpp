@@ -0,0 +1,227 @@
+#include "trajectory.hpp"
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    // Below this angle slerp degenerates, normalized lerp is used instead
+    constexpr double slerp_threshold = 0.9995;
+
+    // Spherical interpolation of two unit quaternions with e0 . e1 >= 0 (shortest arc).
+    // Writes the interpolated quaternion and its derivative with respect to s.
+    void slerp(const Eigen::Vector4d& e0, const Eigen::Vector4d& e1, double s,
+               Eigen::Vector4d& e, Eigen::Vector4d& de_ds)
+    {
+        const double dot = e0.dot(e1);
+
+        if(dot > slerp_threshold)
+        {
+            Eigen::Vector4d lerp = e0 + s * (e1 - e0);
+            double norm = lerp.norm();
+            e = lerp / norm;
+            de_ds = (e1 - e0 - e * e.dot(e1 - e0)) / norm;
+            return;
+        }
+
+        double theta = std::acos(dot);
+        double sin_theta = std::sin(theta);
+        e = (std::sin((1.0 - s) * theta) * e0 + std::sin(s * theta) * e1) / sin_theta;
+        de_ds = theta * (-std::cos((1.0 - s) * theta) * e0 + std::cos(s * theta) * e1) / sin_theta;
+    }
+}
+
+Trajectory::Trajectory(const std::vector<State>& states)
+    : num_bodies(0)
+{
+    if(states.empty())
+        throw std::runtime_error("Trajectory requires at least one state");
+
+    num_bodies = static_cast<int>(states.front().getQ().size() / 7);
+    times.reserve(states.size());
+    positions.reserve(states.size());
+
+    for(const auto& state : states)
+    {
+        if(state.getQ().size() != num_bodies * 7)
+            throw std::runtime_error("Trajectory states differ in size");
+        if(!times.empty() && state.getTime() <= times.back())
+            throw std::runtime_error("Trajectory times must be strictly increasing");
+
+        times.push_back(state.getTime());
+        positions.push_back(state.getQ());
+    }
+
+    // e and -e are the same orientation; each node takes the sign closer to the previous one, so the
+    // slerp between nodes is the shortest arc and the interpolant has no sign jump at a node
+    for(std::size_t k = 1; k < positions.size(); k++)
+    {
+        for(int i = 0; i < num_bodies; i++)
+        {
+            if(positions[k].segment<4>(i * 7 + 3).dot(positions[k - 1].segment<4>(i * 7 + 3)) < 0.0)
+                positions[k].segment<4>(i * 7 + 3) = -positions[k].segment<4>(i * 7 + 3);
+        }
+    }
+
+    estimateVelocities();
+}
+
+Trajectory::Trajectory(const std::vector<State>& states, const std::vector<Eigen::VectorXd>& velocities)
+    : Trajectory(states)
+{
+    if(velocities.size() != states.size())
+        throw std::runtime_error("Trajectory needs one velocity vector per state");
+
+    for(std::size_t k = 0; k < velocities.size(); k++)
+    {
+        if(velocities[k].size() != num_bodies * 7)
+            throw std::runtime_error("Trajectory velocity differs in size");
+        this->velocities[k] = velocities[k];
+    }
+}
+
+// Three-point finite differences on a non-uniform grid (second order everywhere), one-sided at the ends
+void Trajectory::estimateVelocities()
+{
+    const std::size_t n = times.size();
+    velocities.assign(n, Eigen::VectorXd::Zero(num_bodies * 7));
+
+    if(n < 2)
+        return;
+
+    if(n == 2)
+    {
+        velocities[0] = (positions[1] - positions[0]) / (times[1] - times[0]);
+        velocities[1] = velocities[0];
+        return;
+    }
+
+    {
+        const double h0 = times[1] - times[0];
+        const double h1 = times[2] - times[1];
+        velocities[0] = -positions[0] * ((2 * h0 + h1) / (h0 * (h0 + h1))) + positions[1] * ((h0 + h1) / (h0 * h1))
+                      - positions[2] * (h0 / (h1 * (h0 + h1)));
+    }
+    {
+        const double h0 = times[n - 2] - times[n - 3];
+        const double h1 = times[n - 1] - times[n - 2];
+        velocities[n - 1] = positions[n - 3] * (h1 / (h0 * (h0 + h1))) - positions[n - 2] * ((h0 + h1) / (h0 * h1))
+                          + positions[n - 1] * ((2 * h1 + h0) / (h1 * (h0 + h1)));
+    }
+
+    for(std::size_t k = 1; k + 1 < n; k++)
+    {
+        double h0 = times[k] - times[k - 1];
+        double h1 = times[k + 1] - times[k];
+        velocities[k] = ((positions[k + 1] - positions[k]) * (h0 / h1)
+                      + (positions[k] - positions[k - 1]) * (h1 / h0)) / (h0 + h1);
+    }
+}
+
+std::size_t Trajectory::segment(double t) const
+{
+    auto it = std::upper_bound(times.begin(), times.end(), t);
+    std::size_t k = static_cast<std::size_t>(std::distance(times.begin(), it));
+    if(k == 0)
+        return 0;
+    return std::min(k - 1, times.size() - 2);
+}
+
+State Trajectory::at(double t) const
+{
+    Eigen::VectorXd q;
+    at(t, q);
+    return State{q, t};
+}
+
+void Trajectory::at(double t, Eigen::VectorXd& q) const
+{
+    q.resize(num_bodies * 7);
+
+    if(times.size() == 1 || t <= times.front())
+    {
+        q = positions.front();
+        return;
+    }
+    if(t >= times.back())
+    {
+        q = positions.back();
+        return;
+    }
+
+    const std::size_t k = segment(t);
+    const double h = times[k + 1] - times[k];
+    const double s = (t - times[k]) / h;
+
+    // at a node the stored state itself, not its rounded reconstruction
+    if(s == 0.0)
+    {
+        q = positions[k];
+        return;
+    }
+
+    // Cubic Hermite basis
+    const double h00 = (1 + 2 * s) * (1 - s) * (1 - s);
+    const double h10 = s * (1 - s) * (1 - s);
+    const double h01 = s * s * (3 - 2 * s);
+    const double h11 = s * s * (s - 1);
+
+    Eigen::Vector4d e, de_ds;
+    for(int i = 0; i < num_bodies; i++)
+    {
+        q.segment<3>(i * 7) = h00 * positions[k].segment<3>(i * 7) + h10 * h * velocities[k].segment<3>(i * 7)
+                            + h01 * positions[k + 1].segment<3>(i * 7) + h11 * h * velocities[k + 1].segment<3>(i * 7);
+
+        slerp(positions[k].segment<4>(i * 7 + 3), positions[k + 1].segment<4>(i * 7 + 3), s, e, de_ds);
+        q.segment<4>(i * 7 + 3) = e;
+    }
+}
+
+Eigen::VectorXd Trajectory::velocity(double t) const
+{
+    Eigen::VectorXd qd = Eigen::VectorXd::Zero(num_bodies * 7);
+
+    if(times.size() == 1)
+        return qd;
+
+    // the ends use the derivative of their segment, like every other point
+    t = std::clamp(t, times.front(), times.back());
+    const std::size_t k = segment(t);
+    const double h = times[k + 1] - times[k];
+    const double s = (t - times[k]) / h;
+
+    // Derivatives of the cubic Hermite basis with respect to s
+    const double dh00 = 6 * s * s - 6 * s;
+    const double dh10 = 3 * s * s - 4 * s + 1;
+    const double dh01 = -6 * s * s + 6 * s;
+    const double dh11 = 3 * s * s - 2 * s;
+
+    Eigen::Vector4d e, de_ds;
+    for(int i = 0; i < num_bodies; i++)
+    {
+        qd.segment<3>(i * 7) = (dh00 * positions[k].segment<3>(i * 7) + dh01 * positions[k + 1].segment<3>(i * 7)) / h
+                             + dh10 * velocities[k].segment<3>(i * 7) + dh11 * velocities[k + 1].segment<3>(i * 7);
+
+        slerp(positions[k].segment<4>(i * 7 + 3), positions[k + 1].segment<4>(i * 7 + 3), s, e, de_ds);
+        qd.segment<4>(i * 7 + 3) = de_ds / h;
+    }
+
+    return qd;
+}
+
+double Trajectory::getStartTime() const
+{
+    return times.front();
+}
+
+double Trajectory::getEndTime() const
+{
+    return times.back();
+}
+
+int Trajectory::getNumSamples() const
+{
+    return static_cast<int>(times.size());
+}
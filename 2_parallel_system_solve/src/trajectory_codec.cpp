@@ -0,0 +1,299 @@
+#include "trajectory_codec.hpp"
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    // Quantized values stay exact in a double and their differences in an int64
+    constexpr double max_quantized = 4503599627370496.0; // 2^52
+
+    // Rice quotients from this length on are replaced by the raw 64-bit value
+    constexpr int escape_length = 32;
+
+    std::uint64_t low_bits(int n)
+    {
+        return n == 0 ? 0 : ~std::uint64_t{0} >> (64 - n);
+    }
+
+    std::uint64_t zigzag(std::int64_t value)
+    {
+        return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    }
+
+    std::int64_t unzigzag(std::uint64_t value)
+    {
+        return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+    }
+
+    std::int64_t quantize(double value, double step)
+    {
+        const double scaled = std::nearbyint(value / step);
+        if(!(std::abs(scaled) <= max_quantized))
+            throw std::runtime_error("Trajectory value out of range of the compression tolerance");
+        return static_cast<std::int64_t>(scaled);
+    }
+
+    // Bits appended least significant first
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<unsigned char>& out) : out(out) {}
+
+        // n <= 32, bits above n must be zero
+        void put(std::uint64_t bits, int n)
+        {
+            buffer |= bits << count;
+            count += n;
+            while(count >= 8)
+            {
+                out.push_back(static_cast<unsigned char>(buffer));
+                buffer >>= 8;
+                count -= 8;
+            }
+        }
+
+        void putWide(std::uint64_t bits, int n)
+        {
+            if(n > 32)
+            {
+                put(bits & low_bits(32), 32);
+                put(bits >> 32, n - 32);
+            }
+            else
+            {
+                put(bits, n);
+            }
+        }
+
+        void rice(std::uint64_t value, int k)
+        {
+            const std::uint64_t quotient = value >> k;
+            if(quotient < static_cast<std::uint64_t>(escape_length))
+            {
+                // quotient ones closed by a zero
+                put(low_bits(static_cast<int>(quotient)), static_cast<int>(quotient) + 1);
+                putWide(value & low_bits(k), k);
+            }
+            else
+            {
+                put(low_bits(escape_length), escape_length);
+                putWide(value, 64);
+            }
+        }
+
+        void flush()
+        {
+            if(count > 0)
+                out.push_back(static_cast<unsigned char>(buffer));
+            buffer = 0;
+            count = 0;
+        }
+
+    private:
+        std::vector<unsigned char>& out;
+        std::uint64_t buffer = 0;
+        int count = 0;
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const unsigned char* data, std::size_t bytes) : data(data), bytes(bytes) {}
+
+        // n <= 32
+        std::uint64_t get(int n)
+        {
+            while(count < n)
+            {
+                if(position == bytes)
+                    throw std::runtime_error("Corrupted compressed trajectory chunk");
+                buffer |= static_cast<std::uint64_t>(data[position++]) << count;
+                count += 8;
+            }
+            const std::uint64_t bits = buffer & low_bits(n);
+            buffer >>= n;
+            count -= n;
+            return bits;
+        }
+
+        std::uint64_t getWide(int n)
+        {
+            if(n > 32)
+            {
+                const std::uint64_t low = get(32);
+                return low | get(n - 32) << 32;
+            }
+            return get(n);
+        }
+
+        std::uint64_t rice(int k)
+        {
+            int quotient = 0;
+            while(quotient < escape_length && get(1) == 1)
+                quotient++;
+            if(quotient == escape_length)
+                return getWide(64);
+            return static_cast<std::uint64_t>(quotient) << k | getWide(k);
+        }
+
+    private:
+        const unsigned char* data;
+        std::size_t bytes;
+        std::size_t position = 0;
+        std::uint64_t buffer = 0;
+        int count = 0;
+    };
+}
+
+TrajectoryCodec::TrajectoryCodec(std::size_t num_bodies, const TrajectoryCompression& compression)
+    : TrajectoryCodec(num_bodies, 2.0 * compression.position_tolerance, 0.5 * compression.orientation_tolerance)
+{
+}
+
+TrajectoryCodec::TrajectoryCodec(std::size_t num_bodies, double position_step, double orientation_step)
+    : num_bodies(num_bodies), position_step(position_step), orientation_step(orientation_step)
+{
+    if(!(position_step > 0.0) || !(orientation_step > 0.0))
+        throw std::runtime_error("Trajectory compression tolerances must be positive");
+}
+
+void TrajectoryCodec::encode(const double* columns, std::size_t steps, std::vector<unsigned char>& out)
+{
+    values.resize(7 * num_bodies * steps);
+
+    for(std::size_t b = 0; b < num_bodies; b++)
+    {
+        const std::size_t body = 7 * b;
+        for(std::size_t c = body; c < body + 3; c++)
+        {
+            for(std::size_t s = 0; s < steps; s++)
+            {
+                values[c * steps + s] = quantize(columns[c * steps + s], position_step);
+            }
+        }
+
+        // smallest three: columns body + 3 .. body + 5 hold the other components,
+        // column body + 6 the index of the largest one and its sign
+        for(std::size_t s = 0; s < steps; s++)
+        {
+            std::size_t largest = 0;
+            for(std::size_t m = 1; m < 4; m++)
+            {
+                if(std::abs(columns[(body + 3 + m) * steps + s]) > std::abs(columns[(body + 3 + largest) * steps + s]))
+                    largest = m;
+            }
+
+            std::size_t slot = body + 3;
+            for(std::size_t m = 0; m < 4; m++)
+            {
+                if(m != largest)
+                    values[slot++ * steps + s] = quantize(columns[(body + 3 + m) * steps + s], orientation_step);
+            }
+            const bool negative = columns[(body + 3 + largest) * steps + s] < 0.0;
+            values[(body + 6) * steps + s] = static_cast<std::int64_t>(2 * largest + (negative ? 1 : 0));
+        }
+    }
+
+    BitWriter writer{out};
+    for(std::size_t c = 0; c < 7 * num_bodies; c++)
+    {
+        const std::int64_t* column = values.data() + c * steps;
+        if(steps == 0)
+            continue;
+
+        // first value as its bit length and bits, so that it does not inflate the Rice parameter
+        const std::uint64_t first = zigzag(column[0]);
+        int length = 0;
+        while(length < 64 && (first >> length) != 0)
+            length++;
+        writer.put(static_cast<std::uint64_t>(length), 7);
+        writer.putWide(first, length);
+
+        // Rice parameter near log2 of the mean magnitude of the differences
+        double sum = 0.0;
+        for(std::size_t s = 1; s < steps; s++)
+        {
+            sum += static_cast<double>(zigzag(column[s] - column[s - 1]));
+        }
+        const double mean = steps > 1 ? 0.69 * sum / static_cast<double>(steps - 1) : 0.0;
+        const int k = mean >= 2.0 ? std::min(std::ilogb(mean), 60) : 0;
+
+        writer.put(static_cast<std::uint64_t>(k), 6);
+        for(std::size_t s = 1; s < steps; s++)
+        {
+            writer.rice(zigzag(column[s] - column[s - 1]), k);
+        }
+    }
+    writer.flush();
+}
+
+void TrajectoryCodec::decode(const unsigned char* data, std::size_t bytes, std::size_t steps, double* columns)
+{
+    values.resize(7 * num_bodies * steps);
+
+    BitReader reader{data, bytes};
+    for(std::size_t c = 0; c < 7 * num_bodies; c++)
+    {
+        std::int64_t* column = values.data() + c * steps;
+        if(steps == 0)
+            continue;
+
+        const int length = static_cast<int>(reader.get(7));
+        if(length > 64)
+            throw std::runtime_error("Corrupted compressed trajectory chunk");
+        column[0] = unzigzag(reader.getWide(length));
+
+        const int k = static_cast<int>(reader.get(6));
+        if(k > 60)
+            throw std::runtime_error("Corrupted compressed trajectory chunk");
+        for(std::size_t s = 1; s < steps; s++)
+        {
+            column[s] = column[s - 1] + unzigzag(reader.rice(k));
+        }
+    }
+
+    for(std::size_t b = 0; b < num_bodies; b++)
+    {
+        const std::size_t body = 7 * b;
+        for(std::size_t c = body; c < body + 3; c++)
+        {
+            for(std::size_t s = 0; s < steps; s++)
+            {
+                columns[c * steps + s] = static_cast<double>(values[c * steps + s]) * position_step;
+            }
+        }
+
+        for(std::size_t s = 0; s < steps; s++)
+        {
+            const std::int64_t tag = values[(body + 6) * steps + s];
+            if(tag < 0 || tag > 7)
+                throw std::runtime_error("Corrupted compressed trajectory chunk");
+            const std::size_t largest = static_cast<std::size_t>(tag / 2);
+
+            double squares = 0.0;
+            std::size_t slot = body + 3;
+            for(std::size_t m = 0; m < 4; m++)
+            {
+                if(m == largest)
+                    continue;
+                const double component = static_cast<double>(values[slot++ * steps + s]) * orientation_step;
+                columns[(body + 3 + m) * steps + s] = component;
+                squares += component * component;
+            }
+            const double dropped = std::sqrt(std::max(0.0, 1.0 - squares));
+            columns[(body + 3 + largest) * steps + s] = tag % 2 == 1 ? -dropped : dropped;
+        }
+    }
+}
+
+double TrajectoryCodec::getPositionStep() const
+{
+    return position_step;
+}
+
+double TrajectoryCodec::getOrientationStep() const
+{
+    return orientation_step;
+}
@@ -0,0 +1,478 @@
+#include "trajectory_writer.hpp"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
+#include <utility>
+#include <eigen3/Eigen/Dense>
+
+namespace
+{
+    const char trajectory_magic[8] = {'M', 'B', 'T', 'R', 'A', 'J', '\0', '\0'};
+
+    // Fixed-size header at the start of the file, rewritten by close()
+    struct TrajectoryHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        TrajectoryEncoding encoding;
+        std::uint64_t num_bodies;
+        std::uint64_t chunk_steps;
+        std::uint64_t num_steps;
+        std::uint64_t num_chunks;
+        std::uint64_t index_offset;
+        double position_step;     // compressed only
+        double orientation_step;
+    };
+
+    // Start of every chunk, followed by the time stamps of its steps and then its data
+    struct ChunkHeader
+    {
+        std::uint64_t steps;
+        std::uint64_t bytes;
+    };
+
+    template<typename T>
+    void write_array(std::ofstream& file, const T* data, std::size_t size)
+    {
+        file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size * sizeof(T)));
+    }
+
+    template<typename T>
+    void read_array(std::ifstream& file, T* data, std::size_t size)
+    {
+        file.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(size * sizeof(T)));
+    }
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string& path, const std::vector<long int>& body_ids,
+                                   std::size_t chunk_steps, std::size_t queue_capacity)
+    : TrajectoryWriter(path, body_ids, nullptr, chunk_steps, queue_capacity)
+{
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string& path, const std::vector<long int>& body_ids,
+                                   const TrajectoryCompression& compression,
+                                   std::size_t chunk_steps, std::size_t queue_capacity)
+    : TrajectoryWriter(path, body_ids, std::make_unique<TrajectoryCodec>(body_ids.size(), compression),
+                       chunk_steps, queue_capacity)
+{
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string& path, const std::vector<long int>& body_ids,
+                                   std::unique_ptr<TrajectoryCodec> codec, std::size_t chunk_steps,
+                                   std::size_t queue_capacity)
+    : file(path, std::ios::binary | std::ios::trunc), path(path), body_ids(body_ids),
+      num_coordinates(7 * body_ids.size()), chunk_steps(std::max<std::size_t>(chunk_steps, 1)),
+      queue(queue_capacity, Sample{Eigen::VectorXd::Zero(static_cast<Eigen::Index>(7 * body_ids.size())), 0.0}),
+      columns(this->chunk_steps * num_coordinates), times(this->chunk_steps), codec(std::move(codec))
+{
+    if(!file)
+        throw std::runtime_error("Cannot create trajectory file: " + path);
+
+    // placeholder header, completed by close()
+    writeHeader(0, 0, 0);
+
+    std::vector<std::int64_t> ids(body_ids.begin(), body_ids.end());
+    write_array(file, ids.data(), ids.size());
+    if(!file)
+        throw std::runtime_error("Cannot write trajectory file: " + path);
+
+    writer = std::thread{&TrajectoryWriter::run, this};
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    try
+    {
+        close();
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+void TrajectoryWriter::push(const Eigen::VectorXd& q, double t)
+{
+    if(closed)
+        throw std::runtime_error("Trajectory file already closed: " + path);
+    if(static_cast<std::size_t>(q.size()) != num_coordinates)
+        throw std::runtime_error("Trajectory state size does not match the number of bodies");
+
+    Sample* sample = queue.prepare();
+    while(!sample)
+    {
+        // the writer is behind; its pace is the limit anyway
+        num_stalls++;
+        std::this_thread::yield();
+        sample = queue.prepare();
+    }
+
+    // same size as the preallocated slot: a plain copy, no allocation
+    sample->q = q;
+    sample->t = t;
+    queue.publish();
+}
+
+void TrajectoryWriter::close()
+{
+    if(closed)
+        return;
+    closed = true;
+
+    closing.store(true, std::memory_order_release);
+    writer.join();
+
+    if(error)
+        std::rethrow_exception(error);
+}
+
+std::size_t TrajectoryWriter::getNumStalls() const
+{
+    return num_stalls;
+}
+
+void TrajectoryWriter::run()
+{
+    std::size_t steps = 0;
+    int idle = 0;
+    for(;;)
+    {
+        Sample* sample = queue.front();
+        if(!sample)
+        {
+            // everything pushed before close() is visible once closing is
+            if(closing.load(std::memory_order_acquire))
+            {
+                sample = queue.front();
+                if(!sample)
+                    break;
+            }
+            else
+            {
+                // short spin for bursts, then sleep so an idle writer leaves the cores to the solver
+                if(++idle < 64)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+        }
+        idle = 0;
+
+        if(!error)
+        {
+            // transpose into the chunk: one column per coordinate
+            for(std::size_t c = 0; c < num_coordinates; c++)
+            {
+                columns[c * chunk_steps + steps] = sample->q(static_cast<Eigen::Index>(c));
+            }
+            times[steps] = sample->t;
+            steps++;
+        }
+        queue.pop();
+
+        if(steps == chunk_steps)
+        {
+            writeChunk(steps);
+            steps = 0;
+        }
+    }
+
+    if(error)
+        return;
+
+    if(steps > 0)
+    {
+        // close the gaps of a partial chunk: column c moves to [c * steps, (c + 1) * steps)
+        for(std::size_t c = 1; c < num_coordinates; c++)
+        {
+            std::copy(columns.begin() + c * chunk_steps, columns.begin() + c * chunk_steps + steps,
+                      columns.begin() + c * steps);
+        }
+        writeChunk(steps);
+    }
+    if(error)
+        return;
+
+    try
+    {
+        const std::size_t num_chunks = chunk_offsets.size();
+        const auto index_offset = static_cast<std::uint64_t>(file.tellp());
+
+        chunk_offsets.push_back(index_offset);
+        write_array(file, chunk_offsets.data(), chunk_offsets.size());
+
+        file.seekp(0);
+        writeHeader(num_steps, num_chunks, index_offset);
+        file.close();
+        if(!file)
+            throw std::runtime_error("Cannot write trajectory file: " + path);
+    }
+    catch(...)
+    {
+        error = std::current_exception();
+    }
+}
+
+void TrajectoryWriter::writeChunk(std::size_t steps)
+{
+    if(error)
+        return;
+
+    try
+    {
+        chunk_offsets.push_back(static_cast<std::uint64_t>(file.tellp()));
+        if(codec)
+        {
+            encoded.clear();
+            codec->encode(columns.data(), steps, encoded);
+        }
+
+        // the chunk carries its own time stamps, so it can be read before the index exists
+        const ChunkHeader chunk{steps, codec ? encoded.size() : steps * num_coordinates * sizeof(double)};
+        write_array(file, &chunk, 1);
+        write_array(file, times.data(), steps);
+        if(codec)
+            write_array(file, encoded.data(), encoded.size());
+        else
+            write_array(file, columns.data(), steps * num_coordinates);
+
+        // a complete chunk reaches the file even if close() never comes
+        file.flush();
+        if(!file)
+            throw std::runtime_error("Cannot write trajectory file: " + path);
+        num_steps += steps;
+    }
+    catch(...)
+    {
+        // keep draining the queue, so that push() never waits for a failed writer
+        error = std::current_exception();
+    }
+}
+
+void TrajectoryWriter::writeHeader(std::uint64_t num_steps, std::uint64_t num_chunks, std::uint64_t index_offset)
+{
+    TrajectoryHeader header{};
+    std::memcpy(header.magic, trajectory_magic, sizeof(header.magic));
+    header.version = trajectory_file_version;
+    header.encoding = codec ? TrajectoryEncoding::compressed : TrajectoryEncoding::raw;
+    header.num_bodies = body_ids.size();
+    header.chunk_steps = chunk_steps;
+    header.num_steps = num_steps;
+    header.num_chunks = num_chunks;
+    header.index_offset = index_offset;
+    header.position_step = codec ? codec->getPositionStep() : 0.0;
+    header.orientation_step = codec ? codec->getOrientationStep() : 0.0;
+    write_array(file, &header, 1);
+}
+
+TrajectoryReader::TrajectoryReader(const std::string& path)
+    : file(path, std::ios::binary), path(path)
+{
+    if(!file)
+        throw std::runtime_error("Cannot open trajectory file: " + path);
+
+    TrajectoryHeader header;
+    read_array(file, &header, 1);
+    if(!file || std::memcmp(header.magic, trajectory_magic, sizeof(header.magic)) != 0)
+        throw std::runtime_error("Not a trajectory file: " + path);
+    if(header.version != trajectory_file_version)
+        throw std::runtime_error("Unsupported trajectory file version " + std::to_string(header.version) + ": " + path);
+    if(header.encoding == TrajectoryEncoding::compressed)
+        codec = std::make_unique<TrajectoryCodec>(header.num_bodies, header.position_step, header.orientation_step);
+    else if(header.encoding != TrajectoryEncoding::raw)
+        throw std::runtime_error("Unknown trajectory encoding: " + path);
+
+    std::vector<std::int64_t> ids(header.num_bodies);
+    read_array(file, ids.data(), ids.size());
+    body_ids.assign(ids.begin(), ids.end());
+    num_coordinates = 7 * body_ids.size();
+    chunk_steps = header.chunk_steps;
+
+    if(!file || chunk_steps == 0)
+        throw std::runtime_error("Corrupted trajectory file: " + path);
+
+    // not closed: no index, the chunks written so far describe themselves
+    if(header.index_offset == 0)
+    {
+        scanChunks(static_cast<std::uint64_t>(file.tellg()));
+        return;
+    }
+
+    if(header.num_chunks != (header.num_steps + chunk_steps - 1) / chunk_steps)
+        throw std::runtime_error("Corrupted trajectory file: " + path);
+
+    chunk_offsets.resize(header.num_chunks + 1);
+    file.seekg(static_cast<std::streamoff>(header.index_offset));
+    read_array(file, chunk_offsets.data(), chunk_offsets.size());
+    if(!file)
+        throw std::runtime_error("Corrupted trajectory file: " + path);
+
+    times.reserve(header.num_steps);
+    for(std::size_t chunk = 0; chunk < header.num_chunks; chunk++)
+    {
+        const std::size_t steps = std::min<std::uint64_t>(chunk_steps, header.num_steps - chunk * chunk_steps);
+        if(readChunkTimes(chunk_offsets[chunk]) != steps)
+            throw std::runtime_error("Corrupted trajectory file: " + path);
+    }
+}
+
+std::size_t TrajectoryReader::readChunkTimes(std::uint64_t offset)
+{
+    ChunkHeader chunk;
+    file.seekg(static_cast<std::streamoff>(offset));
+    read_array(file, &chunk, 1);
+    if(!file || chunk.steps == 0 || chunk.steps > chunk_steps)
+        throw std::runtime_error("Corrupted trajectory file: " + path);
+
+    const std::size_t first = times.size();
+    times.resize(first + chunk.steps);
+    read_array(file, times.data() + first, chunk.steps);
+    if(!file)
+        throw std::runtime_error("Cannot read trajectory file: " + path);
+    return chunk.steps;
+}
+
+void TrajectoryReader::scanChunks(std::uint64_t first_offset)
+{
+    closed = false;
+    file.seekg(0, std::ios::end);
+    const auto file_bytes = static_cast<std::uint64_t>(file.tellg());
+
+    std::uint64_t offset = first_offset;
+    while(file_bytes - offset >= sizeof(ChunkHeader))
+    {
+        ChunkHeader chunk;
+        file.seekg(static_cast<std::streamoff>(offset));
+        read_array(file, &chunk, 1);
+        if(!file || chunk.steps == 0 || chunk.steps > chunk_steps ||
+           (!chunk_offsets.empty() && times.size() % chunk_steps != 0))
+            throw std::runtime_error("Corrupted trajectory file: " + path);
+
+        // a chunk cut short by the end of the file was still being written
+        const std::uint64_t available = file_bytes - offset - sizeof(ChunkHeader);
+        if(chunk.steps * sizeof(double) > available || chunk.bytes > available - chunk.steps * sizeof(double))
+            break;
+
+        readChunkTimes(offset);
+        chunk_offsets.push_back(offset);
+        offset += sizeof(ChunkHeader) + chunk.steps * sizeof(double) + chunk.bytes;
+    }
+    chunk_offsets.push_back(offset);
+    file.clear();
+}
+
+std::size_t TrajectoryReader::getNumBodies() const
+{
+    return body_ids.size();
+}
+
+std::size_t TrajectoryReader::getNumSteps() const
+{
+    return times.size();
+}
+
+std::size_t TrajectoryReader::getChunkSteps() const
+{
+    return chunk_steps;
+}
+
+TrajectoryEncoding TrajectoryReader::getEncoding() const
+{
+    return codec ? TrajectoryEncoding::compressed : TrajectoryEncoding::raw;
+}
+
+const std::vector<long int>& TrajectoryReader::getBodyIds() const
+{
+    return body_ids;
+}
+
+const std::vector<double>& TrajectoryReader::getTimes() const
+{
+    return times;
+}
+
+bool TrajectoryReader::isClosed() const
+{
+    return closed;
+}
+
+std::vector<State> TrajectoryReader::read(std::size_t first, std::size_t count)
+{
+    if(first > times.size() || count > times.size() - first)
+        throw std::runtime_error("Trajectory steps out of range: " + path);
+
+    std::vector<State> states;
+    states.reserve(count);
+    std::vector<double> columns;
+    Eigen::VectorXd q(static_cast<Eigen::Index>(num_coordinates));
+
+    std::size_t step = first;
+    while(step < first + count)
+    {
+        const std::size_t chunk = step / chunk_steps;
+        const std::size_t chunk_first = chunk * chunk_steps;
+        const std::size_t steps = std::min(chunk_steps, times.size() - chunk_first);
+        readChunk(chunk, columns);
+
+        const std::size_t last = std::min(first + count, chunk_first + steps);
+        for(; step < last; step++)
+        {
+            for(std::size_t c = 0; c < num_coordinates; c++)
+            {
+                q(static_cast<Eigen::Index>(c)) = columns[c * steps + step - chunk_first];
+            }
+            states.emplace_back(q, times[step]);
+        }
+    }
+
+    return states;
+}
+
+std::vector<State> TrajectoryReader::readWindow(double begin_time, double end_time)
+{
+    // time stamps grow with the step number
+    const auto first = std::lower_bound(times.begin(), times.end(), begin_time);
+    const auto last = std::upper_bound(first, times.end(), end_time);
+    return read(static_cast<std::size_t>(first - times.begin()), static_cast<std::size_t>(last - first));
+}
+
+std::vector<State> TrajectoryReader::readAll()
+{
+    return read(0, times.size());
+}
+
+void TrajectoryReader::readChunk(std::size_t chunk, std::vector<double>& columns)
+{
+    // the data follow the chunk header and the time stamps, which are already in times
+    const std::size_t steps = std::min(chunk_steps, times.size() - chunk * chunk_steps);
+    const std::uint64_t data_offset = chunk_offsets[chunk] + sizeof(ChunkHeader) + steps * sizeof(double);
+    if(chunk_offsets[chunk + 1] < data_offset)
+        throw std::runtime_error("Corrupted trajectory file: " + path);
+    const std::uint64_t bytes = chunk_offsets[chunk + 1] - data_offset;
+    if(!codec && bytes != steps * num_coordinates * sizeof(double))
+        throw std::runtime_error("Corrupted trajectory file: " + path);
+
+    columns.resize(steps * num_coordinates);
+    file.seekg(static_cast<std::streamoff>(data_offset));
+    if(codec)
+    {
+        encoded.resize(bytes);
+        read_array(file, encoded.data(), encoded.size());
+    }
+    else
+    {
+        read_array(file, columns.data(), columns.size());
+    }
+    if(!file)
+        throw std::runtime_error("Cannot read trajectory file: " + path);
+
+    if(codec)
+        codec->decode(encoded.data(), encoded.size(), steps, columns.data());
+}
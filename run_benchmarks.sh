@@ -1,9 +1,13 @@
 #!/bin/bash
 
-BENCHMARKS=(
-  "0_unoptimized/build/benchmark"
-  "1_parallel_jacobian/build/benchmark"
-  "2_parallel_system_solve/build/benchmark"
+# Jeden program benchmarku; dawne warianty 0_unoptimized i 1_parallel_jacobian
+# to strategie sesji (solver_policies.hpp) wybierane filtrem
+BENCHMARK="2_parallel_system_solve/build/benchmark"
+
+FILTERS=(
+  "Policy solve columns/sparse QR/sequential"
+  "Policy solve columns/sparse QR/parallel"
+  "Par System solve|Policy solve lanes"
 )
 
 OUTPUT_FILES=(
@@ -18,9 +22,9 @@ BENCHMARK_OPTS="--benchmark_format=csv"
 
 mkdir -p "$OUTPUT_DIR"
 
-for i in "${!BENCHMARKS[@]}"; do
-  echo "Uruchamiam benchmark: ${BENCHMARKS[i]}"
-  "${BENCHMARKS[i]}" $BENCHMARK_OPTS > "${OUTPUT_DIR}/${OUTPUT_FILES[i]}.csv"
+for i in "${!FILTERS[@]}"; do
+  echo "Uruchamiam benchmark: ${BENCHMARK} (${FILTERS[i]})"
+  "${BENCHMARK}" $BENCHMARK_OPTS --benchmark_filter="${FILTERS[i]}" > "${OUTPUT_DIR}/${OUTPUT_FILES[i]}.csv"
   echo "Wynik zapisano do: ${OUTPUT_DIR}/${OUTPUT_FILES[i]}.csv"
 done
 